@@ -0,0 +1,36 @@
+#ifndef __ALIASANALYSIS_H__
+#define __ALIASANALYSIS_H__
+
+#include <map>
+#include <set>
+#include <vector>
+#include "Function.h"
+
+/*
+    Alias analysis for IR memory accesses:
+        1) 前端对GEP的结果换类型时新建同label的操作数，这些操作数没有def，按label找回GEP
+        2) 沿GEP链找到数组的基址：局部数组(alloca)、全局变量或参数传入的指针；
+           指针PHI的各个来源基址相同时取该基址，否则基址未知，与任何地址都可能别名
+        3) 不同的局部数组/全局变量互不别名；参数传入的指针可能指向任意全局变量或调用者的数组，但不会指向本函数的局部变量
+        4) 除只读的库函数外，函数调用都可能写内存
+*/
+class AliasAnalysis
+{
+private:
+    std::map<int, Instruction *> label_defs; // label -> 定义该label的GEP或指针PHI
+    std::map<int, std::vector<Operand *>> aliases;
+    Operand *getBase(Operand *, std::set<Instruction *> &visited);
+    bool sameValue(Operand *, Operand *);
+
+public:
+    AliasAnalysis(Function *func);
+    // 操作数的定值指令，别名操作数返回对应的GEP
+    Instruction *getDef(Operand *);
+    Operand *getBase(Operand *);
+    bool mayAlias(Operand *, Operand *);
+    // 删除冗余的GEP，别名操作数改用等价GEP的label
+    void replaceGep(Instruction *gep, Operand *leader);
+    static bool mayWriteMemory(Instruction *call);
+};
+
+#endif
@@ -27,6 +27,7 @@ public:
     void insertFront(Instruction *);
     void insertBack(Instruction *);
     void insertBefore(Instruction *, Instruction *);
+    void insertBeforeTerminator(Instruction *);
     void remove(Instruction *);
     bool empty() const { return head->getNext() == head; }
     void output() const;
@@ -36,6 +37,7 @@ public:
     void removeSucc(BasicBlock *);
     void addPred(BasicBlock *);
     void removePred(BasicBlock *);
+    void replaceSucc(BasicBlock *from, BasicBlock *to);
     int getNo() { return no; };
     Function *getParent() { return parent; };
     Instruction *begin() { return head->getNext(); };
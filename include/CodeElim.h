@@ -0,0 +1,43 @@
+#ifndef __CODEELIM_H__
+#define __CODEELIM_H__
+
+#include <map>
+#include <set>
+#include <vector>
+#include "Unit.h"
+#include "DominatorTree.h"
+#include "AliasAnalysis.h"
+
+/*
+    Aggressive dead code elimination for SSA IR:
+        1) 先假定所有指令都是死的，以store、有副作用的函数调用和ret为根；到达不了出口的块(死循环)的分支也是根
+        2) 活跃指令的操作数的定值活跃，所在块控制依赖的条件分支活跃；活跃PHI的每个前驱块的分支活跃
+        3) 控制依赖为后支配树上的反向支配边界；不活跃的条件分支改为跳到后支配树中离出口最近的后继，
+           只剩无用计算的分支、循环由此变为不可达后删除
+        4) 不写非局部内存、不做输入输出、只调用同样无副作用的函数的函数，结果不用时调用可以删除
+    无条件分支总是保留，剩下的空块由simplify-cfg合并。
+*/
+class DeadCodeElim
+{
+private:
+    Unit *unit;
+    std::map<SymbolEntry *, Function *> funcs;
+    std::set<Function *> side_effects; // 有副作用的函数
+    AliasAnalysis *AA = nullptr;
+    std::map<BasicBlock *, std::set<BasicBlock *>> RDF; // 块 -> 它控制依赖的块
+    std::set<Instruction *> live;
+    std::set<BasicBlock *> live_blocks;
+    std::vector<Instruction *> worklist;
+    void computeSideEffects();
+    bool isRoot(Instruction *inst);
+    void markLive(Instruction *inst);
+    void mark(Function *func, DominatorTree *PDT);
+    void sweep(Function *func, DominatorTree *PDT);
+    void removeUnreachable(Function *func);
+
+public:
+    DeadCodeElim(Unit *unit) : unit(unit){};
+    void pass();
+};
+
+#endif
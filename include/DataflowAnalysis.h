@@ -0,0 +1,276 @@
+#ifndef __DATAFLOW_ANALYSIS_H__
+#define __DATAFLOW_ANALYSIS_H__
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
+
+/*
+    Bit-vector dataflow framework:
+        1) 分析对象(值、use等)由使用者稠密编号，集合用按64位打包的BitVector表示
+        2) 基本块同样稠密编号，图只保存前驱/后继编号
+        3) worklist按逆后序(前向)或后序(后向)的优先级出队，块只有在输入变化时才重新入队
+*/
+class BitVector
+{
+private:
+    typedef uint64_t word_t;
+    static const int WORD_BITS = 64;
+    std::vector<word_t> words;
+    int num_bits;
+    void clearUnusedBits()
+    {
+        if (num_bits % WORD_BITS)
+            words.back() &= (word_t(1) << (num_bits % WORD_BITS)) - 1;
+    }
+
+public:
+    BitVector(int n = 0, bool val = false) : words((n + WORD_BITS - 1) / WORD_BITS, val ? ~word_t(0) : 0), num_bits(n) { clearUnusedBits(); };
+    int size() const { return num_bits; };
+    bool test(int i) const { return (words[i / WORD_BITS] >> (i % WORD_BITS)) & 1; };
+    void set(int i) { words[i / WORD_BITS] |= word_t(1) << (i % WORD_BITS); };
+    void reset(int i) { words[i / WORD_BITS] &= ~(word_t(1) << (i % WORD_BITS)); };
+    void setAll()
+    {
+        for (auto &w : words)
+            w = ~word_t(0);
+        clearUnusedBits();
+    };
+    void resetAll()
+    {
+        for (auto &w : words)
+            w = 0;
+    };
+    // [begin, end)
+    void setRange(int begin, int end)
+    {
+        for (; begin < end && begin % WORD_BITS; begin++)
+            set(begin);
+        for (; begin + WORD_BITS <= end; begin += WORD_BITS)
+            words[begin / WORD_BITS] = ~word_t(0);
+        for (; begin < end; begin++)
+            set(begin);
+    };
+    void resetRange(int begin, int end)
+    {
+        for (; begin < end && begin % WORD_BITS; begin++)
+            reset(begin);
+        for (; begin + WORD_BITS <= end; begin += WORD_BITS)
+            words[begin / WORD_BITS] = 0;
+        for (; begin < end; begin++)
+            reset(begin);
+    };
+    bool any() const
+    {
+        for (auto w : words)
+            if (w)
+                return true;
+        return false;
+    };
+    int count() const
+    {
+        int res = 0;
+        for (auto w : words)
+            res += __builtin_popcountll(w);
+        return res;
+    };
+    // 返回是否发生变化
+    bool unionWith(const BitVector &o)
+    {
+        word_t changed = 0;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            word_t w = words[i] | o.words[i];
+            changed |= w ^ words[i];
+            words[i] = w;
+        }
+        return changed;
+    };
+    bool intersectWith(const BitVector &o)
+    {
+        word_t changed = 0;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            word_t w = words[i] & o.words[i];
+            changed |= w ^ words[i];
+            words[i] = w;
+        }
+        return changed;
+    };
+    void subtract(const BitVector &o)
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= ~o.words[i];
+    };
+    bool intersects(const BitVector &o) const
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            if (words[i] & o.words[i])
+                return true;
+        return false;
+    };
+    bool operator==(const BitVector &o) const { return num_bits == o.num_bits && words == o.words; };
+    bool operator!=(const BitVector &o) const { return !(*this == o); };
+    // 按编号从小到大遍历置位的bit
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            for (word_t w = words[i]; w; w &= w - 1)
+                f(int(i * WORD_BITS + __builtin_ctzll(w)));
+    };
+    // res = gen ∪ (x - kill)，返回res是否变化
+    static bool genKill(BitVector &res, const BitVector &x, const BitVector &gen, const BitVector &kill)
+    {
+        word_t changed = 0;
+        for (size_t i = 0; i < res.words.size(); i++)
+        {
+            word_t w = gen.words[i] | (x.words[i] & ~kill.words[i]);
+            changed |= w ^ res.words[i];
+            res.words[i] = w;
+        }
+        return changed;
+    };
+};
+
+enum DataflowDirection
+{
+    FORWARD,
+    BACKWARD
+};
+
+enum DataflowMeet
+{
+    MEET_UNION,
+    MEET_INTERSECT
+};
+
+// 默认的gen/kill传递函数
+struct GenKillTransfer
+{
+    bool operator()(int, BitVector &res, const BitVector &x, const BitVector &gen, const BitVector &kill) const
+    {
+        return BitVector::genKill(res, x, gen, kill);
+    };
+};
+
+/*
+    前向: in[b] = meet(out[p]), out[b] = transfer(in[b])
+    后向: out[b] = meet(in[s]), in[b] = transfer(out[b])
+    没有前驱(前向)/后继(后向)的块取boundary。
+    MEET_INTERSECT时内部结点初值为全集，MEET_UNION时为空集。
+*/
+template <DataflowDirection Dir, DataflowMeet Meet, typename Transfer = GenKillTransfer>
+class DataflowSolver
+{
+private:
+    int num_nodes, num_bits;
+    std::vector<std::vector<int>> preds, succs;
+    Transfer transfer;
+    // 从entry出发DFS的逆后序，不可达的块排在最后
+    std::vector<int> computeRPO(int entry) const
+    {
+        std::vector<int> post, order;
+        std::vector<bool> visited(num_nodes, false);
+        std::vector<std::pair<int, size_t>> stk;
+        if (num_nodes > 0)
+        {
+            visited[entry] = true;
+            stk.push_back(std::make_pair(entry, 0));
+        }
+        while (!stk.empty())
+        {
+            int node = stk.back().first;
+            size_t &idx = stk.back().second;
+            if (idx == succs[node].size())
+            {
+                post.push_back(node);
+                stk.pop_back();
+                continue;
+            }
+            int succ = succs[node][idx++];
+            if (!visited[succ])
+            {
+                visited[succ] = true;
+                stk.push_back(std::make_pair(succ, 0));
+            }
+        }
+        order.assign(post.rbegin(), post.rend());
+        for (int i = 0; i < num_nodes; i++)
+            if (!visited[i])
+                order.push_back(i);
+        return order;
+    };
+
+public:
+    std::vector<BitVector> gen, kill, in, out;
+    BitVector boundary;
+    DataflowSolver(int num_nodes, int num_bits, Transfer transfer = Transfer())
+        : num_nodes(num_nodes), num_bits(num_bits), preds(num_nodes), succs(num_nodes), transfer(transfer),
+          gen(num_nodes, BitVector(num_bits)), kill(num_nodes, BitVector(num_bits)),
+          in(num_nodes, BitVector(num_bits)), out(num_nodes, BitVector(num_bits)), boundary(num_bits){};
+    void addEdge(int from, int to)
+    {
+        succs[from].push_back(to);
+        preds[to].push_back(from);
+    };
+    void solve(int entry = 0)
+    {
+        auto order = computeRPO(entry);
+        if (Dir == BACKWARD)
+            std::reverse(order.begin(), order.end());
+        // 优先级 = 在遍历序中的位置
+        std::vector<int> priority(num_nodes);
+        for (int i = 0; i < num_nodes; i++)
+            priority[order[i]] = i;
+        auto &inputs = Dir == FORWARD ? preds : succs;
+        auto &outputs = Dir == FORWARD ? succs : preds;
+        auto &before = Dir == FORWARD ? in : out;
+        auto &after = Dir == FORWARD ? out : in;
+        for (int i = 0; i < num_nodes; i++)
+        {
+            if (Meet == MEET_INTERSECT && !inputs[i].empty())
+                after[i].setAll();
+            else
+                after[i].resetAll();
+        }
+        std::priority_queue<int, std::vector<int>, std::greater<int>> worklist;
+        std::vector<bool> in_worklist(num_nodes, true);
+        for (int i = 0; i < num_nodes; i++)
+            worklist.push(i);
+        while (!worklist.empty())
+        {
+            int node = order[worklist.top()];
+            worklist.pop();
+            in_worklist[node] = false;
+            auto &x = before[node];
+            if (inputs[node].empty())
+                x = boundary;
+            else
+            {
+                if (Meet == MEET_UNION)
+                    x.resetAll();
+                else
+                    x.setAll();
+                for (auto p : inputs[node])
+                {
+                    if (Meet == MEET_UNION)
+                        x.unionWith(after[p]);
+                    else
+                        x.intersectWith(after[p]);
+                }
+            }
+            if (transfer(node, after[node], x, gen[node], kill[node]))
+                for (auto s : outputs[node])
+                    if (!in_worklist[s])
+                    {
+                        in_worklist[s] = true;
+                        worklist.push(priority[s]);
+                    }
+        }
+    };
+};
+
+#endif
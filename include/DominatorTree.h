@@ -0,0 +1,58 @@
+#ifndef __DOMINATOR_TREE_H__
+#define __DOMINATOR_TREE_H__
+
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+class BasicBlock;
+class Function;
+
+/*
+    Dominator tree for IR (Cooper-Harvey-Kennedy, "A Simple, Fast Dominance Algorithm"):
+        1) 从entry非递归DFS，求逆后序(RPO)，并按RPO给可达基本块稠密编号
+        2) 按RPO迭代求idom，intersect沿idom链按编号上溯，直到不动点
+        3) 由idom建树，非递归先序遍历求dfs进/出序号，dominates查询为O(1)
+        4) post为真时在反向CFG上求后支配树，根是连接所有出口块的虚拟节点(nullptr，编号0)，
+           此时computeDomFrontier得到的是反向支配边界，即控制依赖
+    不可达的基本块(后支配树中为到达不了出口的块)没有编号，认为被所有块支配。
+*/
+class DominatorTree
+{
+private:
+    Function *func;
+    bool post;
+    std::vector<BasicBlock *> rpo;                  // 编号 -> 基本块，按逆后序
+    std::unordered_map<BasicBlock *, int> number;   // 基本块 -> 编号，仅含可达块
+    std::vector<int> idom;                          // 编号 -> idom编号，entry的idom是自己
+    std::vector<std::vector<int>> children;         // 支配树上的孩子
+    std::vector<int> dfs_in, dfs_out;               // 支配树先序遍历的进/出序号
+    void computeRPO();
+    void computeIDom();
+    void computeTree();
+    int intersect(int, int) const;
+    std::vector<BasicBlock *> getSuccs(BasicBlock *bb) const;
+    std::vector<BasicBlock *> getPreds(BasicBlock *bb) const;
+
+public:
+    DominatorTree(Function *func, bool post = false);
+    Function *getFunction() { return func; };
+    int getNumOfNodes() const { return rpo.size(); };
+    // 逆后序编号，不可达返回-1
+    int getNumber(BasicBlock *bb) const;
+    bool isReachable(BasicBlock *bb) const { return getNumber(bb) >= 0; };
+    BasicBlock *getBlock(int no) const { return rpo[no]; };
+    const std::vector<BasicBlock *> &getRPO() const { return rpo; };
+    // entry、不可达块和后支配树中出口块返回nullptr
+    BasicBlock *getIDom(BasicBlock *bb) const;
+    std::vector<BasicBlock *> getChildren(BasicBlock *bb) const;
+    bool dominates(BasicBlock *a, BasicBlock *b) const;
+    bool strictlyDominates(BasicBlock *a, BasicBlock *b) const { return a != b && dominates(a, b); };
+    // 支配树的先序序列(非递归)，父节点总在孩子之前
+    std::vector<BasicBlock *> getPreOrder() const;
+    // 支配边界
+    void computeDomFrontier(std::map<BasicBlock *, std::set<BasicBlock *>> &DF) const;
+};
+
+#endif
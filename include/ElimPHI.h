@@ -1,21 +1,54 @@
 #ifndef __ELIMPHI_H__
 #define __ELIMPHI_H__
 
+#include <map>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include "Unit.h"
+#include "PassManager.h"
 
 /*
-    SSA Destruction:
-        1) add critical edges
-        2) convert pcopy to seq
+    SSA Destruction (Budimlic / Boissinot):
+        1) 只对PHI相关的值(PHI的dst和非常量src)求SSA活跃信息，PHI的src视为在对应前驱出口处活跃
+        2) 支配关系 + 活跃信息判断两个值是否冲突：定值被支配的一方定值处另一方仍活跃
+        3) PHI的dst与各src所在的等价类互不冲突时合并，合并后的值共用一个名字，不需要复制
+        4) 每条边上剩余的复制构成并行复制，顺序化时只有成环才需要临时变量；
+           前驱有多个后继时才拆分关键边
+        5) 复制指令为CopyInstruction，生成MOV/VMOV，两端分到同一个寄存器时不输出
+        6) GEP结果的别名(同label、没有def的操作数)按label视为同一个值，重命名时保留别名的类型
 */
-
 class ElimPHI
 {
     Unit *unit;
+    PassManager *pm;
+    Function *func;
+    DominatorTree *DT = nullptr;
+    struct DefPos
+    {
+        BasicBlock *block;
+        int index; // 块内指令序号，PHI为-1，参数为-2
+    };
+    std::unordered_map<SymbolEntry *, DefPos> def_pos;
+    std::unordered_map<SymbolEntry *, std::unordered_map<BasicBlock *, int>> last_use; // 块内最后一个非PHI的use的序号
+    std::unordered_map<BasicBlock *, std::unordered_set<SymbolEntry *>> live_in, live_out;
+    std::unordered_map<SymbolEntry *, SymbolEntry *> leader;   // 并查集
+    std::unordered_map<SymbolEntry *, std::vector<SymbolEntry *>> members; // 等价类 -> 成员
+    std::unordered_map<int, SymbolEntry *> label_def;                     // label -> 定值的SymbolEntry
+    void computeLiveness(std::vector<PhiInstruction *> &phis);
+    bool liveAfter(SymbolEntry *value, SymbolEntry *def);
+    bool interfere(SymbolEntry *a, SymbolEntry *b);
+    SymbolEntry *canon(SymbolEntry *value);
+    SymbolEntry *find(SymbolEntry *value);
+    void coalesce(std::vector<PhiInstruction *> &phis);
+    BasicBlock *splitEdge(BasicBlock *pred, BasicBlock *succ);
+    void sequentialize(BasicBlock *block, std::vector<std::pair<Operand *, Operand *>> &pcopy);
+    void rename();
 
 public:
-    ElimPHI(Unit *unit) : unit(unit){};
+    ElimPHI(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
     void pass();
 };
 
-#endif
\ No newline at end of file
+#endif
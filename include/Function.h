@@ -31,6 +31,8 @@ public:
     BasicBlock *getEntry() { return entry; };
     void setEntry(BasicBlock *bb) { entry = bb; };
     void remove(BasicBlock *bb);
+    // 新建的块默认在末尾，移到pos之前以保持代码布局
+    void moveBlockBefore(BasicBlock *bb, BasicBlock *pos);
     void output() const;
     std::vector<BasicBlock *> &getBlockList() { return block_list; };
     std::vector<Operand *> &getParamsList() { return param_list; };
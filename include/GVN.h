@@ -0,0 +1,40 @@
+#ifndef __GVN_H__
+#define __GVN_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Unit.h"
+#include "PassManager.h"
+#include "AliasAnalysis.h"
+
+/*
+    Global value numbering / CSE for SSA IR:
+        1) 沿支配树先序遍历，值表按作用域维护，离开子树时撤销，保证找到的等价值支配当前指令
+        2) 纯指令(二元运算、比较、类型转换、GEP)以(指令类型, opcode, 类型, 操作数)为键，加法/乘法/相等比较的操作数排序
+        3) load另外维护可用表，store的值直接转发给之后的load；store按基址的别名关系、
+           会写内存的函数调用全部使可用load失效；唯一前驱即idom的块继承idom出口处的可用表
+        4) 条件分支依赖紧邻的比较设置标志位，被条件分支使用的比较不删除
+        5) 临时变量按label编号，与GEP结果同label的别名操作数视为同一个值
+*/
+class GVN
+{
+private:
+    Unit *unit;
+    PassManager *pm;
+    DominatorTree *DT = nullptr;
+    std::map<std::string, Operand *> table;
+    std::map<std::string, std::pair<Operand *, Operand *>> loads; // 地址 -> (地址, 值)
+    std::map<BasicBlock *, std::map<std::string, std::pair<Operand *, Operand *>>> exit_loads;
+    AliasAnalysis *AA = nullptr;
+    std::string valueKey(Operand *);
+    std::string hashKey(Instruction *);
+    void killLoads(Instruction *);
+    void walk(Function *);
+
+public:
+    GVN(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
+    void pass();
+};
+
+#endif
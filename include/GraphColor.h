@@ -0,0 +1,101 @@
+#ifndef __GRAPH_COLOR_H__
+#define __GRAPH_COLOR_H__
+
+#include <set>
+#include <map>
+#include <vector>
+#include <unordered_set>
+#include "RegisterAllocator.h"
+#include "LiveVariableAnalysis.h"
+
+/*
+    Iterated register coalescing (George & Appel):
+        1) 以每个vreg为结点，由活跃变量分析逆序扫描各块建立冲突图，整数和浮点各自成图(K = 11 / 30)
+        2) 同类vreg之间的无条件mov作为可合并的边，结点的溢出代价为各次use/def按循环深度加权之和
+        3) simplify / coalesce(Briggs或George保守合并) / freeze / 按代价除以度数选潜在溢出，交替进行直到图为空
+        4) select时乐观着色，着不上色的结点整体放到栈上，经scratch寄存器访问，不需要重建冲突图
+        5) 合并掉的以及两端颜色相同的mov直接删除
+        6) 直接出现的r0-r3/s0-s15为预着色结点，bl把caller-saved寄存器作为def，跨越调用的vreg与它们冲突，
+           只会分到callee-saved寄存器
+*/
+class GraphColor : public RegisterAllocator
+{
+private:
+    enum NodeState
+    {
+        INITIAL,
+        SIMPLIFY,
+        FREEZE,
+        SPILL,
+        COALESCED,
+        COLORED,
+        SPILLED,
+        SELECT,
+        PRECOLORED
+    };
+    enum MoveState
+    {
+        WORKLIST,
+        ACTIVE,
+        COALESCED_MOVE,
+        CONSTRAINED,
+        FROZEN
+    };
+    struct Node
+    {
+        Type *valType;
+        std::vector<MachineOperand *> defs;
+        std::vector<MachineOperand *> uses;
+        std::vector<int> adj;
+        std::vector<int> moves;
+        int degree;
+        int alias;
+        int color;
+        double cost;
+        NodeState state;
+    };
+    struct Move
+    {
+        MachineInstruction *inst;
+        int dst, src;
+        MoveState state;
+    };
+    MLiveVariableAnalysis lva;
+    std::vector<Node> nodes;
+    std::vector<Move> moves;
+    std::map<MachineOperand, int> vreg2node;
+    std::unordered_set<unsigned long long> adj_set;
+    std::vector<int> simplify_worklist, select_stack;
+    std::set<int> freeze_worklist, spill_worklist;
+    std::set<int> worklist_moves, active_moves;
+    int K(int n);
+    void build();
+    void addEdge(int u, int v);
+    bool adjacent(int u, int v);
+    template <typename F>
+    void forEachAdjacent(int n, F f);
+    bool moveRelated(int n);
+    template <typename F>
+    void forEachNodeMove(int n, F f);
+    void makeWorklist();
+    void simplify();
+    void decrementDegree(int m);
+    void enableMoves(int n);
+    void coalesce();
+    void addWorklist(int u);
+    bool george(int u, int v);
+    bool briggs(int u, int v);
+    int getAlias(int n);
+    void combine(int u, int v);
+    void freeze();
+    void freezeMoves(int u);
+    void selectSpill();
+    void assignColors();
+    void modifyCode();
+
+public:
+    GraphColor(MachineUnit *unit) : RegisterAllocator(unit){};
+    void allocateRegisters();
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __INLINER_H__
+#define __INLINER_H__
+
+#include <map>
+#include <set>
+#include <vector>
+#include "Unit.h"
+#include "PassManager.h"
+
+/*
+    Function inlining for SSA IR:
+        1) 按调用图的后序处理函数，被调函数中的调用先完成内联；调用图中能到达自身的递归函数不内联
+        2) 代价为被调函数的指令数减去调用开销(参数传递、bl、保存现场、返回值移动)，每个常量实参再减去一定收益；
+           阈值随调用点的循环深度增加，只剩一个调用点的函数内联后可以删除，阈值更高
+        3) 在调用处拆分基本块，复制被调函数的全部基本块，形参替换为实参；
+           ret改为跳到调用之后的块，有多个返回值时在该块用PHI合并；alloca移到调用者的入口块
+        4) 调用者的指令数有上限，防止代码膨胀和寄存器压力过大
+    最后删除main不再能调用到的函数。
+*/
+class Inliner
+{
+private:
+    Unit *unit;
+    PassManager *pm;
+    std::map<SymbolEntry *, Function *> funcs;
+    std::map<Function *, std::set<Function *>> callees;
+    std::set<Function *> recursive;
+    std::map<Function *, int> num_calls; // 调用点的个数
+    std::map<Operand *, Operand *> vmap; // 被调函数中的值 -> 调用者中的值
+    std::map<int, Operand *> label_map;  // 按label找别名操作数对应的值
+    std::map<BasicBlock *, BasicBlock *> bmap;
+    Function *getCallee(Instruction *inst);
+    void buildCallGraph();
+    void postOrder(Function *func, std::set<Function *> &visited, std::vector<Function *> &order);
+    bool isInlinable(Function *callee);
+    bool shouldInline(FuncCallInstruction *call, Function *callee, int depth, int caller_size);
+    void mapValue(Operand *from, Operand *to);
+    Operand *remap(Operand *op);
+    BasicBlock *splitAfter(Instruction *inst);
+    void inlineCall(FuncCallInstruction *call, Function *callee);
+    void inlineCalls(Function *caller);
+    void removeDeadFunctions();
+
+public:
+    Inliner(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
+    void pass();
+};
+
+#endif
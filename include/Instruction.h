@@ -24,6 +24,12 @@ public:
     bool isPHI() const { return instType == PHI; };
     bool isCall() const { return instType == CALL; };
     bool isGep() const { return instType == GEP; };
+    bool isCopy() const { return instType == COPY; };
+    bool isBinary() const { return instType == BINARY; };
+    bool isCmp() const { return instType == CMP; };
+    bool isZext() const { return instType == ZEXT; };
+    bool isIntFloatCast() const { return instType == IFCAST; };
+    unsigned getOpcode() const { return opcode; };
     void setParent(BasicBlock *);
     void setNext(Instruction *);
     void setPrev(Instruction *);
@@ -39,6 +45,10 @@ public:
     virtual std::vector<Operand *> &getDef() { return def_list; };
     virtual std::vector<Operand *> &getUses() { return use_list; };
     std::vector<Operand *> replaceAllUsesWith(Operand *); // Mem2Reg
+    // use_list中的old替换为rep，PHI同时更新srcs
+    void replaceUse(Operand *old, Operand *rep);
+    // 复制指令：结果为新的临时变量，操作数和跳转目标与原指令相同，不插入基本块
+    virtual Instruction *copy() = 0;
 
 protected:
     unsigned instType;
@@ -63,7 +73,8 @@ protected:
         IFCAST,
         CALL,
         PHI,
-        GEP
+        GEP,
+        COPY
     };
 };
 
@@ -72,6 +83,7 @@ class DummyInstruction : public Instruction
 {
 public:
     DummyInstruction() : Instruction(-1, nullptr){};
+    Instruction *copy() { return new DummyInstruction(); };
     void output() const {};
     void genMachineCode(AsmBuilder *){};
 };
@@ -80,7 +92,9 @@ class AllocaInstruction : public Instruction
 {
 public:
     AllocaInstruction(Operand *dst, SymbolEntry *se, BasicBlock *insert_bb = nullptr);
+    SymbolEntry *getSymPtr() { return se; };
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 
 private:
@@ -92,6 +106,7 @@ class LoadInstruction : public Instruction
 public:
     LoadInstruction(Operand *dst, Operand *src_addr, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 };
 
@@ -102,6 +117,7 @@ class StoreInstruction : public Instruction
 public:
     StoreInstruction(Operand *dst_addr, Operand *src, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 };
 
@@ -110,6 +126,7 @@ class BinaryInstruction : public Instruction
 public:
     BinaryInstruction(unsigned opcode, Operand *dst, Operand *src1, Operand *src2, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
     enum
     {
@@ -126,6 +143,7 @@ class CmpInstruction : public Instruction
 public:
     CmpInstruction(unsigned opcode, Operand *dst, Operand *src1, Operand *src2, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
     enum
     {
@@ -144,6 +162,7 @@ class UncondBrInstruction : public Instruction
 public:
     UncondBrInstruction(BasicBlock *, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void setBranch(BasicBlock *);
     BasicBlock *getBranch();
     void genMachineCode(AsmBuilder *);
@@ -158,6 +177,7 @@ class CondBrInstruction : public Instruction
 public:
     CondBrInstruction(BasicBlock *, BasicBlock *, Operand *, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void setTrueBranch(BasicBlock *);
     BasicBlock *getTrueBranch();
     void setFalseBranch(BasicBlock *);
@@ -174,6 +194,7 @@ class RetInstruction : public Instruction
 public:
     RetInstruction(Operand *src, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 };
 
@@ -182,6 +203,17 @@ class ZextInstruction : public Instruction
 public:
     ZextInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
+    void genMachineCode(AsmBuilder *);
+};
+
+// SSA destruction生成的复制，翻译为MOV/VMOV
+class CopyInstruction : public Instruction
+{
+public:
+    CopyInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
+    void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 };
 
@@ -190,6 +222,7 @@ class IntFloatCastInstruction : public Instruction
 public:
     IntFloatCastInstruction(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
     enum
     {
@@ -205,7 +238,11 @@ private:
 
 public:
     FuncCallInstruction(Operand *dst, std::vector<Operand *> params, IdentifierSymbolEntry *funcse, BasicBlock *insert_bb);
+    IdentifierSymbolEntry *getFuncSe() { return func_se; };
+    // 紧跟着返回调用结果(或void返回)、参数都在寄存器中、调用者没有局部数组时，可以先恢复栈帧再b到被调函数
+    bool isTailCall();
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 };
 
@@ -219,8 +256,10 @@ public:
     PhiInstruction(Operand *dst, BasicBlock *insert_bb = nullptr);
     ~PhiInstruction();
     void output() const;
+    Instruction *copy();
     void updateDst(Operand *);
     void addEdge(BasicBlock *block, Operand *src);
+    void removeEdge(BasicBlock *block);
     Operand *getAddr() { return addr; };
     std::map<BasicBlock *, Operand *> &getSrcs() { return srcs; };
 
@@ -232,6 +271,7 @@ class GepInstruction : public Instruction
 public:
     GepInstruction(Operand *dst, Operand *arr, std::vector<Operand *> idxList, BasicBlock *insert_bb = nullptr); // 普适，降维n-1次
     void output() const;
+    Instruction *copy();
     void genMachineCode(AsmBuilder *);
 };
 #endif
\ No newline at end of file
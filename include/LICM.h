@@ -0,0 +1,40 @@
+#ifndef __LICM_H__
+#define __LICM_H__
+
+#include <set>
+#include <vector>
+#include "Unit.h"
+#include "PassManager.h"
+#include "AliasAnalysis.h"
+
+/*
+    Loop invariant code motion for SSA IR:
+        1) 内层循环先处理，只处理有preheader的循环(由loop-simplify保证)，提升到preheader的终结指令之前
+        2) 操作数都是常量、在循环外定义或已被提升的纯指令(二元运算、比较、类型转换、GEP)可以提升；
+           整数除法/取模只在除数为非0、非-1的常量时提升，避免在原本不执行的路径上产生异常
+        3) 循环内没有会写内存的函数调用、也没有可能与之别名的store时，地址不变的load可以提升；
+           提升后的load在循环一次也不执行时也会执行，因此load须在header中，或循环至少执行一次(header
+           的首次判断可由初值确定)且所在块支配所有latch和其他退出块，否则只提升全局标量的load
+        4) 条件分支依赖紧邻的比较设置标志位，被条件分支使用的比较不提升
+    提升到外层循环preheader所在块的指令在处理外层循环时可以继续提升。
+*/
+class LICM
+{
+private:
+    Unit *unit;
+    PassManager *pm;
+    DominatorTree *DT = nullptr;
+    AliasAnalysis *AA = nullptr;
+    std::set<BasicBlock *> guaranteed; // 进入循环后一定执行的块
+    bool isInvariant(Loop *loop, Operand *op);
+    bool canHoist(Instruction *inst, bool loadsSafe, const std::vector<Operand *> &stores);
+    bool entersBody(Loop *loop);
+    bool isGuaranteed(Loop *loop, BasicBlock *bb, bool enters);
+    void hoist(Loop *loop);
+
+public:
+    LICM(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
+    void pass();
+};
+
+#endif
@@ -7,16 +7,40 @@
 #include <set>
 #include <map>
 #include <vector>
-#include <list>
-#include "Type.h"
+#include <queue>
+#include "RegisterAllocator.h"
+#include "LiveVariableAnalysis.h"
 
 class MachineUnit;
 class MachineOperand;
 class MachineFunction;
+class MachineBlock;
+class MachineInstruction;
 
-class LinearScan
+/*
+    Linear scan with lifetime holes and interval splitting:
+        1) 指令线性编号，每条指令占两个位置：use在no，def在no + 1
+        2) 以活跃变量分析的live_out为起点，一次逆序扫描为每个vreg建立range list和use position
+        3) active按end排序，处于hole中的区间放入inactive，寄存器空闲与否由二者共同决定
+        4) 寄存器只空闲一段时，在空闲结束前切分当前区间；全部被占用时按循环深度估计让出各寄存器的代价，
+           把代价最小的区间切开，中间段放到栈上，再次使用前的部分重新参与分配
+        5) 切分点尽量选在循环深度低的基本块入口，必要时让区间在整个内层循环中留在栈上
+        6) 分配结束后在切分点和控制流边上插入mov/ldr/str，使相邻两段的位置一致；
+           栈上的段经保留的scratch寄存器(r12/lr, s4/s5)访问
+        7) 直接出现的r0-r3/s0-s15(传参、返回值以及bl破坏的寄存器)作为fixed区间预先占住寄存器，
+           不跨越调用的区间可以优先使用这些caller-saved寄存器而不必在序言中保存；
+           与它们之间有mov的vreg(参数、实参、返回值)空闲时直接分到同一个寄存器，mov随之消失
+        8) 常量、全局变量地址、栈上数组地址在切分点不需要str，重新载入时直接重新计算
+        9) 生存期不相交的溢出vreg共用栈槽
+*/
+class LinearScan : public RegisterAllocator
 {
 private:
+    struct Range
+    {
+        int start;
+        int end; // [start, end)
+    };
     struct Interval
     {
         int start;
@@ -25,27 +49,70 @@ private:
         int disp;     // displacement in stack
         int real_reg; // the real register mapped from virtual register if the vreg is not spilled to memory
         Type *valType;
-        std::set<MachineOperand *> defs;
-        std::set<MachineOperand *> uses;
+        std::vector<MachineOperand *> defs;
+        std::vector<MachineOperand *> uses;
+        std::vector<Range> ranges;   // 按位置升序
+        std::vector<int> use_pos;    // 需要寄存器的位置(use/def)，升序
+        size_t cur_range;            // 第一个end大于当前扫描位置的range
+        int no;                      // 创建序号，保证分配顺序确定
+        Interval *parent;            // 切分前的区间(即vreg本身)，其children按start排序记录所有分段
+        std::vector<Interval *> children;
+        bool fixed;                  // 物理寄存器(传参、返回值、被调用破坏的寄存器)的区间，不能切分或让出
+        int hint;                    // 与物理寄存器之间有mov时优先分配该寄存器，没有为-1
+        MachineInstruction *remat;   // 可以重新计算的定值，栈上的段不占栈槽
+        void addRange(int from, int to);
+        bool covers(int pos);
+        int intersectPos(Interval *other); // 第一个公共位置，不相交返回-1
+        int nextUsePos(int pos);           // pos及之后第一个use position，没有返回INT_MAX
+        int lastUsePos(int pos);           // pos之前最后一个use position，没有返回-1
     };
-    MachineUnit *unit;
-    MachineFunction *func;
-    std::vector<int> rregs;
-    std::vector<int> sregs; // 浮点可分配寄存器号
-    std::map<MachineOperand *, std::set<MachineOperand *>> du_chains;
-    std::vector<Interval *> intervals, active;
-    static bool compareStart(Interval *a, Interval *b);
-    void expireOldIntervals(Interval *interval);
-    void spillAtInterval(Interval *interval);
-    void makeDuChains();
+    struct compareEnd
+    {
+        bool operator()(Interval *a, Interval *b) const { return a->end < b->end || (a->end == b->end && a->no < b->no); };
+    };
+    struct compareStartGreater
+    {
+        bool operator()(Interval *a, Interval *b) const { return a->start > b->start || (a->start == b->start && a->no > b->no); };
+    };
+    MLiveVariableAnalysis lva;
+    std::map<MachineOperand, Interval *> vreg2interval;
+    std::vector<Interval *> intervals; // 所有vreg区间及切分出的分段
+    std::vector<Interval *> fixed;     // 可分配的物理寄存器被直接使用时的区间
+    std::vector<Interval *> inactive;
+    std::set<Interval *, compareEnd> active;
+    std::priority_queue<Interval *, std::vector<Interval *>, compareStartGreater> unhandled;
+    std::set<Interval *> clean;             // 与栈上的值一致的寄存器分段
+    std::vector<Interval *> use2interval;   // use编号 -> vreg区间
+    std::vector<MachineInstruction *> numbered_insts; // 位置 / 2 -> 指令
+    std::vector<MachineBlock *> blocks;      // 非空块，按入口位置排序
+    std::vector<int> block_start;
+    std::vector<int> outer_prev, outer_next; // 前/后方第一个循环深度更低的块，没有为-1
+    int position;                            // 当前处理到的位置
+    int interval_cnt;
     void computeLiveIntervals();
-    bool linearScanRegisterAllocation();
+    void expireOldIntervals(Interval *interval);
+    bool tryAllocateFreeReg(Interval *interval);
+    void allocateBlockedReg(Interval *interval);
+    Interval *splitInterval(Interval *interval, int pos);
+    int findSplitPos(int min_pos, int max_pos);
+    double weight(int pos);
+    int usesInLoop(Interval *interval, int pos);
+    int reloadPos(Interval *interval, int spill_pos, int min_pos, double &cost);
+    double spillCost(Interval *interval, int pos);
+    void spillInterval(Interval *interval, int pos);
+    bool evictSplitPos(Interval *interval, Interval *current, int &pos, double &cost);
+    void linearScanRegisterAllocation();
+    Interval *childAt(Interval *interval, int pos);
+    void assignStackSlots();
+    void resolveDataFlow();
+    void insertMoves(MachineBlock *block, std::vector<std::pair<Interval *, Interval *>> &moves, std::vector<MachineInstruction *> &insts);
     void modifyCode();
     void genSpillCode();
 
 public:
-    LinearScan(MachineUnit *unit);
+    LinearScan(MachineUnit *unit) : RegisterAllocator(unit){};
+    ~LinearScan();
     void allocateRegisters();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,8 +3,17 @@
 
 #include <set>
 #include <map>
+#include <vector>
+#include <unordered_map>
+#include "DataflowAnalysis.h"
 
 // https://decaf-lang.github.io/minidecaf-tutorial/docs/step7/dataflow.html
+/*
+    活跃的单位是use操作数：
+        1) 给每个use稠密编号，同一个值的use编号连续，def该值即kill这一段编号
+        2) 块内正向扫描求gen(向上暴露的use)和kill
+        3) 在DataflowSolver上后向求解，结果同时写回基本块的live_in/live_out
+*/
 class Operand;
 class BasicBlock;
 class Function;
@@ -12,16 +21,23 @@ class Unit;
 class LiveVariableAnalysis
 {
 private:
-    std::map<Operand, std::set<Operand *>> all_uses;
-    std::map<BasicBlock *, std::set<Operand *>> def, use;
+    std::vector<Operand *> use_ops;                      // use编号 -> use
+    std::unordered_map<Operand *, int> use_no;           // use -> use编号
+    std::map<Operand, std::pair<int, int>> use_range;    // 值 -> 该值所有use的编号区间[begin, end)
+    std::unordered_map<BasicBlock *, int> block_no;
+    std::vector<BitVector> live_in, live_out;
     void computeUsePos(Function *);
-    void computeDefUse(Function *);
     void computeLiveInOut(Function *);
 
 public:
     void pass(Unit *unit);
     void pass(Function *func);
-    std::map<Operand, std::set<Operand *>> &getAllUses() { return all_uses; };
+    int getNumOfUses() const { return use_ops.size(); };
+    Operand *getUse(int no) const { return use_ops[no]; };
+    int getUseNo(Operand *use) const;
+    std::pair<int, int> getUseRange(Operand *value) const;
+    const BitVector &getLiveInBits(BasicBlock *bb) { return live_in[block_no[bb]]; };
+    const BitVector &getLiveOutBits(BasicBlock *bb) { return live_out[block_no[bb]]; };
 };
 
 class MachineOperand;
@@ -31,16 +47,24 @@ class MachineUnit;
 class MLiveVariableAnalysis
 {
 private:
-    std::map<MachineOperand, std::set<MachineOperand *>> all_uses;
-    std::map<MachineBlock *, std::set<MachineOperand *>> def, use;
+    std::vector<MachineOperand *> use_ops;
+    std::unordered_map<MachineOperand *, int> use_no;
+    std::map<MachineOperand, std::pair<int, int>> use_range;
+    std::unordered_map<MachineBlock *, int> block_no;
+    std::vector<BitVector> live_in, live_out;
     void computeUsePos(MachineFunction *);
-    void computeDefUse(MachineFunction *);
     void computeLiveInOut(MachineFunction *);
 
 public:
     void pass(MachineUnit *unit);
     void pass(MachineFunction *func);
-    std::map<MachineOperand, std::set<MachineOperand *>> &getAllUses() { return all_uses; };
+    int getNumOfUses() const { return use_ops.size(); };
+    MachineOperand *getUse(int no) const { return use_ops[no]; };
+    // 不是寄存器的use返回-1
+    int getUseNo(MachineOperand *use) const;
+    std::pair<int, int> getUseRange(MachineOperand *value) const;
+    const BitVector &getLiveInBits(MachineBlock *bb) { return live_in[block_no[bb]]; };
+    const BitVector &getLiveOutBits(MachineBlock *bb) { return live_out[block_no[bb]]; };
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,83 @@
+#ifndef __LOOPINFO_H__
+#define __LOOPINFO_H__
+
+#include <map>
+#include <set>
+#include <vector>
+
+class BasicBlock;
+class Function;
+class DominatorTree;
+class Instruction;
+class PhiInstruction;
+class Operand;
+
+// 基本归纳变量：header中的PHI，从preheader进入初值，从唯一的latch进入自身加/减一个整数常量
+struct InductionVar
+{
+    PhiInstruction *phi;
+    Instruction *inc;
+    Operand *init;
+    int step;
+};
+
+/*
+    Natural loops for IR:
+        1) 前驱被header支配的边为回边，回边的源为latch
+        2) 从latch沿前驱反向搜索到header为止，得到循环体；已属于内层循环的块直接跳到内层循环的header
+        3) 按支配树先序的逆序处理header，内层循环先于外层循环建立，由此得到嵌套关系和深度
+    不可达的基本块不属于任何循环。
+*/
+class Loop
+{
+private:
+    BasicBlock *header;
+    Loop *parent = nullptr;
+    std::vector<Loop *> sub_loops;
+    std::set<BasicBlock *> blocks;
+    std::vector<BasicBlock *> latches;
+    int depth = 1;
+    friend class LoopInfo;
+
+public:
+    Loop(BasicBlock *header) : header(header){};
+    BasicBlock *getHeader() const { return header; };
+    Loop *getParent() const { return parent; };
+    const std::vector<Loop *> &getSubLoops() const { return sub_loops; };
+    const std::set<BasicBlock *> &getBlocks() const { return blocks; };
+    const std::vector<BasicBlock *> &getLatches() const { return latches; };
+    int getDepth() const { return depth; };
+    bool contains(BasicBlock *bb) const { return blocks.count(bb); };
+    bool contains(const Loop *loop) const;
+    // 新建的块加入本循环及所有外层循环
+    void addBlock(BasicBlock *bb);
+    // 唯一的循环外前驱且其唯一后继为header时返回该前驱，否则返回nullptr
+    BasicBlock *getPreheader() const;
+    // 有循环外后继的循环块
+    std::vector<BasicBlock *> getExitingBlocks() const;
+    // 循环外的后继
+    std::vector<BasicBlock *> getExitBlocks() const;
+    // 没有preheader或latch不唯一时返回空
+    std::vector<InductionVar> getInductionVars() const;
+};
+
+class LoopInfo
+{
+private:
+    std::vector<Loop *> loops; // 内层循环在前
+    std::vector<Loop *> top_loops;
+    std::map<BasicBlock *, Loop *> bb_loop; // 基本块 -> 最内层循环
+
+public:
+    LoopInfo(Function *func, DominatorTree *DT);
+    ~LoopInfo();
+    const std::vector<Loop *> &getLoops() const { return loops; };
+    const std::vector<Loop *> &getTopLevelLoops() const { return top_loops; };
+    Loop *getLoopFor(BasicBlock *bb) const;
+    int getLoopDepth(BasicBlock *bb) const;
+    bool isLoopHeader(BasicBlock *bb) const;
+    // 新建的块属于loop(可以为nullptr)
+    void addBlock(BasicBlock *bb, Loop *loop);
+};
+
+#endif
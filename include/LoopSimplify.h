@@ -0,0 +1,31 @@
+#ifndef __LOOPSIMPLIFY_H__
+#define __LOOPSIMPLIFY_H__
+
+#include <vector>
+#include "Unit.h"
+#include "PassManager.h"
+
+/*
+    Loop canonicalization for IR:
+        1) 插入preheader：header的循环外前驱都改为跳到新块，新块唯一后继为header
+        2) 专用出口：出口块有循环外前驱时，循环内的前驱改为跳到新块，使出口块只被本循环支配的边进入
+        3) 拆分前驱时header/出口块的PHI在新块中合并对应的src，src都相同时不需要新的PHI
+    内层循环先处理，新块加入外层循环，LoopInfo随之更新。
+*/
+class LoopSimplify
+{
+private:
+    Unit *unit;
+    PassManager *pm;
+    Function *func;
+    LoopInfo *LI;
+    BasicBlock *splitPredecessors(BasicBlock *bb, const std::vector<BasicBlock *> &preds);
+    void insertPreheader(Loop *loop);
+    void formDedicatedExits(Loop *loop);
+
+public:
+    LoopSimplify(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
+    void pass();
+};
+
+#endif
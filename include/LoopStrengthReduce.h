@@ -0,0 +1,39 @@
+#ifndef __LOOPSTRENGTHREDUCE_H__
+#define __LOOPSTRENGTHREDUCE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Unit.h"
+#include "PassManager.h"
+#include "AliasAnalysis.h"
+
+/*
+    Loop strength reduction for SSA IR:
+        1) 基本归纳变量由Loop::getInductionVars给出
+        2) 只有一个下标是i或i±常量、其余下标和基址都是循环不变量的GEP，地址随i线性变化，
+           改为header中的指针PHI：初值在preheader中按i的初值计算，latch中每次加上步长乘以该维的跨度，
+           每次访问的乘法和加法变为每次迭代一次加法
+        3) 基址和下标形式相同的GEP共用一个指针PHI，下标的常量部分不同时在原位置加上相应的偏移
+        4) 归纳变量只被自身的更新使用时删除
+    内层循环先处理，内层指针的初值在外层循环中仍是地址计算，处理外层循环时继续削弱。
+*/
+class LoopStrengthReduce
+{
+private:
+    Unit *unit;
+    PassManager *pm;
+    DominatorTree *DT = nullptr;
+    AliasAnalysis *AA = nullptr;
+    std::vector<InductionVar> ivs;
+    bool isInvariant(Loop *loop, Operand *op);
+    InductionVar *matchIndex(Operand *idx, int &offset);
+    std::string operandKey(Operand *op);
+    void reduce(Loop *loop);
+
+public:
+    LoopStrengthReduce(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
+    void pass();
+};
+
+#endif
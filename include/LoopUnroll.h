@@ -0,0 +1,59 @@
+#ifndef __LOOPUNROLL_H__
+#define __LOOPUNROLL_H__
+
+#include <map>
+#include <vector>
+#include "Unit.h"
+#include "PassManager.h"
+
+/*
+    Loop unrolling for SSA IR，只处理最内层、只从header退出、header由归纳变量与循环不变量比较决定是否继续的循环：
+        1) 初值、边界都是常量时模拟得到迭代次数T，T * 循环大小不超过上限时完全展开：
+           依次复制T份循环体，各份header中的分支已知为真改为直接跳转，最后一份只复制header并跳到出口
+        2) 其他情况按循环大小展开4或2次：新的header判断 i + (N-1)*step 是否仍满足条件，
+           满足时连续执行N份不再判断的循环体，不满足时进入原循环作为余数部分；
+           为避免溢出改为比较 i 与 bound - (N-1)*step，边界不是常量时由preheader先判断相减不会溢出
+        3) 复制时第j份中基本归纳变量直接取 i + j*step，便于之后的强度削弱，其他header PHI取上一份latch的值
+        4) 每个函数新增的指令数有上限，防止代码膨胀
+    复制后不再使用的比较、归纳变量的更新等纯指令随即删除。
+*/
+class LoopUnroll
+{
+private:
+    struct UnrollInfo
+    {
+        BasicBlock *preheader, *header, *latch, *exit, *body; // body为header在循环内的后继
+        std::vector<BasicBlock *> blocks;                     // 按RPO，header在最前
+        InductionVar iv;                                      // 决定是否退出的归纳变量
+        std::vector<InductionVar> ivs;                        // 所有基本归纳变量
+        Operand *bound;
+        unsigned pred; // 归纳变量在左边时的比较
+        int size;      // 指令数，不含PHI
+    };
+    Unit *unit;
+    PassManager *pm;
+    Function *func;
+    int budget;
+    std::vector<BasicBlock *> new_blocks;
+    std::map<Operand *, Operand *> vmap; // 原循环中的值 -> 当前这一份中的值
+    std::map<int, Operand *> label_map;  // 按label找别名操作数对应的值
+    std::map<BasicBlock *, BasicBlock *> bmap;
+    bool analyze(Loop *loop, UnrollInfo &info);
+    int getTripCount(UnrollInfo &info);
+    Operand *remap(Operand *op);
+    void mapValue(Operand *from, Operand *to);
+    void cloneIteration(UnrollInfo &info, bool headerOnly, BasicBlock *pos);
+    std::vector<Instruction *> pending;
+    Operand *offsetValue(Operand *base, int offset);
+    void nextIteration(UnrollInfo &info, int j, std::map<PhiInstruction *, Operand *> &bases);
+    void insertPending(BasicBlock *bb);
+    void fullUnroll(UnrollInfo &info, int trip_count);
+    void runtimeUnroll(UnrollInfo &info, int factor);
+    void removeDeadInsts(UnrollInfo &info);
+
+public:
+    LoopUnroll(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
+    void pass();
+};
+
+#endif
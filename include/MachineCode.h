@@ -1,6 +1,7 @@
 #ifndef __MACHINECODE_H__
 #define __MACHINECODE_H__
 #include <vector>
+#include <map>
 #include <set>
 #include <string>
 #include <algorithm>
@@ -24,6 +25,7 @@ class MachineInstruction;
 class MachineOperand;
 
 bool isShifterOperandVal(unsigned bin_val);
+bool isVFPImmediate(float val); // vmov.f32可以直接编码的浮点立即数
 
 class MachineOperand
 {
@@ -81,8 +83,13 @@ protected:
     std::vector<MachineOperand *> use_list;
     void addDef(MachineOperand *ope) { def_list.push_back(ope); };
     void addUse(MachineOperand *ope) { use_list.push_back(ope); };
+    // 最后一个寄存器操作数经过桶形移位器，例如 add r0, r1, r2, lsl #2 / ldr r0, [r1, r2, lsl #2]
+    // shift_type为BinaryMInstruction::LSL/LSR/ASR，-1表示不移位
+    int shift_type = -1;
+    int shift_amount = 0;
     // print execution code after printing opcode
     void printCond();
+    void printShift();
     enum instType
     {
         BINARY,
@@ -94,7 +101,8 @@ protected:
         STACK,
         ZEXT,
         VCVT,
-        VMRS
+        VMRS,
+        MULACC
     };
 
 public:
@@ -116,7 +124,16 @@ public:
     std::vector<MachineOperand *> &getDef() { return def_list; };
     std::vector<MachineOperand *> &getUse() { return use_list; };
     MachineBlock *getParent() { return parent; };
+    void setParent(MachineBlock *p) { parent = p; };
     int getOpType() { return op; };
+    int getCond() { return cond; };
+    void setShift(int type, int amount)
+    {
+        shift_type = type;
+        shift_amount = amount;
+    };
+    int getShiftType() { return shift_type; };
+    int getShiftAmount() { return shift_amount; };
 };
 
 class BinaryMInstruction : public MachineInstruction
@@ -128,6 +145,11 @@ public:
         SUB,
         MUL,
         DIV,
+        RSB,
+        SMMUL, // 有符号乘法结果的高32位，用于除以常数
+        LSL,
+        LSR,
+        ASR,
     };
     BinaryMInstruction(MachineBlock *p, int op,
                        MachineOperand *dst, MachineOperand *src1, MachineOperand *src2,
@@ -135,6 +157,22 @@ public:
     void output();
 };
 
+class MulAccMInstruction : public MachineInstruction
+{
+public:
+    enum opType
+    {
+        MLA,  // dst = acc + src1 * src2
+        MLS,  // dst = acc - src1 * src2
+        VFMA, // dst += src1 * src2，融合乘加只有一次舍入，acc须与dst是同一个寄存器
+        VFMS, // dst -= src1 * src2
+    };
+    MulAccMInstruction(MachineBlock *p, int op,
+                       MachineOperand *dst, MachineOperand *src1, MachineOperand *src2, MachineOperand *acc,
+                       int cond = MachineInstruction::NONE);
+    void output();
+};
+
 class LoadMInstruction : public MachineInstruction
 {
 public:
@@ -162,7 +200,7 @@ public:
         // MVN,
         // MOVT,
         VMOV,
-        // VMOVF32
+        VMOVF32
     };
     MovMInstruction(MachineBlock *p, int op,
                     MachineOperand *dst, MachineOperand *src,
@@ -177,11 +215,16 @@ public:
     {
         B,
         BL,
+        TAIL, // 尾调用：恢复栈帧和保存的寄存器后b到被调函数
         // BX
     };
     BranchMInstruction(MachineBlock *p, int op,
                        MachineOperand *dst,
                        int cond = MachineInstruction::NONE);
+    // bl: args为传参用到的r0-r3/s0-s3，作为bl的use
+    BranchMInstruction(MachineBlock *p, int op,
+                       MachineOperand *dst, std::vector<MachineOperand *> args,
+                       int cond = MachineInstruction::NONE);
     void output();
 };
 
@@ -190,9 +233,10 @@ class CmpMInstruction : public MachineInstruction
 public:
     enum opType
     {
-        CMP
+        CMP,
+        CMN
     };
-    CmpMInstruction(MachineBlock *p,
+    CmpMInstruction(MachineBlock *p, int op,
                     MachineOperand *src1, MachineOperand *src2,
                     int cond = MachineInstruction::NONE);
     void output();
@@ -252,6 +296,7 @@ class MachineBlock
 private:
     MachineFunction *parent;
     int no;
+    int loop_depth = 0;
     std::vector<MachineBlock *> pred, succ;
     std::vector<MachineInstruction *> inst_list;
     std::set<MachineOperand *> live_in;
@@ -278,6 +323,8 @@ public:
     std::vector<MachineBlock *> &getSuccs() { return succ; };
     MachineFunction *getParent() { return parent; };
     int getNo() { return no; };
+    int getLoopDepth() { return loop_depth; };
+    void setLoopDepth(int depth) { loop_depth = depth; };
     void insertBefore(MachineInstruction *pos, MachineInstruction *inst);
     void insertAfter(MachineInstruction *pos, MachineInstruction *inst);
     MachineOperand *insertLoadImm(MachineOperand *imm);
@@ -319,7 +366,13 @@ public:
     MachineUnit *getParent() { return parent; };
     SymbolEntry *getSymPtr() { return sym_ptr; };
     void addAdditionalArgsOffset(MachineOperand *param) { additional_args_offset.push_back(param); };
-    // std::vector<MachineOperand *> getAdditionalArgsOffset() { return additional_args_offset; };
+    // 由回边识别自然循环：header -> 循环体(含header)，同一header的回边合并
+    std::map<MachineBlock *, std::set<MachineBlock *>> findLoops();
+    // 结果写入各块的loop_depth
+    void computeLoopDepth();
+    std::vector<MachineOperand *> &getAdditionalArgsOffset() { return additional_args_offset; };
+    // 恢复sp和保存的寄存器，函数结尾和尾调用之前输出
+    void outputEpilogue();
     void output();
     ~MachineFunction();
 };
@@ -0,0 +1,30 @@
+#ifndef __MACHINE_LICM_H__
+#define __MACHINE_LICM_H__
+
+#include <map>
+#include <set>
+#include "MachineCode.h"
+
+/*
+    Loop invariant code motion for machine code (寄存器分配之前):
+        1) 指令选择后才出现的字面量池加载(ldr r, =imm / ldr r, addr_x)以及由它得到浮点常量的vmov，
+           在IR层面不可见，这里在vreg上完成提升
+        2) 只提升在函数中唯一定值的vreg，被提升指令的结果在循环内各处的值相同
+        3) 提升到header唯一的循环外前驱末尾的跳转指令之前；ldr/vmov不影响标志位，可以放在cmp与条件跳转之间
+        4) 循环体由小到大处理，内层提升出的指令在处理外层循环时可以继续提升
+*/
+class MachineLICM
+{
+private:
+    MachineUnit *unit;
+    std::map<int, int> def_cnt; // vreg -> 定值次数
+    bool isSingleDef(MachineOperand *op);
+    bool canHoist(MachineInstruction *inst, const std::set<int> &hoisted);
+    void hoist(MachineBlock *header, const std::set<MachineBlock *> &body);
+
+public:
+    MachineLICM(MachineUnit *unit) : unit(unit){};
+    void pass();
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __MACHINE_PEEPHOLE_H__
+#define __MACHINE_PEEPHOLE_H__
+
+#include <map>
+#include "MachineCode.h"
+
+/*
+    Peephole optimization for machine code (寄存器分配之前):
+        1) 只被使用一次的移位结果折叠进加减法的第二操作数：
+           lsl t, y, #k; add d, x, t  =>  add d, x, y, lsl #k
+        2) 只被使用一次的地址计算折叠进ldr/str的寻址方式：
+           add t, b, i, lsl #k; ldr d, [t]  =>  ldr d, [b, i, lsl #k]
+           add t, b, #imm; ldr d, [t]       =>  ldr d, [b, #imm]
+           vldr/vstr只有立即数偏移，且须是4的倍数
+        3) 只被使用一次的乘法结果与加减法合并为乘加：
+           mul t, a, b; add d, c, t  =>  mla d, a, b, c
+           mul t, a, b; sub d, c, t  =>  mls d, a, b, c
+           浮点合并为vfma/vfms会少一次舍入、改变结果，只在-ffast-math下进行
+        4) 只在块内折叠，被折叠指令的源操作数在两条指令之间不能被重新定值
+*/
+class MachinePeephole
+{
+private:
+    MachineUnit *unit;
+    bool fast_math;
+    MachineFunction *func;
+    std::map<int, int> def_cnt, use_cnt; // vreg -> 定值/使用次数
+    int findSingleUseDef(MachineBlock *block, int pos, MachineOperand *op);
+    bool srcsUnchanged(MachineBlock *block, int from, int to);
+    bool foldShift(MachineBlock *block, int &pos);
+    bool foldMulAcc(MachineBlock *block, int &pos);
+    bool foldAddress(MachineBlock *block, int &pos);
+
+public:
+    MachinePeephole(MachineUnit *unit, bool fast_math = false) : unit(unit), fast_math(fast_math){};
+    void pass();
+};
+
+#endif
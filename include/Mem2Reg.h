@@ -2,19 +2,21 @@
 #define __MEM2REG_H__
 
 #include "Unit.h"
+#include "PassManager.h"
 
 /*
     Mem2Reg for IR:
-        1) 计算Idom
+        1) 计算支配树 (DominatorTree)
         2) 计算DF
         3) insertPHI (pruned SSA)
-        4) Rename
+        4) Rename (沿支配树先序遍历)
 */
 class Mem2Reg
 {
 private:
     Unit *unit;
-    std::map<BasicBlock *, std::set<BasicBlock *>> IDom;
+    PassManager *pm;
+    DominatorTree *DT = nullptr;
     void ComputeDom(Function *);
     std::map<BasicBlock *, std::set<BasicBlock *>> DF;
     void ComputeDomFrontier(Function *);
@@ -22,7 +24,7 @@ private:
     void Rename(Function *);
 
 public:
-    Mem2Reg(Unit *unit) : unit(unit){};
+    Mem2Reg(Unit *unit, PassManager *pm) : unit(unit), pm(pm){};
     void pass();
 };
 
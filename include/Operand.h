@@ -35,6 +35,7 @@ public:
     Instruction *getDef() { return def; };
     std::vector<Instruction *> getUses() { return uses; };
     SymbolEntry *getEntry() { return se; };
+    void setEntry(SymbolEntry *se) { this->se = se; };
 };
 
 #endif
\ No newline at end of file
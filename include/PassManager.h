@@ -0,0 +1,49 @@
+#ifndef __PASSMANAGER_H__
+#define __PASSMANAGER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include "Unit.h"
+#include "DominatorTree.h"
+#include "LoopInfo.h"
+
+/*
+    Pass manager for IR:
+        1) 优化遍按名字注册，-O0/-O1/-O2对应预设的流水线，-passes=a,b,c按给定顺序执行
+        2) 分析结果(支配树、循环)按函数缓存，由getDomTree/getLoopInfo按需计算
+        3) 每个遍注册时声明是否保持CFG不变，执行后使失效的分析重新计算
+*/
+class PassManager
+{
+private:
+    Unit *unit;
+    struct PassInfo
+    {
+        std::function<void()> run;
+        bool preservesCFG;
+    };
+    std::map<std::string, PassInfo> passes;
+    std::vector<std::string> pipeline;
+    std::map<Function *, DominatorTree *> dom_trees;
+    std::map<Function *, LoopInfo *> loop_infos;
+
+public:
+    PassManager(Unit *unit);
+    ~PassManager() { invalidate(); };
+    void registerPass(const std::string &name, std::function<void()> run, bool preservesCFG = false);
+    bool hasPass(const std::string &name) const { return passes.count(name); };
+    bool addPass(const std::string &name);
+    // 逗号分隔的遍名，有未注册的遍时返回false
+    bool parsePipeline(const std::string &names);
+    void buildPipeline(int opt_level);
+    const std::vector<std::string> &getPipeline() const { return pipeline; };
+    void runPass(const std::string &name);
+    void run();
+    DominatorTree *getDomTree(Function *func);
+    LoopInfo *getLoopInfo(Function *func);
+    void invalidate();
+};
+
+#endif
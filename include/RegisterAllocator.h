@@ -0,0 +1,53 @@
+#ifndef __REGISTER_ALLOCATOR_H__
+#define __REGISTER_ALLOCATOR_H__
+
+#include <map>
+#include <vector>
+#include "Type.h"
+
+class MachineUnit;
+class MachineOperand;
+class MachineFunction;
+class MachineBlock;
+class MachineInstruction;
+
+/*
+    寄存器分配器的公共接口：
+        1) allocateRegisters()逐个函数把vreg替换成物理寄存器，-O2用图着色(GraphColor)，否则用线性扫描(LinearScan)
+        2) 可分配的寄存器为r0-r10和s0-s3、s6-s31，其中r0-r3、s0-s15为caller-saved，bl将它们作为def，
+           跨越调用的值因此只会分到callee-saved寄存器
+        3) 放在栈上的vreg每次访问都经保留的scratch寄存器(r12/lr, s4/s5)中转，不需要重新分配
+        4) 只由ldr =imm / ldr =label / mov #imm / add fp, #off定值一次的vreg不占栈槽，
+           需要时重新计算(rematerialization)，定值本身删除
+*/
+class RegisterAllocator
+{
+protected:
+    MachineUnit *unit;
+    MachineFunction *func;
+    std::vector<int> rregs;
+    std::vector<int> sregs;       // 浮点可分配寄存器号
+    std::vector<int> spill_rregs; // 访问溢出vreg用的scratch寄存器
+    std::vector<int> spill_sregs;
+    // 栈上的vreg：fp - disp处，类型为valType；remat不为空时不占栈槽，由该指令重新计算
+    struct StackSlot
+    {
+        int disp;
+        Type *valType;
+        MachineInstruction *remat;
+    };
+    // 定值可以在任意位置重新计算的指令，否则返回nullptr
+    MachineInstruction *rematerializable(MachineOperand *def);
+    void insertRemat(MachineBlock *block, std::vector<MachineInstruction *> &insts, int reg, const StackSlot &slot);
+    void insertSpillLoad(MachineBlock *block, std::vector<MachineInstruction *> &insts, int reg, const StackSlot &slot);
+    void insertSpillStore(MachineBlock *block, std::vector<MachineInstruction *> &insts, int reg, const StackSlot &slot, int cond);
+    // 为位于栈上的操作数分配scratch寄存器，在use前插入ldr、def后插入str
+    void genSpillCode(std::map<MachineOperand *, StackSlot> &spilled);
+
+public:
+    RegisterAllocator(MachineUnit *unit);
+    virtual ~RegisterAllocator(){};
+    virtual void allocateRegisters() = 0;
+};
+
+#endif
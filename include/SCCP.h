@@ -0,0 +1,49 @@
+#ifndef __SCCP_H__
+#define __SCCP_H__
+
+#include <map>
+#include <set>
+#include <vector>
+#include "Unit.h"
+
+/*
+    Sparse conditional constant propagation (Wegman-Zadeck) for SSA IR:
+        1) 每个SSA值的格为 UNDEF > CONST > NAC，CFG边和SSA边各用一个工作表
+        2) 只求值可执行块中的指令，PHI只合并可执行边上的src
+        3) 条件分支的条件为常量时只有一条出边可执行
+        4) 值为常量的指令替换为常量后删除，条件为常量的分支改为无条件分支，删去死边和不可达块
+*/
+class SCCP
+{
+private:
+    Unit *unit;
+    struct Lattice
+    {
+        enum
+        {
+            UNDEF,
+            CONST,
+            NAC
+        };
+        int state;
+        double value;
+    };
+    std::map<SymbolEntry *, Lattice> status;
+    std::set<std::pair<BasicBlock *, BasicBlock *>> exec_edges;
+    std::set<BasicBlock *> exec_blocks;
+    std::vector<std::pair<BasicBlock *, BasicBlock *>> cfg_worklist;
+    std::vector<Instruction *> ssa_worklist;
+    Lattice getStatus(Operand *);
+    void setStatus(Instruction *, Lattice);
+    void markEdge(BasicBlock *from, BasicBlock *to);
+    Lattice evaluate(Instruction *);
+    void visit(Instruction *);
+    void propagate(Function *);
+    void rewrite(Function *);
+
+public:
+    SCCP(Unit *unit) : unit(unit){};
+    void pass();
+};
+
+#endif
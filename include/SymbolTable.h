@@ -134,6 +134,7 @@ public:
     int getParamNo() { return paramNo; };
     std::string getName() const { return name; };
     void setLabel() { label = SymbolTable::getLabel(); };
+    int getLabel() const { return label; }; // 前4个参数在函数体中对应的vreg
     bool isLibFunc();
     void decl_code();
     bool need8BytesAligned() { return this->is8BytesAligned; };
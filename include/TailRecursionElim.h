@@ -0,0 +1,36 @@
+#ifndef __TAILRECURSIONELIM_H__
+#define __TAILRECURSIONELIM_H__
+
+#include <vector>
+#include "Unit.h"
+
+/*
+    Tail recursion elimination for SSA IR:
+        1) 尾递归：调用自身后直接返回调用结果(或void)的块，改为带着实参跳回原入口，
+           原入口成为循环头，每个形参对应一个PHI，新建的入口块只跳到原入口
+        2) 累加器递归：调用结果只参与一次整数加法/乘法(另一个操作数不依赖调用)后返回，
+           例如 return n + f(n - 1)，增加累加器PHI，初值为单位元，
+           其他返回处改为返回 累加器 op 返回值
+        3) 有局部数组的函数不处理，递归的各层共用同一块栈空间会改变语义
+        4) 有数组参数的函数不处理，不引入以GEP结果(及其别名)为来源的指针PHI
+    非自身的尾调用在生成汇编时处理，见FuncCallInstruction::isTailCall。
+*/
+class TailRecursionElim
+{
+private:
+    Unit *unit;
+    struct TailSite
+    {
+        Instruction *call;
+        Instruction *acc_op; // 累加器递归的加法/乘法，纯尾递归为nullptr
+        Operand *acc_val;    // 加到累加器上的值
+    };
+    bool findSites(Function *func, std::vector<TailSite> &sites, unsigned &acc_opcode);
+    void eliminate(Function *func, std::vector<TailSite> &sites, bool hasAcc, unsigned acc_opcode);
+
+public:
+    TailRecursionElim(Unit *unit) : unit(unit){};
+    void pass();
+};
+
+#endif
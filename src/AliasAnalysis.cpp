@@ -0,0 +1,124 @@
+#include "AliasAnalysis.h"
+#include "Type.h"
+#include <set>
+
+// 不写内存的库函数
+static const std::set<std::string> readOnlyLibFuncs = {
+    "getint", "getch", "getfloat", "putint", "putch", "putfloat",
+    "putarray", "putfarray", "putf", "_sysy_starttime", "_sysy_stoptime"};
+
+static int getLabel(Operand *op)
+{
+    return dynamic_cast<TemporarySymbolEntry *>(op->getEntry())->getLabel();
+}
+
+AliasAnalysis::AliasAnalysis(Function *func)
+{
+    for (auto bb : func->getBlockList())
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+        {
+            // 强度削弱后别名操作数也可能对应指针PHI
+            if (inst->isGep() || (inst->isPHI() && inst->getDef()[0]->getType()->isPTR()))
+                label_defs[getLabel(inst->getDef()[0])] = inst;
+            for (auto use : inst->getUses())
+                if (use->getEntry()->isTemporary() && use->getDef() == nullptr)
+                    aliases[getLabel(use)].push_back(use);
+        }
+}
+
+Instruction *AliasAnalysis::getDef(Operand *op)
+{
+    auto def = op->getDef();
+    if (def == nullptr && op->getEntry()->isTemporary())
+    {
+        auto it = label_defs.find(getLabel(op));
+        if (it != label_defs.end())
+            def = it->second;
+    }
+    return def;
+}
+
+Operand *AliasAnalysis::getBase(Operand *addr)
+{
+    std::set<Instruction *> visited;
+    return getBase(addr, visited);
+}
+
+// 指针PHI各个src(除经过自身的)基址相同时取该基址，否则返回PHI本身，作为未知的基址
+Operand *AliasAnalysis::getBase(Operand *addr, std::set<Instruction *> &visited)
+{
+    while (true)
+    {
+        auto def = getDef(addr);
+        if (def != nullptr && def->isPHI())
+        {
+            if (!visited.insert(def).second)
+                return nullptr;
+            Operand *base = nullptr;
+            for (auto &src : dynamic_cast<PhiInstruction *>(def)->getSrcs())
+            {
+                auto src_base = getBase(src.second, visited);
+                if (src_base == nullptr)
+                    continue;
+                if (base != nullptr && !sameValue(base, src_base))
+                    return addr;
+                base = src_base;
+            }
+            return base == nullptr ? addr : base;
+        }
+        if (def == nullptr || !def->isGep())
+            return addr;
+        addr = def->getUses()[0];
+    }
+}
+
+bool AliasAnalysis::sameValue(Operand *a, Operand *b)
+{
+    auto seA = a->getEntry(), seB = b->getEntry();
+    return seA == seB || (seA->isTemporary() && seB->isTemporary() && getLabel(a) == getLabel(b));
+}
+
+bool AliasAnalysis::mayAlias(Operand *a, Operand *b)
+{
+    auto baseA = getBase(a), baseB = getBase(b);
+    if (sameValue(baseA, baseB))
+        return true;
+    auto isLocal = [](Operand *base)
+    { return base->getDef() != nullptr && base->getDef()->isAlloca(); };
+    auto isGlobal = [](Operand *base)
+    { return base->getEntry()->isVariable() && dynamic_cast<IdentifierSymbolEntry *>(base->getEntry())->isGlobal(); };
+    auto isParam = [](Operand *base)
+    { return base->getEntry()->isVariable() && dynamic_cast<IdentifierSymbolEntry *>(base->getEntry())->isParam(); };
+    // 基址未知(不同来源的指针PHI)时保守处理
+    if (!isLocal(baseA) && !isGlobal(baseA) && !isParam(baseA))
+        return true;
+    if (!isLocal(baseB) && !isGlobal(baseB) && !isParam(baseB))
+        return true;
+    if (isLocal(baseA) || isLocal(baseB))
+        return false;
+    if (isGlobal(baseA) && isGlobal(baseB))
+        return false;
+    return true;
+}
+
+void AliasAnalysis::replaceGep(Instruction *gep, Operand *leader)
+{
+    int label = getLabel(gep->getDef()[0]);
+    int new_label = getLabel(leader);
+    for (auto alias : aliases[label])
+    {
+        alias->setEntry(new TemporarySymbolEntry(alias->getType(), new_label));
+        aliases[new_label].push_back(alias);
+    }
+    aliases.erase(label);
+    label_defs.erase(label);
+    // 等价的值不是GEP(如强度削弱得到的指针PHI)时，别名操作数同样能找回定义
+    if (!label_defs.count(new_label) && leader->getDef() != nullptr)
+        label_defs[new_label] = leader->getDef();
+}
+
+bool AliasAnalysis::mayWriteMemory(Instruction *call)
+{
+    auto func_se = dynamic_cast<FuncCallInstruction *>(call)->getFuncSe();
+    return !readOnlyLibFuncs.count(func_se->getName());
+}
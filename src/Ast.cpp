@@ -61,8 +61,13 @@ Type *ExprNode::getType()
     {
         if (!is_array_ele)
             return symbolEntry->getType();
-        else
-            return dynamic_cast<ArrayType *>(symbolEntry->getType())->getElemType();
+        // 下标含变量的常量数组元素不能参与常量折叠，常量下标的情况已在语法分析时折叠
+        Type *elemType = dynamic_cast<ArrayType *>(symbolEntry->getType())->getElemType();
+        if (elemType->isConstInt())
+            return TypeSystem::intType;
+        if (elemType->isConstFloat())
+            return TypeSystem::floatType;
+        return elemType;
     }
 }
 
@@ -1355,8 +1360,18 @@ void FuncDefNode::genCode()
             }
             index = index->getNext();
         }
-        // 获取该块的最后一条指令
+        // 没有以ret或跳转结尾的基本块(如void函数的结尾)补上ret，空块不再隐含函数返回
         Instruction *last = (*bb)->rbegin();
+        if (!last->isRet() && !last->isCond() && !last->isUncond())
+        {
+            auto retType = dynamic_cast<FunctionType *>(se->getType())->getRetType();
+            if (retType->isVoid())
+                new RetInstruction(nullptr, *bb);
+            else
+                new RetInstruction(new Operand(new ConstantSymbolEntry(retType->isFloat() ? TypeSystem::constFloatType : TypeSystem::constIntType, 0)), *bb);
+        }
+        // 获取该块的最后一条指令
+        last = (*bb)->rbegin();
         // (*bb)->output();
         // 对于有条件的跳转指令，需要对其true分支和false分支都设置控制流关系
         if (last->isCond())
@@ -1504,8 +1519,9 @@ void InitNode::fill(int level, std::vector<int> d, Type *type)
     int cap = 1, num = 0;
     for (size_t i = level + 1; i < d.size(); i++)
         cap *= d[i];
+    // 只统计末尾的标量，空的{}是子数组
     for (int i = (int)leaves.size() - 1; i >= 0; i--)
-        if (leaves[i]->isLeaf())
+        if (leaves[i]->leaf != nullptr)
             num++;
         else
             break;
@@ -28,6 +28,15 @@ void BasicBlock::insertBefore(Instruction *dst, Instruction *src)
     dst->setParent(this);
 }
 
+// 插到终结指令之前；条件分支依赖紧邻的比较设置标志位，此时插到比较之前
+void BasicBlock::insertBeforeTerminator(Instruction *inst)
+{
+    auto pos = rbegin();
+    if (pos->isCond() && pos->getPrev() != end() && pos->getPrev()->isCmp())
+        pos = pos->getPrev();
+    insertBefore(inst, pos);
+}
+
 // remove the instruction from intruction list.
 void BasicBlock::remove(Instruction *inst)
 {
@@ -97,6 +106,29 @@ void BasicBlock::removePred(BasicBlock *bb)
     pred.erase(bb);
 }
 
+// 终结指令中跳到from的目标改为to，同时更新前驱/后继
+void BasicBlock::replaceSucc(BasicBlock *from, BasicBlock *to)
+{
+    auto lastInst = rbegin();
+    if (lastInst->isCond())
+    {
+        auto branch = dynamic_cast<CondBrInstruction *>(lastInst);
+        if (branch->getTrueBranch() == from)
+            branch->setTrueBranch(to);
+        if (branch->getFalseBranch() == from)
+            branch->setFalseBranch(to);
+    }
+    else
+    {
+        assert(lastInst->isUncond());
+        dynamic_cast<UncondBrInstruction *>(lastInst)->setBranch(to);
+    }
+    removeSucc(from);
+    addSucc(to);
+    from->removePred(this);
+    to->addPred(this);
+}
+
 void BasicBlock::genMachineCode(AsmBuilder *builder)
 {
     auto cur_func = builder->getFunction();
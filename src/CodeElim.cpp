@@ -0,0 +1,183 @@
+#include "CodeElim.h"
+#include "Type.h"
+#include <queue>
+
+static std::set<Instruction *> freeInsts;
+
+void DeadCodeElim::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+        funcs[(*func)->getSymPtr()] = *func;
+    computeSideEffects();
+    for (auto func = unit->begin(); func != unit->end(); func++)
+    {
+        AA = new AliasAnalysis(*func);
+        DominatorTree PDT(*func, true);
+        PDT.computeDomFrontier(RDF);
+        live.clear();
+        live_blocks.clear();
+        mark(*func, &PDT);
+        sweep(*func, &PDT);
+        removeUnreachable(*func);
+        delete AA;
+    }
+}
+
+// 库函数都做输入输出；store的基址不是本函数的局部数组时写了非局部内存
+void DeadCodeElim::computeSideEffects()
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto &kv : funcs)
+        {
+            auto func = kv.second;
+            if (side_effects.count(func))
+                continue;
+            AliasAnalysis AA(func);
+            bool effect = false;
+            for (auto bb : func->getBlockList())
+                for (auto inst = bb->begin(); inst != bb->end() && !effect; inst = inst->getNext())
+                {
+                    if (inst->isStore())
+                    {
+                        auto base = AA.getBase(inst->getUses()[0]);
+                        effect = base->getDef() == nullptr || !base->getDef()->isAlloca();
+                    }
+                    else if (inst->isCall())
+                    {
+                        auto it = funcs.find(dynamic_cast<FuncCallInstruction *>(inst)->getFuncSe());
+                        effect = it == funcs.end() || side_effects.count(it->second);
+                    }
+                }
+            if (effect)
+            {
+                side_effects.insert(func);
+                changed = true;
+            }
+        }
+    }
+}
+
+bool DeadCodeElim::isRoot(Instruction *inst)
+{
+    if (inst->isStore() || inst->isRet())
+        return true;
+    if (!inst->isCall())
+        return false;
+    auto it = funcs.find(dynamic_cast<FuncCallInstruction *>(inst)->getFuncSe());
+    return it == funcs.end() || side_effects.count(it->second);
+}
+
+void DeadCodeElim::markLive(Instruction *inst)
+{
+    if (live.insert(inst).second)
+        worklist.push_back(inst);
+}
+
+void DeadCodeElim::mark(Function *func, DominatorTree *PDT)
+{
+    for (auto bb : func->getBlockList())
+    {
+        // 到达不了出口的块保留原来的控制流
+        if (!PDT->isReachable(bb))
+            markLive(bb->rbegin());
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            if (isRoot(inst))
+                markLive(inst);
+    }
+    while (!worklist.empty())
+    {
+        auto inst = worklist.back();
+        worklist.pop_back();
+        for (auto use : inst->getUses())
+        {
+            auto def = AA->getDef(use);
+            if (def != nullptr)
+                markLive(def);
+        }
+        auto bb = inst->getParent();
+        if (live_blocks.insert(bb).second)
+            for (auto cd : RDF[bb])
+                markLive(cd->rbegin());
+        if (inst->isPHI())
+            for (auto &src : dynamic_cast<PhiInstruction *>(inst)->getSrcs())
+                markLive(src.first->rbegin());
+    }
+}
+
+void DeadCodeElim::sweep(Function *func, DominatorTree *PDT)
+{
+    for (auto bb : func->getBlockList())
+    {
+        auto inst = bb->begin();
+        while (inst != bb->end())
+        {
+            auto next = inst->getNext();
+            if (live.count(inst) || inst->isUncond())
+            {
+                inst = next;
+                continue;
+            }
+            for (auto use : inst->getUses())
+                use->removeUse(inst);
+            bb->remove(inst);
+            freeInsts.insert(inst);
+            if (inst->isCond())
+            {
+                // 各后继之后执行的活跃指令相同，选后支配树中离出口最近的后继，不会引入死循环
+                auto br = dynamic_cast<CondBrInstruction *>(inst);
+                auto taken = br->getTrueBranch(), dead = br->getFalseBranch();
+                int t = PDT->getNumber(taken), d = PDT->getNumber(dead);
+                if (d >= 0 && (t < 0 || d < t))
+                    std::swap(taken, dead);
+                new UncondBrInstruction(taken, bb);
+                if (dead != taken)
+                {
+                    bb->removeSucc(dead);
+                    dead->removePred(bb);
+                    for (auto phi = dead->begin(); phi != dead->end() && phi->isPHI(); phi = phi->getNext())
+                        dynamic_cast<PhiInstruction *>(phi)->removeEdge(bb);
+                }
+            }
+            inst = next;
+        }
+    }
+}
+
+void DeadCodeElim::removeUnreachable(Function *func)
+{
+    std::set<BasicBlock *> reachable;
+    std::queue<BasicBlock *> q;
+    q.push(func->getEntry());
+    reachable.insert(func->getEntry());
+    while (!q.empty())
+    {
+        auto bb = q.front();
+        q.pop();
+        for (auto succ = bb->succ_begin(); succ != bb->succ_end(); succ++)
+            if (reachable.insert(*succ).second)
+                q.push(*succ);
+    }
+    auto blocks = func->getBlockList();
+    for (auto bb : blocks)
+    {
+        if (reachable.count(bb))
+            continue;
+        func->remove(bb);
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            for (auto use : inst->getUses())
+                use->removeUse(inst);
+        std::vector<BasicBlock *> preds(bb->pred_begin(), bb->pred_end());
+        std::vector<BasicBlock *> succs(bb->succ_begin(), bb->succ_end());
+        for (auto pred : preds)
+            pred->removeSucc(bb);
+        for (auto succ : succs)
+        {
+            succ->removePred(bb);
+            for (auto phi = succ->begin(); phi != succ->end() && phi->isPHI(); phi = phi->getNext())
+                dynamic_cast<PhiInstruction *>(phi)->removeEdge(bb);
+        }
+    }
+}
@@ -0,0 +1,237 @@
+#include "DominatorTree.h"
+#include "Function.h"
+#include <cassert>
+
+DominatorTree::DominatorTree(Function *func, bool post) : func(func), post(post)
+{
+    computeRPO();
+    computeIDom();
+    computeTree();
+}
+
+int DominatorTree::getNumber(BasicBlock *bb) const
+{
+    auto it = number.find(bb);
+    return it == number.end() ? -1 : it->second;
+}
+
+// 后支配树沿前驱遍历，虚拟根的后继是所有没有后继的块
+std::vector<BasicBlock *> DominatorTree::getSuccs(BasicBlock *bb) const
+{
+    if (!post)
+        return std::vector<BasicBlock *>(bb->succ_begin(), bb->succ_end());
+    if (bb != nullptr)
+        return std::vector<BasicBlock *>(bb->pred_begin(), bb->pred_end());
+    std::vector<BasicBlock *> exits;
+    for (auto block : func->getBlockList())
+        if (block->succEmpty())
+            exits.push_back(block);
+    return exits;
+}
+
+std::vector<BasicBlock *> DominatorTree::getPreds(BasicBlock *bb) const
+{
+    if (!post)
+        return std::vector<BasicBlock *>(bb->pred_begin(), bb->pred_end());
+    std::vector<BasicBlock *> preds(bb->succ_begin(), bb->succ_end());
+    if (preds.empty())
+        preds.push_back(nullptr);
+    return preds;
+}
+
+// 非递归DFS求后序，再反转得到逆后序
+void DominatorTree::computeRPO()
+{
+    rpo.clear();
+    number.clear();
+    std::vector<BasicBlock *> postorder;
+    std::vector<std::pair<BasicBlock *, std::vector<BasicBlock *>>> stk;
+    std::unordered_map<BasicBlock *, bool> visited;
+    // 后继逆序入栈，从栈顶取出时按原顺序访问
+    auto push = [&](BasicBlock *bb)
+    {
+        auto succs = getSuccs(bb);
+        visited[bb] = true;
+        stk.push_back(std::make_pair(bb, std::vector<BasicBlock *>(succs.rbegin(), succs.rend())));
+    };
+    push(post ? nullptr : func->getEntry());
+    while (!stk.empty())
+    {
+        auto bb = stk.back().first;
+        auto &succs = stk.back().second;
+        if (succs.empty())
+        {
+            postorder.push_back(bb);
+            stk.pop_back();
+            continue;
+        }
+        auto succ = succs.back();
+        succs.pop_back();
+        if (!visited[succ])
+            push(succ);
+    }
+    rpo.assign(postorder.rbegin(), postorder.rend());
+    for (int i = 0; i < (int)rpo.size(); i++)
+        number[rpo[i]] = i;
+}
+
+// 编号越小越靠近entry，沿idom链上溯编号大的一方直到相遇
+int DominatorTree::intersect(int b1, int b2) const
+{
+    while (b1 != b2)
+    {
+        while (b1 > b2)
+            b1 = idom[b1];
+        while (b2 > b1)
+            b2 = idom[b2];
+    }
+    return b1;
+}
+
+void DominatorTree::computeIDom()
+{
+    int n = rpo.size();
+    idom.assign(n, -1);
+    idom[0] = 0;
+    // 前驱编号只需算一次
+    std::vector<std::vector<int>> preds(n);
+    for (int i = 1; i < n; i++)
+        for (auto pred : getPreds(rpo[i]))
+        {
+            int p = getNumber(pred);
+            if (p >= 0)
+                preds[i].push_back(p);
+        }
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < n; i++)
+        {
+            int new_idom = -1;
+            for (auto p : preds[i])
+            {
+                if (idom[p] == -1)
+                    continue;
+                new_idom = new_idom == -1 ? p : intersect(p, new_idom);
+            }
+            assert(new_idom != -1);
+            if (idom[i] != new_idom)
+            {
+                idom[i] = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+void DominatorTree::computeTree()
+{
+    int n = rpo.size();
+    children.assign(n, std::vector<int>());
+    for (int i = 1; i < n; i++)
+        children[idom[i]].push_back(i);
+    dfs_in.assign(n, 0);
+    dfs_out.assign(n, 0);
+    if (n == 0)
+        return;
+    int clock = 0;
+    std::vector<std::pair<int, size_t>> stk;
+    stk.push_back(std::make_pair(0, 0));
+    dfs_in[0] = clock++;
+    while (!stk.empty())
+    {
+        int node = stk.back().first;
+        size_t &idx = stk.back().second;
+        if (idx == children[node].size())
+        {
+            dfs_out[node] = clock++;
+            stk.pop_back();
+            continue;
+        }
+        int child = children[node][idx++];
+        dfs_in[child] = clock++;
+        stk.push_back(std::make_pair(child, 0));
+    }
+}
+
+BasicBlock *DominatorTree::getIDom(BasicBlock *bb) const
+{
+    int no = getNumber(bb);
+    if (no <= 0)
+        return nullptr;
+    return rpo[idom[no]];
+}
+
+std::vector<BasicBlock *> DominatorTree::getChildren(BasicBlock *bb) const
+{
+    std::vector<BasicBlock *> res;
+    int no = getNumber(bb);
+    if (no < 0)
+        return res;
+    for (auto child : children[no])
+        res.push_back(rpo[child]);
+    return res;
+}
+
+bool DominatorTree::dominates(BasicBlock *a, BasicBlock *b) const
+{
+    int nb = getNumber(b);
+    if (nb < 0)
+        return true;
+    int na = getNumber(a);
+    if (na < 0)
+        return false;
+    return dfs_in[na] <= dfs_in[nb] && dfs_out[nb] <= dfs_out[na];
+}
+
+std::vector<BasicBlock *> DominatorTree::getPreOrder() const
+{
+    std::vector<BasicBlock *> res;
+    if (rpo.empty())
+        return res;
+    std::vector<int> stk;
+    stk.push_back(0);
+    while (!stk.empty())
+    {
+        int node = stk.back();
+        stk.pop_back();
+        res.push_back(rpo[node]);
+        for (auto it = children[node].rbegin(); it != children[node].rend(); it++)
+            stk.push_back(*it);
+    }
+    return res;
+}
+
+// 对每个汇合点b，从它的每个前驱沿idom链上溯到idom(b)为止，途经的块的DF都包含b
+void DominatorTree::computeDomFrontier(std::map<BasicBlock *, std::set<BasicBlock *>> &DF) const
+{
+    DF.clear();
+    for (auto bb : func->getBlockList())
+        DF[bb] = std::set<BasicBlock *>();
+    int n = rpo.size();
+    for (int b = 0; b < n; b++)
+    {
+        // 后支配树的虚拟根没有前驱
+        if (rpo[b] == nullptr)
+            continue;
+        auto preds = getPreds(rpo[b]);
+        if (b != 0 && preds.size() < 2)
+            continue;
+        for (auto pred : preds)
+        {
+            int runner = getNumber(pred);
+            if (runner < 0)
+                continue;
+            // entry没有idom，上溯到entry为止(含entry)
+            int stop = b == 0 ? -1 : idom[b];
+            while (runner != stop)
+            {
+                DF[rpo[runner]].insert(rpo[b]);
+                if (runner == 0)
+                    break;
+                runner = idom[runner];
+            }
+        }
+    }
+}
@@ -1,15 +1,29 @@
 #include "ElimPHI.h"
-
-static std::set<Instruction *> freeList; // ALL PHIs
+#include <algorithm>
 
 void ElimPHI::pass()
 {
     auto Funcs = std::vector<Function *>(unit->begin(), unit->end());
-    for (auto func : Funcs)
+    for (auto f : Funcs)
     {
-        std::map<BasicBlock *, std::vector<Instruction *>> pcopy;
+        func = f;
+        std::vector<PhiInstruction *> phis;
+        for (auto bb : func->getBlockList())
+            for (auto i = bb->begin(); i != bb->end() && i->isPHI(); i = i->getNext())
+                phis.push_back(dynamic_cast<PhiInstruction *>(i));
+        if (phis.empty())
+            continue;
+        DT = pm->getDomTree(func);
+        label_def.clear();
+        for (auto bb : func->getBlockList())
+            for (auto i = bb->begin(); i != bb->end(); i = i->getNext())
+                for (auto def : i->getDef())
+                    if (def->getEntry()->isTemporary())
+                        label_def[dynamic_cast<TemporarySymbolEntry *>(def->getEntry())->getLabel()] = def->getEntry();
+        computeLiveness(phis);
+        coalesce(phis);
+        // 每条边上的并行复制，合并到同一个等价类的src不需要复制
         auto blocks = std::vector<BasicBlock *>(func->begin(), func->end());
-        // Critical Edge Splitting Algorithm for making non-conventional SSA form conventional
         for (auto bb : blocks)
         {
             if (!bb->begin()->isPHI())
@@ -17,89 +31,301 @@ void ElimPHI::pass()
             auto preds = std::vector<BasicBlock *>(bb->pred_begin(), bb->pred_end());
             for (auto pred : preds)
             {
-                // split
-                if (pred->getNumOfSucc() > 1) // == 2
+                std::vector<std::pair<Operand *, Operand *>> pcopy;
+                for (auto i = bb->begin(); i != bb->end() && i->isPHI(); i = i->getNext())
                 {
-                    BasicBlock *splitBlock = new BasicBlock(func);
-                    // pred->splitBlock
-                    CondBrInstruction *branch = (CondBrInstruction *)(pred->rbegin());
-                    if (branch->getTrueBranch() == bb)
-                        branch->setTrueBranch(splitBlock);
-                    else
-                        branch->setFalseBranch(splitBlock);
-                    pred->addSucc(splitBlock);
-                    pred->removeSucc(bb);
-                    splitBlock->addPred(pred);
-                    // splitBlock->bb
-                    new UncondBrInstruction(bb, splitBlock);
-                    splitBlock->addSucc(bb);
-                    bb->addPred(splitBlock);
-                    bb->removePred(pred);
-                    for (auto i = bb->begin(); i != bb->end() && i->isPHI(); i = i->getNext())
-                    {
-                        auto def = i->getDef()[0];
-                        auto src = dynamic_cast<PhiInstruction *>(i)->getSrcs()[pred];
-                        src->removeUse(i);
-                        pcopy[splitBlock].push_back(new BinaryInstruction(BinaryInstruction::ADD, def, src, new Operand(new ConstantSymbolEntry(Var2Const(def->getType()), 0))));
-                        freeList.insert(i);
-                    }
-                }
-                // no split
-                else
-                {
-                    for (auto i = bb->begin(); i != bb->end() && i->isPHI(); i = i->getNext())
-                    {
-                        auto def = i->getDef()[0];
-                        auto src = dynamic_cast<PhiInstruction *>(i)->getSrcs()[pred];
-                        src->removeUse(i);
-                        pcopy[pred].push_back(new BinaryInstruction(BinaryInstruction::ADD, def, src, new Operand(new ConstantSymbolEntry(Var2Const(def->getType()), 0))));
-                        freeList.insert(i);
-                    }
+                    auto phi = dynamic_cast<PhiInstruction *>(i);
+                    auto &srcs = phi->getSrcs();
+                    if (!srcs.count(pred) || srcs[pred] == nullptr)
+                        continue;
+                    auto src = srcs[pred];
+                    auto dst = find(phi->getDef()[0]->getEntry());
+                    // 合并后的src仍被使用，保留其use
+                    if (!src->getEntry()->isConstant() && find(src->getEntry()) == dst)
+                        continue;
+                    src->removeUse(phi);
+                    pcopy.push_back(std::make_pair(new Operand(dst), src));
                 }
+                if (pcopy.empty())
+                    continue;
+                sequentialize(pred->getNumOfSucc() > 1 ? splitEdge(pred, bb) : pred, pcopy);
             }
-            for (auto i : freeList)
-                i->getParent()->remove(i);
         }
-        // Replacement of parallel copies with sequences of sequential copy operations.
-        for (auto kv : pcopy)
+        for (auto phi : phis)
+            phi->getParent()->remove(phi);
+        rename();
+    }
+}
+
+/*
+    只对PHI相关的值求活跃信息：从每个use沿前驱向上标记，直到定值所在的块。
+    PHI的src在对应前驱的出口处活跃，PHI的dst在所在块入口处定值。
+*/
+void ElimPHI::computeLiveness(std::vector<PhiInstruction *> &phis)
+{
+    def_pos.clear();
+    last_use.clear();
+    live_in.clear();
+    live_out.clear();
+    std::unordered_set<SymbolEntry *> values;
+    for (auto phi : phis)
+    {
+        values.insert(phi->getDef()[0]->getEntry());
+        for (auto &kv : phi->getSrcs())
+            if (kv.second && !kv.second->getEntry()->isConstant())
+                values.insert(canon(kv.second->getEntry()));
+    }
+    // 参数以及找不到定值的值视为在entry开头定值
+    for (auto value : values)
+        def_pos[value] = {func->getEntry(), -2};
+    for (auto bb : func->getBlockList())
+    {
+        int index = 0;
+        for (auto i = bb->begin(); i != bb->end(); i = i->getNext())
+        {
+            for (auto def : i->getDef())
+                if (values.count(def->getEntry()))
+                    def_pos[def->getEntry()] = {bb, i->isPHI() ? -1 : index};
+            if (!i->isPHI())
+                index++;
+        }
+    }
+    auto upAndMark = [&](BasicBlock *bb, SymbolEntry *value)
+    {
+        std::vector<BasicBlock *> worklist{bb};
+        while (!worklist.empty())
         {
-            auto block = kv.first;
-            auto &restInsts = kv.second;
-            std::vector<Instruction *> seq;
-            auto insts = restInsts;
-            for(auto inst : insts) // delete inst like a <- a
+            auto b = worklist.back();
+            worklist.pop_back();
+            if (b == def_pos[value].block || live_in[b].count(value))
+                continue;
+            live_in[b].insert(value);
+            for (auto pred = b->pred_begin(); pred != b->pred_end(); pred++)
             {
-                if(inst->getDef()[0] == inst->getUses()[0])
-                     restInsts.erase(std::find(restInsts.begin(), restInsts.end(), inst));
+                live_out[*pred].insert(value);
+                worklist.push_back(*pred);
             }
-            while (restInsts.size())
+        }
+    };
+    for (auto bb : func->getBlockList())
+    {
+        int index = 0;
+        for (auto i = bb->begin(); i != bb->end(); i = i->getNext())
+        {
+            if (i->isPHI())
             {
-                std::set<Operand *> uses;
-                for (auto inst : restInsts)
-                    uses.insert(inst->getUses()[0]);
-                bool found = false;
-                auto Insts = restInsts;
-                for (auto inst : Insts)
-                {
-                    if (uses.count(inst->getDef()[0]) == 0) // inst is not live-in of pcopy
+                for (auto &kv : dynamic_cast<PhiInstruction *>(i)->getSrcs())
+                    if (kv.second && values.count(canon(kv.second->getEntry())))
                     {
-                        seq.push_back(inst);
-                        restInsts.erase(std::find(restInsts.begin(), restInsts.end(), inst));
-                        found = true;
+                        live_out[kv.first].insert(canon(kv.second->getEntry()));
+                        upAndMark(kv.first, canon(kv.second->getEntry()));
                     }
-                }
-                // pcopy is only made-up of cycles; Break one of them
-                if (!found)
+                continue;
+            }
+            for (auto use : i->getUses())
+                if (values.count(canon(use->getEntry())))
                 {
-                    auto freshOp = new Operand(new TemporarySymbolEntry(restInsts[0]->getUses()[0]->getType(), SymbolTable::getLabel()));
-                    seq.push_back(new BinaryInstruction(BinaryInstruction::ADD, freshOp, restInsts[0]->getUses()[0], new Operand(new ConstantSymbolEntry(Var2Const(freshOp->getType()), 0))));
-                    restInsts[0]->getUses()[0] = freshOp;
+                    last_use[canon(use->getEntry())][bb] = index;
+                    upAndMark(bb, canon(use->getEntry()));
                 }
+            index++;
+        }
+    }
+}
+
+// value在def的定值之后是否仍活跃
+bool ElimPHI::liveAfter(SymbolEntry *value, SymbolEntry *def)
+{
+    auto &pos = def_pos[def];
+    if (pos.index < 0)
+        return live_in[pos.block].count(value);
+    if (live_out[pos.block].count(value))
+        return true;
+    auto &uses = last_use[value];
+    auto it = uses.find(pos.block);
+    return it != uses.end() && it->second > pos.index;
+}
+
+// 两个值冲突当且仅当定值被支配的一方定值时另一方仍活跃
+bool ElimPHI::interfere(SymbolEntry *a, SymbolEntry *b)
+{
+    auto &pa = def_pos[a], &pb = def_pos[b];
+    if (pa.block == pb.block)
+    {
+        if (pa.index == pb.index)
+            return true;
+        return pa.index < pb.index ? liveAfter(a, b) : liveAfter(b, a);
+    }
+    if (DT->dominates(pa.block, pb.block))
+        return liveAfter(a, b);
+    if (DT->dominates(pb.block, pa.block))
+        return liveAfter(b, a);
+    return false;
+}
+
+// 前端给GEP的结果换类型时新建同label的SymbolEntry，这些别名按label找回定值的SymbolEntry
+SymbolEntry *ElimPHI::canon(SymbolEntry *value)
+{
+    if (!value->isTemporary())
+        return value;
+    auto it = label_def.find(dynamic_cast<TemporarySymbolEntry *>(value)->getLabel());
+    return it == label_def.end() ? value : it->second;
+}
+
+SymbolEntry *ElimPHI::find(SymbolEntry *value)
+{
+    value = canon(value);
+    auto it = leader.find(value);
+    if (it == leader.end() || it->second == value)
+        return value;
+    return it->second = find(it->second);
+}
+
+// PHI的dst与src所在的等价类两两不冲突时合并；参数在函数入口有固定的来源，不参与合并
+void ElimPHI::coalesce(std::vector<PhiInstruction *> &phis)
+{
+    leader.clear();
+    members.clear();
+    auto init = [&](SymbolEntry *value)
+    {
+        if (!leader.count(value))
+        {
+            leader[value] = value;
+            members[value] = {value};
+        }
+    };
+    for (auto phi : phis)
+    {
+        auto dst = phi->getDef()[0]->getEntry();
+        init(dst);
+        for (auto &kv : phi->getSrcs())
+        {
+            if (!kv.second || !kv.second->getEntry()->isTemporary())
+                continue;
+            init(canon(kv.second->getEntry()));
+            auto a = find(dst), b = find(kv.second->getEntry());
+            if (a == b)
+                continue;
+            bool conflict = false;
+            for (auto x : members[a])
+            {
+                for (auto y : members[b])
+                    if (interfere(x, y))
+                    {
+                        conflict = true;
+                        break;
+                    }
+                if (conflict)
+                    break;
             }
-            for (auto inst : seq)
-                block->insertBefore(inst, block->rbegin()); // 跳过branch指令
+            if (conflict)
+                continue;
+            if (members[a].size() < members[b].size())
+                std::swap(a, b);
+            leader[b] = a;
+            members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+            members.erase(b);
+        }
+    }
+}
+
+// 拆分pred->succ这条关键边，返回新的基本块
+BasicBlock *ElimPHI::splitEdge(BasicBlock *pred, BasicBlock *succ)
+{
+    auto splitBlock = new BasicBlock(func);
+    auto branch = dynamic_cast<CondBrInstruction *>(pred->rbegin());
+    if (branch->getTrueBranch() == succ)
+        branch->setTrueBranch(splitBlock);
+    if (branch->getFalseBranch() == succ)
+        branch->setFalseBranch(splitBlock);
+    pred->removeSucc(succ);
+    pred->addSucc(splitBlock);
+    splitBlock->addPred(pred);
+    new UncondBrInstruction(succ, splitBlock);
+    splitBlock->addSucc(succ);
+    succ->removePred(pred);
+    succ->addPred(splitBlock);
+    return splitBlock;
+}
+
+/*
+    并行复制的顺序化(Boissinot et al.)：
+        loc[a]为a的原值当前所在的位置，pred[b]为b的来源。
+        目的不再被读的复制可以直接进行；剩下的都在环上，把环上一个值先移到临时变量。
+        常量来源不会被覆盖，放在最后。
+*/
+void ElimPHI::sequentialize(BasicBlock *block, std::vector<std::pair<Operand *, Operand *>> &pcopy)
+{
+    std::unordered_map<SymbolEntry *, Operand *> loc, pred, dst_op;
+    std::vector<SymbolEntry *> ready, todo;
+    std::vector<std::pair<Operand *, Operand *>> seq, consts;
+    for (auto &copy : pcopy)
+    {
+        if (copy.second->getEntry()->isConstant())
+        {
+            consts.push_back(copy);
+            continue;
+        }
+        auto b = copy.first->getEntry();
+        loc[find(copy.second->getEntry())] = copy.second;
+        pred[b] = copy.second;
+        dst_op[b] = copy.first;
+        todo.push_back(b);
+    }
+    for (auto b : todo)
+        if (!loc.count(b))
+            ready.push_back(b);
+    std::unordered_set<SymbolEntry *> done;
+    while (!todo.empty())
+    {
+        while (!ready.empty())
+        {
+            auto b = ready.back();
+            ready.pop_back();
+            auto a = find(pred[b]->getEntry());
+            auto c = loc[a];
+            seq.push_back(std::make_pair(dst_op[b], c));
+            done.insert(b);
+            loc[a] = dst_op[b];
+            if (find(c->getEntry()) == a && pred.count(a) && !done.count(a))
+                ready.push_back(a);
+        }
+        auto b = todo.back();
+        todo.pop_back();
+        if (!done.count(b))
+        {
+            // b的原值还要被读，先移到临时变量
+            auto tmp = new Operand(new TemporarySymbolEntry(b->getType(), SymbolTable::getLabel()));
+            seq.push_back(std::make_pair(tmp, loc[b]));
+            loc[b] = tmp;
+            ready.push_back(b);
         }
-        // for(auto i :freeList)
-        //     delete i;
     }
-}
\ No newline at end of file
+    seq.insert(seq.end(), consts.begin(), consts.end());
+    for (auto &copy : seq)
+        block->insertBefore(new CopyInstruction(copy.first, copy.second), block->rbegin()); // 跳过branch指令
+}
+
+// 等价类中的值改用同一个名字；别名保留自己的类型，改用leader的label
+void ElimPHI::rename()
+{
+    std::unordered_map<SymbolEntry *, SymbolEntry *> renamed_alias;
+    for (auto bb : func->getBlockList())
+        for (auto i = bb->begin(); i != bb->end(); i = i->getNext())
+        {
+            for (auto def : i->getDef())
+                def->setEntry(find(def->getEntry()));
+            for (auto use : i->getUses())
+            {
+                auto se = use->getEntry(), target = find(se);
+                if (canon(se) == se)
+                    use->setEntry(target);
+                else if (target != canon(se))
+                {
+                    if (!renamed_alias.count(se))
+                        renamed_alias[se] = new TemporarySymbolEntry(se->getType(), dynamic_cast<TemporarySymbolEntry *>(target)->getLabel());
+                    use->setEntry(renamed_alias[se]);
+                }
+            }
+        }
+}
@@ -29,6 +29,12 @@ void Function::remove(BasicBlock *bb)
         block_list.erase(it);
 }
 
+void Function::moveBlockBefore(BasicBlock *bb, BasicBlock *pos)
+{
+    remove(bb);
+    block_list.insert(std::find(block_list.begin(), block_list.end(), pos), bb);
+}
+
 void Function::output() const
 {
     FunctionType *funcType = dynamic_cast<FunctionType *>(sym_ptr->getType());
@@ -97,12 +103,57 @@ void Function::genMachineCode(AsmBuilder *builder)
     //     }
     // }
 
+    // 参数在函数体中使用各自的vreg
+    for (auto param : param_list)
+        dynamic_cast<IdentifierSymbolEntry *>(param->getEntry())->setLabel();
+
     for (auto block : block_list)
     {
         block->genMachineCode(builder);
         map[block] = builder->getBlock();
     }
 
+    // 在入口处把r0-r3/s0-s3复制到参数的vreg，寄存器分配时尽量分到同一个寄存器，使mov消失
+    auto entry_block = map[entry];
+    if (entry->getNumOfPred() > 0)
+    {
+        // 入口块位于循环中时，复制放在新的块里只执行一次
+        entry_block = new MachineBlock(cur_func, SymbolTable::getLabel());
+        entry_block->insertInst(new BranchMInstruction(entry_block, BranchMInstruction::B, new MachineOperand(".L" + std::to_string(map[entry]->getNo()))));
+        entry_block->addSucc(map[entry]);
+        map[entry]->addPred(entry_block);
+        cur_func->getBlocks().insert(cur_func->getBlocks().begin(), entry_block);
+    }
+    // 第四个以后的参数在栈上，只有Mem2Reg之后直接作为值使用时才需要读到vreg
+    std::set<SymbolEntry *> used_params;
+    for (auto block : block_list)
+        for (auto inst = block->begin(); inst != block->end(); inst = inst->getNext())
+        {
+            auto &uses = inst->getUses();
+            for (size_t i = 0; i < uses.size(); i++)
+                if (!(inst->isStore() && i == 1 && uses[0]->getDef() && uses[0]->getDef()->isAlloca()))
+                    used_params.insert(uses[i]->getEntry());
+        }
+    std::vector<MachineInstruction *> param_moves;
+    for (auto param : param_list)
+    {
+        auto id_se = dynamic_cast<IdentifierSymbolEntry *>(param->getEntry());
+        auto type = id_se->getType()->isPTR() ? TypeSystem::intType : id_se->getType();
+        auto dst = new MachineOperand(MachineOperand::VREG, id_se->getLabel(), type);
+        if (id_se->getParamNo() >= 4)
+        {
+            if (!used_params.count(id_se))
+                continue;
+            auto offset = new MachineOperand(MachineOperand::IMM, 4 * (id_se->getParamNo() - 4));
+            cur_func->addAdditionalArgsOffset(offset);
+            param_moves.push_back(new LoadMInstruction(entry_block, dst, new MachineOperand(MachineOperand::REG, 11), offset));
+            continue;
+        }
+        auto src = new MachineOperand(MachineOperand::REG, id_se->getParamNo(), type);
+        param_moves.push_back(new MovMInstruction(entry_block, type->isFloat() ? MovMInstruction::VMOV : MovMInstruction::MOV, dst, src));
+    }
+    entry_block->getInsts().insert(entry_block->getInsts().begin(), param_moves.begin(), param_moves.end());
+
     // Add pred and succ for every block
     for (auto block : block_list)
     {
@@ -0,0 +1,184 @@
+#include "GVN.h"
+#include "Type.h"
+#include <set>
+
+static std::set<Instruction *> freeInsts;
+
+void GVN::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+    {
+        DT = pm->getDomTree(*func);
+        table.clear();
+        loads.clear();
+        exit_loads.clear();
+        AA = new AliasAnalysis(*func);
+        walk(*func);
+        delete AA;
+    }
+}
+
+std::string GVN::valueKey(Operand *op)
+{
+    auto se = op->getEntry();
+    char buf[64];
+    if (se->isConstant())
+        snprintf(buf, sizeof(buf), "%s:%a", op->getType()->isFloat() ? "f" : "i", se->getValue());
+    else if (se->isTemporary())
+        snprintf(buf, sizeof(buf), "t%d", dynamic_cast<TemporarySymbolEntry *>(se)->getLabel());
+    else
+        snprintf(buf, sizeof(buf), "%p", (void *)se);
+    return buf;
+}
+
+// 纯指令的键，不能参与值编号的指令返回空串
+std::string GVN::hashKey(Instruction *inst)
+{
+    if (inst->getDef().empty())
+        return "";
+    std::vector<std::string> ops;
+    for (auto use : inst->getUses())
+        ops.push_back(valueKey(use));
+    unsigned opcode = 0;
+    std::string kind;
+    if (inst->isBinary())
+    {
+        kind = "bin";
+        opcode = inst->getOpcode();
+        if ((opcode == BinaryInstruction::ADD || opcode == BinaryInstruction::MUL) && ops[1] < ops[0])
+            std::swap(ops[0], ops[1]);
+    }
+    else if (inst->isCmp())
+    {
+        kind = "cmp";
+        opcode = inst->getOpcode();
+        // a > b 与 b < a 等价
+        if (opcode == CmpInstruction::G || opcode == CmpInstruction::GE)
+        {
+            std::swap(ops[0], ops[1]);
+            opcode = opcode == CmpInstruction::G ? CmpInstruction::L : CmpInstruction::LE;
+        }
+        else if ((opcode == CmpInstruction::E || opcode == CmpInstruction::NE) && ops[1] < ops[0])
+            std::swap(ops[0], ops[1]);
+    }
+    else if (inst->isZext())
+        kind = "zext";
+    else if (inst->isIntFloatCast())
+    {
+        kind = "cast";
+        opcode = inst->getOpcode();
+    }
+    else if (inst->isGep())
+        kind = "gep:" + inst->getUses()[0]->getType()->toStr();
+    else
+        return "";
+    std::string key = kind + "/" + std::to_string(opcode) + "/" + inst->getDef()[0]->getType()->toStr();
+    for (auto &op : ops)
+        key += "/" + op;
+    return key;
+}
+
+void GVN::killLoads(Instruction *inst)
+{
+    if (inst->isCall())
+    {
+        if (AliasAnalysis::mayWriteMemory(inst))
+            loads.clear();
+        return;
+    }
+    auto addr = inst->getUses()[0];
+    for (auto it = loads.begin(); it != loads.end();)
+        if (AA->mayAlias(it->second.first, addr))
+            it = loads.erase(it);
+        else
+            it++;
+}
+
+static void removeInst(Instruction *inst)
+{
+    for (auto use : inst->getUses())
+        use->removeUse(inst);
+    inst->getParent()->remove(inst);
+    freeInsts.insert(inst);
+}
+
+void GVN::walk(Function *func)
+{
+    // 非递归先序遍历支配树，离开子树时撤销该块加入值表的键
+    std::vector<std::pair<BasicBlock *, bool>> stack;
+    std::map<BasicBlock *, std::vector<std::string>> inserted;
+    stack.push_back(std::make_pair(func->getEntry(), false));
+    while (!stack.empty())
+    {
+        auto bb = stack.back().first;
+        if (stack.back().second)
+        {
+            stack.pop_back();
+            for (auto &key : inserted[bb])
+                table.erase(key);
+            inserted.erase(bb);
+            exit_loads.erase(bb);
+            continue;
+        }
+        stack.back().second = true;
+        loads.clear();
+        if (bb->getNumOfPred() == 1 && exit_loads.count(*bb->pred_begin()))
+            loads = exit_loads[*bb->pred_begin()];
+        auto inst = bb->begin();
+        while (inst != bb->end())
+        {
+            auto next = inst->getNext();
+            if (inst->isLoad())
+            {
+                auto addr = inst->getUses()[0];
+                auto it = loads.find(valueKey(addr));
+                if (it != loads.end())
+                {
+                    inst->replaceAllUsesWith(it->second.second);
+                    removeInst(inst);
+                }
+                else
+                    loads[valueKey(addr)] = std::make_pair(addr, inst->getDef()[0]);
+            }
+            else if (inst->isStore())
+            {
+                killLoads(inst);
+                auto addr = inst->getUses()[0];
+                loads[valueKey(addr)] = std::make_pair(addr, inst->getUses()[1]);
+            }
+            else if (inst->isCall())
+                killLoads(inst);
+            else
+            {
+                auto key = hashKey(inst);
+                if (!key.empty())
+                {
+                    auto it = table.find(key);
+                    if (it == table.end())
+                    {
+                        table[key] = inst->getDef()[0];
+                        inserted[bb].push_back(key);
+                    }
+                    else
+                    {
+                        // 条件分支使用紧邻的比较设置的标志位
+                        bool usedByBranch = false;
+                        for (auto user : inst->getDef()[0]->getUses())
+                            usedByBranch |= user->isCond();
+                        if (!usedByBranch)
+                        {
+                            if (inst->isGep())
+                                AA->replaceGep(inst, it->second);
+                            inst->replaceAllUsesWith(it->second);
+                            removeInst(inst);
+                        }
+                    }
+                }
+            }
+            inst = next;
+        }
+        exit_loads[bb] = loads;
+        for (auto child : DT->getChildren(bb))
+            stack.push_back(std::make_pair(child, false));
+    }
+}
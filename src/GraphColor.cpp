@@ -0,0 +1,501 @@
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include "GraphColor.h"
+#include "MachineCode.h"
+
+void GraphColor::allocateRegisters()
+{
+    for (auto &f : unit->getFuncs())
+    {
+        func = f;
+        build();
+        makeWorklist();
+        while (!simplify_worklist.empty() || !worklist_moves.empty() || !freeze_worklist.empty() || !spill_worklist.empty())
+        {
+            if (!simplify_worklist.empty())
+                simplify();
+            else if (!worklist_moves.empty())
+                coalesce();
+            else if (!freeze_worklist.empty())
+                freeze();
+            else
+                selectSpill();
+        }
+        assignColors();
+        modifyCode();
+    }
+}
+
+int GraphColor::K(int n)
+{
+    return nodes[n].valType->isFloat() ? sregs.size() : rregs.size();
+}
+
+void GraphColor::build()
+{
+    lva.pass(func);
+    func->computeLoopDepth();
+    nodes.clear();
+    moves.clear();
+    vreg2node.clear();
+    adj_set.clear();
+    simplify_worklist.clear();
+    select_stack.clear();
+    freeze_worklist.clear();
+    spill_worklist.clear();
+    worklist_moves.clear();
+    active_moves.clear();
+    // 为每个vreg建立结点，溢出代价为各次use/def按循环深度加权之和
+    // 直接使用的可分配物理寄存器(传参、返回值、bl破坏的寄存器)作为预着色结点
+    std::vector<int> use2node(lva.getNumOfUses(), -1);
+    auto isPrecolored = [&](MachineOperand *op)
+    {
+        auto &regs = op->getValType()->isFloat() ? sregs : rregs;
+        return op->isReg() && std::find(regs.begin(), regs.end(), op->getReg()) != regs.end();
+    };
+    auto getNode = [&](MachineOperand *op)
+    {
+        auto it = vreg2node.find(*op);
+        if (it != vreg2node.end())
+            return it->second;
+        int n = nodes.size();
+        if (op->isReg())
+            nodes.push_back({op->getValType(), {}, {}, {}, {}, INT_MAX / 2, n, op->getReg(), 0, PRECOLORED});
+        else
+            nodes.push_back({op->getValType(), {}, {}, {}, {}, 0, n, -1, 0, INITIAL});
+        vreg2node[*op] = n;
+        return n;
+    };
+    for (auto &block : func->getBlocks())
+    {
+        double weight = std::pow(10.0, std::min(block->getLoopDepth(), 9));
+        for (auto &inst : block->getInsts())
+        {
+            for (auto &def : inst->getDef())
+                if (isPrecolored(def))
+                    getNode(def);
+                else if (def->isVReg())
+                {
+                    int n = getNode(def);
+                    nodes[n].defs.push_back(def);
+                    nodes[n].cost += weight;
+                }
+            for (auto &use : inst->getUse())
+                if (isPrecolored(use))
+                    use2node[lva.getUseNo(use)] = getNode(use);
+                else if (use->isVReg())
+                {
+                    int n = getNode(use);
+                    nodes[n].uses.push_back(use);
+                    nodes[n].cost += weight;
+                    use2node[lva.getUseNo(use)] = n;
+                }
+        }
+    }
+    // 可以重新计算的vreg溢出时不需要str
+    for (auto &node : nodes)
+        if (node.defs.size() == 1 && rematerializable(node.defs[0]))
+            node.cost -= std::pow(10.0, std::min(node.defs[0]->getParent()->getParent()->getLoopDepth(), 9));
+    // 逆序扫描各块，定值与此处活跃的vreg冲突；mov的源不与目的冲突
+    BitVector live(nodes.size());
+    for (auto &block : func->getBlocks())
+    {
+        live.resetAll();
+        lva.getLiveOutBits(block).forEach([&](int no)
+                                          {
+            if (use2node[no] != -1)
+                live.set(use2node[no]); });
+        for (auto inst = block->rbegin(); inst != block->rend(); inst++)
+        {
+            auto &defs = (*inst)->getDef();
+            auto &uses = (*inst)->getUse();
+            // 参数、返回值的mov一端为预着色结点，合并后vreg直接分到r0-r3/s0-s3
+            if (dynamic_cast<MovMInstruction *>(*inst) && (*inst)->getCond() == MachineInstruction::NONE &&
+                vreg2node.count(*defs[0]) && vreg2node.count(*uses[0]) && (defs[0]->isVReg() || uses[0]->isVReg()) &&
+                defs[0]->getValType()->isFloat() == uses[0]->getValType()->isFloat())
+            {
+                int dst = vreg2node[*defs[0]], src = vreg2node[*uses[0]];
+                live.reset(src);
+                nodes[dst].moves.push_back(moves.size());
+                nodes[src].moves.push_back(moves.size());
+                worklist_moves.insert(moves.size());
+                moves.push_back({*inst, dst, src, WORKLIST});
+            }
+            for (auto &def : defs)
+            {
+                if (!vreg2node.count(*def))
+                    continue;
+                int n = vreg2node[*def];
+                live.forEach([&](int l)
+                             { addEdge(n, l); });
+                for (auto &other : defs)
+                    if (vreg2node.count(*other))
+                        addEdge(n, vreg2node[*other]);
+            }
+            for (auto &def : defs)
+                if (vreg2node.count(*def))
+                    live.reset(vreg2node[*def]);
+            for (auto &use : uses)
+                if (vreg2node.count(*use))
+                    live.set(vreg2node[*use]);
+        }
+    }
+}
+
+void GraphColor::addEdge(int u, int v)
+{
+    if (u == v || nodes[u].valType->isFloat() != nodes[v].valType->isFloat() || adjacent(u, v))
+        return;
+    adj_set.insert(((unsigned long long)std::min(u, v) << 32) | std::max(u, v));
+    // 预着色结点的度数视为无穷大，不需要记录邻接表
+    if (nodes[u].state != PRECOLORED)
+    {
+        nodes[u].adj.push_back(v);
+        nodes[u].degree++;
+    }
+    if (nodes[v].state != PRECOLORED)
+    {
+        nodes[v].adj.push_back(u);
+        nodes[v].degree++;
+    }
+}
+
+bool GraphColor::adjacent(int u, int v)
+{
+    return adj_set.count(((unsigned long long)std::min(u, v) << 32) | std::max(u, v));
+}
+
+// 仍在图中的邻居(不在select栈中，也没有被合并)
+template <typename F>
+void GraphColor::forEachAdjacent(int n, F f)
+{
+    for (auto w : nodes[n].adj)
+        if (nodes[w].state != SELECT && nodes[w].state != COALESCED)
+            f(w);
+}
+
+// 还可能被合并的mov
+template <typename F>
+void GraphColor::forEachNodeMove(int n, F f)
+{
+    for (auto m : nodes[n].moves)
+        if (moves[m].state == ACTIVE || moves[m].state == WORKLIST)
+            f(m);
+}
+
+bool GraphColor::moveRelated(int n)
+{
+    for (auto m : nodes[n].moves)
+        if (moves[m].state == ACTIVE || moves[m].state == WORKLIST)
+            return true;
+    return false;
+}
+
+void GraphColor::makeWorklist()
+{
+    for (int n = 0; n < (int)nodes.size(); n++)
+    {
+        if (nodes[n].state == PRECOLORED)
+            continue;
+        if (nodes[n].degree >= K(n))
+        {
+            nodes[n].state = SPILL;
+            spill_worklist.insert(n);
+        }
+        else if (moveRelated(n))
+        {
+            nodes[n].state = FREEZE;
+            freeze_worklist.insert(n);
+        }
+        else
+        {
+            nodes[n].state = SIMPLIFY;
+            simplify_worklist.push_back(n);
+        }
+    }
+}
+
+void GraphColor::simplify()
+{
+    int n = simplify_worklist.back();
+    simplify_worklist.pop_back();
+    nodes[n].state = SELECT;
+    select_stack.push_back(n);
+    forEachAdjacent(n, [&](int m)
+                    { decrementDegree(m); });
+}
+
+void GraphColor::decrementDegree(int m)
+{
+    int d = nodes[m].degree--;
+    if (d != K(m) || nodes[m].state != SPILL)
+        return;
+    enableMoves(m);
+    forEachAdjacent(m, [&](int n)
+                    { enableMoves(n); });
+    spill_worklist.erase(m);
+    if (moveRelated(m))
+    {
+        nodes[m].state = FREEZE;
+        freeze_worklist.insert(m);
+    }
+    else
+    {
+        nodes[m].state = SIMPLIFY;
+        simplify_worklist.push_back(m);
+    }
+}
+
+void GraphColor::enableMoves(int n)
+{
+    forEachNodeMove(n, [&](int m)
+                    {
+        if (moves[m].state == ACTIVE)
+        {
+            active_moves.erase(m);
+            moves[m].state = WORKLIST;
+            worklist_moves.insert(m);
+        } });
+}
+
+void GraphColor::coalesce()
+{
+    int m = *worklist_moves.begin();
+    worklist_moves.erase(worklist_moves.begin());
+    int u = getAlias(moves[m].dst), v = getAlias(moves[m].src);
+    if (nodes[v].state == PRECOLORED)
+        std::swap(u, v);
+    if (u == v)
+    {
+        moves[m].state = COALESCED_MOVE;
+        addWorklist(u);
+    }
+    else if (nodes[v].state == PRECOLORED || adjacent(u, v))
+    {
+        moves[m].state = CONSTRAINED;
+        addWorklist(u);
+        addWorklist(v);
+    }
+    // 预着色结点的邻接表不完整，只能用George判断
+    else if (george(u, v) || (nodes[u].state != PRECOLORED && briggs(u, v)))
+    {
+        moves[m].state = COALESCED_MOVE;
+        combine(u, v);
+        addWorklist(u);
+    }
+    else
+    {
+        moves[m].state = ACTIVE;
+        active_moves.insert(m);
+    }
+}
+
+void GraphColor::addWorklist(int u)
+{
+    if (nodes[u].state == FREEZE && !moveRelated(u) && nodes[u].degree < K(u))
+    {
+        freeze_worklist.erase(u);
+        nodes[u].state = SIMPLIFY;
+        simplify_worklist.push_back(u);
+    }
+}
+
+// George: v的每个邻居要么度数小于K，要么是预着色结点，要么已经与u冲突
+bool GraphColor::george(int u, int v)
+{
+    bool ok = true;
+    forEachAdjacent(v, [&](int t)
+                    {
+        if (nodes[t].degree >= K(t) && nodes[t].state != PRECOLORED && !adjacent(t, u))
+            ok = false; });
+    return ok;
+}
+
+// Briggs: 合并后度数不小于K的邻居少于K个
+bool GraphColor::briggs(int u, int v)
+{
+    std::set<int> significant;
+    auto count = [&](int t)
+    {
+        if (nodes[t].degree >= K(t))
+            significant.insert(t);
+    };
+    forEachAdjacent(u, count);
+    forEachAdjacent(v, count);
+    return (int)significant.size() < K(u);
+}
+
+int GraphColor::getAlias(int n)
+{
+    while (nodes[n].state == COALESCED)
+        n = nodes[n].alias;
+    return n;
+}
+
+void GraphColor::combine(int u, int v)
+{
+    if (freeze_worklist.count(v))
+        freeze_worklist.erase(v);
+    else
+        spill_worklist.erase(v);
+    nodes[v].state = COALESCED;
+    nodes[v].alias = u;
+    nodes[u].moves.insert(nodes[u].moves.end(), nodes[v].moves.begin(), nodes[v].moves.end());
+    nodes[u].cost += nodes[v].cost;
+    enableMoves(v);
+    forEachAdjacent(v, [&](int t)
+                    {
+        addEdge(t, u);
+        decrementDegree(t); });
+    if (nodes[u].degree >= K(u) && nodes[u].state == FREEZE)
+    {
+        freeze_worklist.erase(u);
+        nodes[u].state = SPILL;
+        spill_worklist.insert(u);
+    }
+}
+
+void GraphColor::freeze()
+{
+    int u = *freeze_worklist.begin();
+    freeze_worklist.erase(freeze_worklist.begin());
+    nodes[u].state = SIMPLIFY;
+    simplify_worklist.push_back(u);
+    freezeMoves(u);
+}
+
+// 放弃u相关的mov的合并
+void GraphColor::freezeMoves(int u)
+{
+    forEachNodeMove(u, [&](int m)
+                    {
+        int v = getAlias(moves[m].src) == getAlias(u) ? getAlias(moves[m].dst) : getAlias(moves[m].src);
+        active_moves.erase(m);
+        worklist_moves.erase(m);
+        moves[m].state = FROZEN;
+        if (nodes[v].state == FREEZE && !moveRelated(v) && nodes[v].degree < K(v))
+        {
+            freeze_worklist.erase(v);
+            nodes[v].state = SIMPLIFY;
+            simplify_worklist.push_back(v);
+        } });
+}
+
+// 选 溢出代价 / 度数 最小的结点作为潜在溢出
+void GraphColor::selectSpill()
+{
+    int m = -1;
+    for (auto n : spill_worklist)
+        if (m == -1 || nodes[n].cost * nodes[m].degree < nodes[m].cost * nodes[n].degree)
+            m = n;
+    spill_worklist.erase(m);
+    nodes[m].state = SIMPLIFY;
+    simplify_worklist.push_back(m);
+    freezeMoves(m);
+}
+
+void GraphColor::assignColors()
+{
+    while (!select_stack.empty())
+    {
+        int n = select_stack.back();
+        select_stack.pop_back();
+        std::vector<bool> ok(32, true);
+        for (auto w : nodes[n].adj)
+        {
+            int a = getAlias(w);
+            if (nodes[a].state == COLORED || nodes[a].state == PRECOLORED)
+                ok[nodes[a].color] = false;
+        }
+        nodes[n].state = SPILLED;
+        for (auto r : nodes[n].valType->isFloat() ? sregs : rregs)
+            if (ok[r])
+            {
+                nodes[n].state = COLORED;
+                nodes[n].color = r;
+                break;
+            }
+    }
+    for (auto &node : nodes)
+        if (node.state == COALESCED)
+            node.color = nodes[getAlias(node.alias)].color;
+}
+
+void GraphColor::modifyCode()
+{
+    // 合并掉的、两端颜色相同的mov不再需要
+    std::set<MachineInstruction *> removed;
+    for (auto &m : moves)
+    {
+        int u = getAlias(m.dst), v = getAlias(m.src);
+        if (u == v || (nodes[u].state != SPILLED && nodes[v].state != SPILLED && nodes[u].color == nodes[v].color))
+            removed.insert(m.inst);
+    }
+    for (auto &block : func->getBlocks())
+    {
+        auto &insts = block->getInsts();
+        insts.erase(std::remove_if(insts.begin(), insts.end(), [&](MachineInstruction *inst)
+                                   { return removed.count(inst); }),
+                    insts.end());
+    }
+    // 合并后只剩一个可以重新计算的定值时，溢出的结点不占栈槽
+    std::map<int, std::vector<MachineOperand *>> group_defs;
+    std::map<int, std::vector<int>> members;
+    for (int n = 0; n < (int)nodes.size(); n++)
+        members[getAlias(n)].push_back(n);
+    for (int n = 0; n < (int)nodes.size(); n++)
+        for (auto def : nodes[n].defs)
+            if (!removed.count(def->getParent()))
+                group_defs[getAlias(n)].push_back(def);
+    // 栈槽着色：不冲突的溢出结点共用栈槽，与给寄存器着色相同；整数和浮点的冲突图是分开的，栈槽也分开
+    std::map<int, StackSlot> slots;
+    std::vector<int> slot_disp[2];
+    std::map<int, int> slot_no;
+    for (int a = 0; a < (int)nodes.size(); a++)
+    {
+        if (nodes[a].state != SPILLED)
+            continue;
+        auto &defs = group_defs[a];
+        auto remat = defs.size() == 1 ? rematerializable(defs[0]) : nullptr;
+        if (remat)
+        {
+            slots[a] = {0, nodes[a].valType, remat};
+            continue;
+        }
+        // 合并进来的结点的冲突边不一定都在a的邻接表中
+        auto &disp = slot_disp[nodes[a].valType->isFloat()];
+        std::vector<bool> used(disp.size(), false);
+        for (auto n : members[a])
+            for (auto w : nodes[n].adj)
+            {
+                int b = getAlias(w);
+                if (slot_no.count(b))
+                    used[slot_no[b]] = true;
+            }
+        int s = std::find(used.begin(), used.end(), false) - used.begin();
+        if (s == (int)disp.size())
+            disp.push_back(func->AllocSpace(4));
+        slot_no[a] = s;
+        slots[a] = {disp[s], nodes[a].valType, nullptr};
+    }
+    std::map<MachineOperand *, StackSlot> spilled;
+    for (int n = 0; n < (int)nodes.size(); n++)
+    {
+        int a = getAlias(n);
+        if (nodes[a].state == SPILLED)
+        {
+            for (auto def : nodes[n].defs)
+                spilled[def] = slots[a];
+            for (auto use : nodes[n].uses)
+                spilled[use] = slots[a];
+            continue;
+        }
+        func->addSavedRegs(nodes[a].color, nodes[a].valType->isFloat());
+        for (auto def : nodes[n].defs)
+            def->setReg(nodes[a].color);
+        for (auto use : nodes[n].uses)
+            use->setReg(nodes[a].color);
+    }
+    genSpillCode(spilled);
+}
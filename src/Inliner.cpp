@@ -0,0 +1,342 @@
+#include "Inliner.h"
+#include "Type.h"
+
+const int CALL_COST = 8;              // 参数之外的调用开销
+const int CONST_ARG_BONUS = 5;        // 常量实参内联后可以继续传播
+const int INLINE_THRESHOLD = 30;      // 循环外的调用点
+const int LOOP_DEPTH_BONUS = 40;      // 每层循环增加的阈值，最多计两层
+const int SINGLE_CALL_THRESHOLD = 300; // 唯一的调用点，内联后被调函数可以删除
+const int MAX_CALLER_SIZE = 3000;
+
+static bool isMain(Function *func)
+{
+    return dynamic_cast<IdentifierSymbolEntry *>(func->getSymPtr())->getName() == "main";
+}
+
+// 不含PHI和alloca的指令数
+static int getSize(Function *func)
+{
+    int size = 0;
+    for (auto bb : func->getBlockList())
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            if (!inst->isPHI() && !inst->isAlloca())
+                size++;
+    return size;
+}
+
+static int getLabel(Operand *op)
+{
+    return dynamic_cast<TemporarySymbolEntry *>(op->getEntry())->getLabel();
+}
+
+void Inliner::pass()
+{
+    for (auto f = unit->begin(); f != unit->end(); f++)
+        funcs[(*f)->getSymPtr()] = *f;
+    buildCallGraph();
+    std::set<Function *> visited;
+    std::vector<Function *> order;
+    for (auto f = unit->begin(); f != unit->end(); f++)
+        postOrder(*f, visited, order);
+    for (auto func : order)
+        inlineCalls(func);
+    removeDeadFunctions();
+}
+
+// 库函数没有函数体，返回nullptr
+Function *Inliner::getCallee(Instruction *inst)
+{
+    if (!inst->isCall())
+        return nullptr;
+    auto it = funcs.find(dynamic_cast<FuncCallInstruction *>(inst)->getFuncSe());
+    return it == funcs.end() ? nullptr : it->second;
+}
+
+void Inliner::buildCallGraph()
+{
+    for (auto &kv : funcs)
+        for (auto bb : kv.second->getBlockList())
+            for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            {
+                auto callee = getCallee(inst);
+                if (callee == nullptr)
+                    continue;
+                callees[kv.second].insert(callee);
+                num_calls[callee]++;
+            }
+    // 从自身的被调函数出发能回到自身即为递归
+    for (auto &kv : funcs)
+    {
+        auto func = kv.second;
+        std::set<Function *> reached;
+        std::vector<Function *> worklist(callees[func].begin(), callees[func].end());
+        while (!worklist.empty())
+        {
+            auto f = worklist.back();
+            worklist.pop_back();
+            if (f == func)
+            {
+                recursive.insert(func);
+                break;
+            }
+            if (!reached.insert(f).second)
+                continue;
+            worklist.insert(worklist.end(), callees[f].begin(), callees[f].end());
+        }
+    }
+}
+
+void Inliner::postOrder(Function *func, std::set<Function *> &visited, std::vector<Function *> &order)
+{
+    if (!visited.insert(func).second)
+        return;
+    for (auto callee : callees[func])
+        postOrder(callee, visited, order);
+    order.push_back(func);
+}
+
+// 入口块在循环中时入口的PHI缺少调用处的边；第四个以后的形参仍有alloca时地址在调用者的栈帧之外
+bool Inliner::isInlinable(Function *callee)
+{
+    if (recursive.count(callee) || isMain(callee) || !callee->getEntry()->predEmpty())
+        return false;
+    for (auto inst = callee->getEntry()->begin(); inst != callee->getEntry()->end(); inst = inst->getNext())
+        if (inst->isAlloca() && inst->getDef()[0]->usersNum() != 0)
+        {
+            auto se = dynamic_cast<IdentifierSymbolEntry *>(dynamic_cast<AllocaInstruction *>(inst)->getSymPtr());
+            if (se->isParam())
+                return false;
+        }
+    return true;
+}
+
+bool Inliner::shouldInline(FuncCallInstruction *call, Function *callee, int depth, int caller_size)
+{
+    if (!isInlinable(callee))
+        return false;
+    int size = getSize(callee);
+    if (caller_size + size > MAX_CALLER_SIZE)
+        return false;
+    int cost = size - CALL_COST - (int)call->getUses().size();
+    for (auto arg : call->getUses())
+        if (arg->getEntry()->isConstant())
+            cost -= CONST_ARG_BONUS;
+    int threshold = num_calls[callee] == 1 ? SINGLE_CALL_THRESHOLD : INLINE_THRESHOLD + LOOP_DEPTH_BONUS * std::min(depth, 2);
+    return cost <= threshold;
+}
+
+void Inliner::mapValue(Operand *from, Operand *to)
+{
+    vmap[from] = to;
+    if (from->getEntry()->isTemporary())
+        label_map[getLabel(from)] = to;
+}
+
+// 前端对GEP的结果换类型时新建同label、没有def的操作数，按label找到对应的值后同样新建别名
+Operand *Inliner::remap(Operand *op)
+{
+    auto it = vmap.find(op);
+    if (it != vmap.end())
+        return it->second;
+    if (!op->getEntry()->isTemporary() || op->getDef() != nullptr)
+        return op;
+    auto label_it = label_map.find(getLabel(op));
+    if (label_it == label_map.end())
+        return op;
+    auto value = label_it->second;
+    if (!value->getEntry()->isTemporary())
+        return value;
+    return new Operand(new TemporarySymbolEntry(op->getType(), getLabel(value)));
+}
+
+// inst之后的指令移到紧跟在后面的新块中，后继及其PHI随之改为新块
+BasicBlock *Inliner::splitAfter(Instruction *inst)
+{
+    auto bb = inst->getParent();
+    auto func = bb->getParent();
+    auto next_bb = new BasicBlock(func);
+    auto &blocks = func->getBlockList();
+    auto pos = std::find(blocks.begin(), blocks.end(), bb) + 1;
+    if (*pos != next_bb)
+        func->moveBlockBefore(next_bb, *pos);
+    while (inst->getNext() != bb->end())
+    {
+        auto next = inst->getNext();
+        bb->remove(next);
+        next_bb->insertBack(next);
+    }
+    std::vector<BasicBlock *> succs(bb->succ_begin(), bb->succ_end());
+    for (auto succ : succs)
+    {
+        for (auto phi = succ->begin(); phi != succ->end() && phi->isPHI(); phi = phi->getNext())
+        {
+            auto PHI = dynamic_cast<PhiInstruction *>(phi);
+            auto src = PHI->getSrcs()[bb];
+            PHI->removeEdge(bb);
+            PHI->addEdge(next_bb, src);
+        }
+        bb->removeSucc(succ);
+        succ->removePred(bb);
+        next_bb->addSucc(succ);
+        succ->addPred(next_bb);
+    }
+    return next_bb;
+}
+
+void Inliner::inlineCall(FuncCallInstruction *call, Function *callee)
+{
+    auto bb = call->getParent();
+    auto caller = bb->getParent();
+    vmap.clear();
+    label_map.clear();
+    bmap.clear();
+    auto &params = callee->getParamsList();
+    for (size_t i = 0; i < params.size(); i++)
+        mapValue(params[i], call->getUses()[i]);
+    auto ret_bb = splitAfter(call);
+    for (auto callee_bb : callee->getBlockList())
+    {
+        auto new_bb = new BasicBlock(caller);
+        caller->moveBlockBefore(new_bb, ret_bb);
+        bmap[callee_bb] = new_bb;
+    }
+    // 先复制全部指令再统一替换操作数，PHI可能使用在后面的块中定义的值
+    std::vector<Instruction *> clones;
+    std::vector<std::pair<BasicBlock *, Operand *>> rets;
+    for (auto callee_bb : callee->getBlockList())
+    {
+        auto new_bb = bmap[callee_bb];
+        for (auto inst = callee_bb->begin(); inst != callee_bb->end(); inst = inst->getNext())
+        {
+            if (inst->isRet())
+            {
+                new UncondBrInstruction(ret_bb, new_bb);
+                new_bb->addSucc(ret_bb);
+                ret_bb->addPred(new_bb);
+                if (!inst->getUses().empty())
+                    rets.push_back({new_bb, inst->getUses()[0]});
+                continue;
+            }
+            auto clone = inst->copy();
+            if (clone->isPHI())
+            {
+                auto &srcs = dynamic_cast<PhiInstruction *>(clone)->getSrcs();
+                std::map<BasicBlock *, Operand *> new_srcs;
+                for (auto &src : srcs)
+                    new_srcs[bmap[src.first]] = src.second;
+                srcs = new_srcs;
+            }
+            else if (clone->isCond())
+            {
+                auto branch = dynamic_cast<CondBrInstruction *>(clone);
+                branch->setTrueBranch(bmap[branch->getTrueBranch()]);
+                branch->setFalseBranch(bmap[branch->getFalseBranch()]);
+            }
+            else if (clone->isUncond())
+            {
+                auto branch = dynamic_cast<UncondBrInstruction *>(clone);
+                branch->setBranch(bmap[branch->getBranch()]);
+            }
+            if (!inst->getDef().empty())
+                mapValue(inst->getDef()[0], clone->getDef()[0]);
+            if (clone->isAlloca())
+                caller->getEntry()->insertFront(clone);
+            else
+                new_bb->insertBack(clone);
+            if (getCallee(clone) != nullptr)
+                num_calls[getCallee(clone)]++;
+            clones.push_back(clone);
+        }
+    }
+    for (auto clone : clones)
+    {
+        auto uses = clone->getUses();
+        for (auto use : uses)
+        {
+            auto rep = remap(use);
+            if (rep != use)
+                clone->replaceUse(use, rep);
+        }
+    }
+    for (auto &kv : bmap)
+        for (auto succ = kv.first->succ_begin(); succ != kv.first->succ_end(); succ++)
+        {
+            kv.second->addSucc(bmap[*succ]);
+            bmap[*succ]->addPred(kv.second);
+        }
+    new UncondBrInstruction(bmap[callee->getEntry()], bb);
+    bb->addSucc(bmap[callee->getEntry()]);
+    bmap[callee->getEntry()]->addPred(bb);
+    // 返回值
+    if (!rets.empty())
+    {
+        Operand *value = remap(rets[0].second);
+        if (rets.size() > 1)
+        {
+            value = new Operand(new TemporarySymbolEntry(call->getDef()[0]->getType(), SymbolTable::getLabel()));
+            auto phi = new PhiInstruction(value);
+            ret_bb->insertFront(phi);
+            phi->updateDst(value);
+            for (auto &ret : rets)
+                phi->addEdge(ret.first, remap(ret.second));
+        }
+        call->replaceAllUsesWith(value);
+    }
+    for (auto use : call->getUses())
+        use->removeUse(call);
+    bb->remove(call);
+    num_calls[callee]--;
+}
+
+void Inliner::inlineCalls(Function *caller)
+{
+    // 调用点的循环深度在修改CFG之前得到
+    auto LI = pm->getLoopInfo(caller);
+    std::vector<std::pair<FuncCallInstruction *, int>> sites;
+    for (auto bb : caller->getBlockList())
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            if (getCallee(inst) != nullptr)
+                sites.push_back({dynamic_cast<FuncCallInstruction *>(inst), LI->getLoopDepth(bb)});
+    int size = getSize(caller);
+    for (auto &site : sites)
+    {
+        auto callee = getCallee(site.first);
+        if (callee == caller || !shouldInline(site.first, callee, site.second, size))
+            continue;
+        size += getSize(callee);
+        inlineCall(site.first, callee);
+    }
+}
+
+void Inliner::removeDeadFunctions()
+{
+    std::set<Function *> live;
+    std::vector<Function *> worklist;
+    for (auto &kv : funcs)
+        if (isMain(kv.second))
+            worklist.push_back(kv.second);
+    while (!worklist.empty())
+    {
+        auto func = worklist.back();
+        worklist.pop_back();
+        if (!live.insert(func).second)
+            continue;
+        for (auto bb : func->getBlockList())
+            for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+                if (getCallee(inst) != nullptr)
+                    worklist.push_back(getCallee(inst));
+    }
+    // 没有main时保留全部函数
+    if (live.empty())
+        return;
+    for (auto &kv : funcs)
+    {
+        if (live.count(kv.second))
+            continue;
+        for (auto bb : kv.second->getBlockList())
+            for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+                for (auto use : inst->getUses())
+                    use->removeUse(inst);
+        delete kv.second;
+    }
+}
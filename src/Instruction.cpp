@@ -95,6 +95,102 @@ std::vector<Operand *> Instruction::replaceAllUsesWith(Operand *replVal)
     return freeList;
 }
 
+void Instruction::replaceUse(Operand *old, Operand *rep)
+{
+    for (auto &use : use_list)
+        if (use == old)
+        {
+            old->removeUse(this);
+            use = rep;
+            rep->addUse(this);
+        }
+    if (isPHI())
+        for (auto &src : ((PhiInstruction *)this)->getSrcs())
+            if (src.second == old)
+                src.second = rep;
+}
+
+// 与dst同类型的新临时变量
+static Operand *copyDst(Operand *dst)
+{
+    return new Operand(new TemporarySymbolEntry(dst->getType(), SymbolTable::getLabel()));
+}
+
+Instruction *AllocaInstruction::copy()
+{
+    return new AllocaInstruction(copyDst(def_list[0]), se);
+}
+
+Instruction *LoadInstruction::copy()
+{
+    return new LoadInstruction(copyDst(def_list[0]), use_list[0]);
+}
+
+Instruction *StoreInstruction::copy()
+{
+    return new StoreInstruction(use_list[0], use_list[1]);
+}
+
+Instruction *BinaryInstruction::copy()
+{
+    return new BinaryInstruction(opcode, copyDst(def_list[0]), use_list[0], use_list[1]);
+}
+
+Instruction *CmpInstruction::copy()
+{
+    return new CmpInstruction(opcode, copyDst(def_list[0]), use_list[0], use_list[1]);
+}
+
+Instruction *UncondBrInstruction::copy()
+{
+    return new UncondBrInstruction(branch);
+}
+
+Instruction *CondBrInstruction::copy()
+{
+    return new CondBrInstruction(true_branch, false_branch, use_list[0]);
+}
+
+Instruction *RetInstruction::copy()
+{
+    return new RetInstruction(use_list.empty() ? nullptr : use_list[0]);
+}
+
+Instruction *ZextInstruction::copy()
+{
+    return new ZextInstruction(copyDst(def_list[0]), use_list[0]);
+}
+
+Instruction *CopyInstruction::copy()
+{
+    return new CopyInstruction(copyDst(def_list[0]), use_list[0]);
+}
+
+Instruction *IntFloatCastInstruction::copy()
+{
+    return new IntFloatCastInstruction(opcode, copyDst(def_list[0]), use_list[0]);
+}
+
+Instruction *FuncCallInstruction::copy()
+{
+    return new FuncCallInstruction(copyDst(def_list[0]), use_list, func_se, nullptr);
+}
+
+Instruction *PhiInstruction::copy()
+{
+    auto dst = copyDst(def_list[0]);
+    auto phi = new PhiInstruction(dst);
+    phi->updateDst(dst);
+    for (auto &src : srcs)
+        phi->addEdge(src.first, src.second);
+    return phi;
+}
+
+Instruction *GepInstruction::copy()
+{
+    return new GepInstruction(copyDst(def_list[0]), use_list[0], std::vector<Operand *>(use_list.begin() + 1, use_list.end()));
+}
+
 AllocaInstruction::AllocaInstruction(Operand *dst, SymbolEntry *se, BasicBlock *insert_bb) : Instruction(ALLOCA, insert_bb)
 {
     assert(dst->getType()->isPTR());
@@ -399,6 +495,23 @@ void ZextInstruction::output() const
     fprintf(stderr, "  %s = zext %s %s to %s\n", dst.c_str(), src_type.c_str(), src.c_str(), dst_type.c_str());
 }
 
+CopyInstruction::CopyInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(COPY, insert_bb)
+{
+    def_list.push_back(dst);
+    use_list.push_back(src);
+    dst->setDef(this);
+    src->addUse(this);
+}
+
+void CopyInstruction::output() const
+{
+    std::string dst = def_list[0]->toStr();
+    std::string src = use_list[0]->toStr();
+    std::string type = def_list[0]->getType()->toStr();
+    fprintf(yyout, "  %s = bitcast %s %s to %s\n", dst.c_str(), type.c_str(), src.c_str(), type.c_str());
+    fprintf(stderr, "  %s = bitcast %s %s to %s\n", dst.c_str(), type.c_str(), src.c_str(), type.c_str());
+}
+
 IntFloatCastInstruction::IntFloatCastInstruction(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(IFCAST, insert_bb)
 {
     this->opcode = opcode;
@@ -531,6 +644,16 @@ void PhiInstruction::addEdge(BasicBlock *block, Operand *src)
     src->addUse(this);
 }
 
+void PhiInstruction::removeEdge(BasicBlock *block)
+{
+    if (!srcs.count(block))
+        return;
+    auto src = srcs[block];
+    srcs.erase(block);
+    use_list.erase(std::find(use_list.begin(), use_list.end(), src));
+    src->removeUse(this);
+}
+
 GepInstruction::GepInstruction(Operand *dst,
                                Operand *arr,
                                std::vector<Operand *> idxList,
@@ -589,11 +712,8 @@ MachineOperand *Instruction::genMachineOperand(Operand *ope)
         else if (id_se->isGlobal())
             mope = new MachineOperand(id_se->toStr().c_str());
         else if (id_se->isParam())
-        {
-            int paramNo = id_se->getParamNo();
-            if (paramNo >= 0 && paramNo <= 3)
-                mope = new MachineOperand(MachineOperand::REG, paramNo, se->getType());
-        }
+            // 参数在函数入口从r0-r3/s0-s3复制或从栈上读到vreg中
+            mope = new MachineOperand(MachineOperand::VREG, id_se->getLabel(), se->getType()->isPTR() ? TypeSystem::intType : se->getType());
         else
         {
             assert(0);
@@ -708,19 +828,11 @@ void StoreInstruction::genMachineCode(AsmBuilder *builder)
     // TODO : Array
     auto cur_block = builder->getBlock();
     MachineInstruction *cur_inst = nullptr;
-    MachineOperand *src = genMachineOperand(use_list[1]);
-    // src对应的参数不在前四个
-    if (src == nullptr)
-    {
-        // auto id_se = dynamic_cast<IdentifierSymbolEntry *>(use_list[1]->getEntry());
-        // assert(id_se->isParam());
-        // // int below_dist = 0;
-        // // for (int i = 4; i != id_se->getParamNo(); i++)
-        // //     below_dist += parent->getParent()->getParamsList()[i]->getType()->getSize();
-        // int below_dist = 4 * (id_se->getParamNo() - 4);
-        // dynamic_cast<TemporarySymbolEntry *>(use_list[0]->getEntry())->setOffset(below_dist);
+    // 第四个以后的参数本来就在栈上，store到它自己的位置可以省略
+    auto src_se = dynamic_cast<IdentifierSymbolEntry *>(use_list[1]->getEntry());
+    if (src_se && src_se->isParam() && src_se->getParamNo() >= 4 && use_list[0]->getDef() && use_list[0]->getDef()->isAlloca())
         return;
-    }
+    MachineOperand *src = genMachineOperand(use_list[1]);
     // 如果src为常数，需要先load进来
     if (src->isImm())
         src = cur_block->insertLoadImm(src);
@@ -743,6 +855,9 @@ void StoreInstruction::genMachineCode(AsmBuilder *builder)
         // example: str r1, [fp, #-4]
         auto fp = genMachineReg(11);
         auto offset = genMachineImm(dynamic_cast<TemporarySymbolEntry *>(use_list[0]->getEntry())->getOffset());
+        // 第四个以后的参数在栈帧之上，同load一样需要再偏移保存的寄存器
+        if (dynamic_cast<TemporarySymbolEntry *>(use_list[0]->getEntry())->getOffset() >= 0)
+            cur_block->getParent()->addAdditionalArgsOffset(offset);
         if (offset->isIllegalShifterOperand())
             offset = cur_block->insertLoadImm(offset);
         cur_inst = new StoreMInstruction(cur_block, src, fp, offset);
@@ -758,6 +873,249 @@ void StoreInstruction::genMachineCode(AsmBuilder *builder)
     }
 }
 
+// 有符号除以常数d的魔数和移位量(Hacker's Delight 10-1)，|d| >= 2
+static void signedMagic(int d, int &magic, int &shift)
+{
+    const unsigned two31 = 0x80000000;
+    unsigned ad = d < 0 ? -(unsigned)d : d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    int p = 31;
+    do
+    {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
+        {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    magic = q2 + 1;
+    if (d < 0)
+        magic = -magic;
+    shift = p - 32;
+}
+
+static MachineOperand *newVReg()
+{
+    return new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel());
+}
+
+static MachineOperand *newImm(int val)
+{
+    return new MachineOperand(MachineOperand::IMM, val);
+}
+
+// 除数是常数时不用sdiv：2的幂用移位加符号修正，其他用smmul取魔数乘积的高位
+// dst可能和n是同一个虚拟寄存器，只有最后一条指令写dst
+static bool genDivByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *n, int d)
+{
+    if (d == 0 || d == INT32_MIN)
+        return false;
+    auto use = [](MachineOperand *op)
+    { return new MachineOperand(*op); };
+    if (d == 1 || d == -1)
+    {
+        if (d == 1)
+            block->insertInst(new MovMInstruction(block, MovMInstruction::MOV, dst, use(n)));
+        else
+            block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::RSB, dst, use(n), newImm(0)));
+        return true;
+    }
+    unsigned ad = d < 0 ? -d : d;
+    MachineOperand *q;
+    if ((ad & (ad - 1)) == 0)
+    {
+        // n为负时先加上2^k-1，使移位向0取整
+        int k = __builtin_ctz(ad);
+        auto sign = n;
+        if (k > 1)
+        {
+            sign = newVReg();
+            block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::ASR, sign, use(n), newImm(31)));
+        }
+        auto bias = newVReg();
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::LSR, bias, use(sign), newImm(32 - k)));
+        auto sum = newVReg();
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::ADD, sum, use(n), use(bias)));
+        q = d > 0 ? dst : newVReg();
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::ASR, q, use(sum), newImm(k)));
+    }
+    else
+    {
+        int magic, shift;
+        signedMagic(d, magic, shift);
+        auto m = block->insertLoadImm(newImm(magic));
+        q = newVReg();
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::SMMUL, q, use(n), m));
+        if (d > 0 && magic < 0)
+        {
+            auto t = newVReg();
+            block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::ADD, t, use(q), use(n)));
+            q = t;
+        }
+        else if (d < 0 && magic > 0)
+        {
+            auto t = newVReg();
+            block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::SUB, t, use(q), use(n)));
+            q = t;
+        }
+        if (shift > 0)
+        {
+            auto t = newVReg();
+            block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::ASR, t, use(q), newImm(shift)));
+            q = t;
+        }
+        // 商为负时加1
+        auto sign = newVReg();
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::LSR, sign, use(q), newImm(31)));
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::ADD, dst, use(q), use(sign)));
+        return true;
+    }
+    if (d < 0)
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::RSB, dst, use(q), newImm(0)));
+    return true;
+}
+
+// a % d = a - a / d * d，余数的符号只取决于a，除数取绝对值；乘2的幂用移位
+static bool genModByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *n, int d)
+{
+    if (d == 0 || d == INT32_MIN)
+        return false;
+    unsigned ad = d < 0 ? -d : d;
+    if (ad == 1)
+    {
+        block->insertInst(new MovMInstruction(block, MovMInstruction::MOV, dst, newImm(0)));
+        return true;
+    }
+    auto q = newVReg();
+    genDivByConst(block, q, n, ad);
+    auto prod = newVReg();
+    if ((ad & (ad - 1)) == 0)
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::LSL, prod, new MachineOperand(*q), newImm(__builtin_ctz(ad))));
+    else
+        block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::MUL, prod, new MachineOperand(*q), block->insertLoadImm(newImm(ad))));
+    block->insertInst(new BinaryMInstruction(block, BinaryMInstruction::SUB, dst, new MachineOperand(*n), new MachineOperand(*prod)));
+    return true;
+}
+
+/*
+    乘以常数分解为移位和加减，v从x开始，每一步是一条带移位操作数的指令：
+        STEP_SHL: v = v << k          STEP_ADD_SELF: v = v + (v << k)    STEP_RSB_SELF: v = (v << k) - v
+        STEP_SUB_SELF: v = v - (v << k)    STEP_ADD_X: v = x + (v << k)    STEP_RSB_X: v = (v << k) - x
+        STEP_NEG: v = 0 - v
+    最多两步，不比ldr常数加mul慢
+*/
+enum
+{
+    STEP_SHL,
+    STEP_ADD_SELF,
+    STEP_RSB_SELF,
+    STEP_SUB_SELF,
+    STEP_ADD_X,
+    STEP_RSB_X,
+    STEP_NEG
+};
+static const int MAX_MUL_STEPS = 2;
+
+static bool findMulSteps(long long c, int depth, std::vector<std::pair<int, int>> &steps)
+{
+    if (c == 1)
+        return true;
+    if (depth == 0 || c == 0)
+        return false;
+    auto tryStep = [&](long long m, int op, int k)
+    {
+        if (m == 0 || !findMulSteps(m, depth - 1, steps))
+            return false;
+        steps.push_back({op, k});
+        return true;
+    };
+    if (tryStep(-c, STEP_NEG, 0))
+        return true;
+    for (int k = 1; k < 32; k++)
+    {
+        long long p = 1LL << k;
+        if (c % p == 0 && tryStep(c / p, STEP_SHL, k))
+            return true;
+        if (c % (p + 1) == 0 && tryStep(c / (p + 1), STEP_ADD_SELF, k))
+            return true;
+        if (k > 1 && c % (p - 1) == 0 && tryStep(c / (p - 1), STEP_RSB_SELF, k))
+            return true;
+        if (c % (1 - p) == 0 && tryStep(c / (1 - p), STEP_SUB_SELF, k))
+            return true;
+        if ((c - 1) % p == 0 && tryStep((c - 1) / p, STEP_ADD_X, k))
+            return true;
+        if ((c + 1) % p == 0 && tryStep((c + 1) / p, STEP_RSB_X, k))
+            return true;
+    }
+    return false;
+}
+
+// dst可能和x是同一个虚拟寄存器，只有最后一条指令写dst
+static bool genMulByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *x, int c)
+{
+    if (c == 0)
+    {
+        block->insertInst(new MovMInstruction(block, MovMInstruction::MOV, dst, newImm(0)));
+        return true;
+    }
+    std::vector<std::pair<int, int>> steps;
+    bool found = false;
+    for (int depth = 0; depth <= MAX_MUL_STEPS && !found; depth++)
+    {
+        steps.clear();
+        found = findMulSteps(c, depth, steps);
+    }
+    if (!found)
+        return false;
+    if (steps.empty())
+    {
+        block->insertInst(new MovMInstruction(block, MovMInstruction::MOV, dst, new MachineOperand(*x)));
+        return true;
+    }
+    auto v = x;
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        auto t = i + 1 == steps.size() ? dst : newVReg();
+        int op = steps[i].first, k = steps[i].second;
+        BinaryMInstruction *inst;
+        switch (op)
+        {
+        case STEP_SHL:
+            inst = new BinaryMInstruction(block, BinaryMInstruction::LSL, t, new MachineOperand(*v), newImm(k));
+            break;
+        case STEP_NEG:
+            inst = new BinaryMInstruction(block, BinaryMInstruction::RSB, t, new MachineOperand(*v), newImm(0));
+            break;
+        default:
+        {
+            static const int opcodes[] = {0, BinaryMInstruction::ADD, BinaryMInstruction::RSB, BinaryMInstruction::SUB, BinaryMInstruction::ADD, BinaryMInstruction::RSB};
+            auto src1 = op == STEP_ADD_X || op == STEP_RSB_X ? x : v;
+            inst = new BinaryMInstruction(block, opcodes[op], t, new MachineOperand(*src1), new MachineOperand(*v));
+            inst->setShift(BinaryMInstruction::LSL, k);
+            break;
+        }
+        }
+        block->insertInst(inst);
+        v = t;
+    }
+    return true;
+}
+
 void BinaryInstruction::genMachineCode(AsmBuilder *builder)
 {
     auto cur_block = builder->getBlock();
@@ -784,6 +1142,21 @@ void BinaryInstruction::genMachineCode(AsmBuilder *builder)
     }
     // toDo : a = a + 0, a = b - 0, a = b*0, a=b*1, a = c/1; 把这部分工作额外用一次强度削弱的遍历来完成
     MachineInstruction *cur_inst = nullptr;
+    if ((opcode == DIV || opcode == MOD) && src2->isImm() && !dst->getValType()->isFloat())
+    {
+        if (src1->isImm())
+            src1 = cur_block->insertLoadImm(src1);
+        int d = src2->getVal();
+        if (opcode == DIV ? genDivByConst(cur_block, dst, src1, d) : genModByConst(cur_block, dst, src1, d))
+            return;
+    }
+    if (opcode == MUL && src1->isImm() != src2->isImm() && !dst->getValType()->isFloat())
+    {
+        auto x = src1->isImm() ? src2 : src1;
+        int c = (src1->isImm() ? src1 : src2)->getVal();
+        if (genMulByConst(cur_block, dst, x, c))
+            return;
+    }
     if (opcode == MUL || opcode == DIV || opcode == MOD)
     {
         if (src2->isImm())
@@ -791,23 +1164,40 @@ void BinaryInstruction::genMachineCode(AsmBuilder *builder)
     }
     if (src1->isImm() && src2->isImm())
         src1 = cur_block->insertLoadImm(src1);
+    // imm - x 且imm能编码时用 rsb dst, x, #imm
+    int add_op = opcode == ADD ? BinaryMInstruction::ADD : BinaryMInstruction::SUB;
     if (src1->isImm() && !src2->isImm())
     {
         if (opcode == ADD)
             std::swap(src1, src2);
+        else if (opcode == SUB && !src1->getValType()->isFloat() && isShifterOperandVal((int)src1->getVal()))
+        {
+            std::swap(src1, src2);
+            add_op = BinaryMInstruction::RSB;
+        }
         else
             src1 = cur_block->insertLoadImm(src1);
     }
+    if (src2->isImm() && (opcode == ADD || opcode == SUB) && add_op != BinaryMInstruction::RSB && !src2->getValType()->isFloat())
+    {
+        // 立即数不能编码而相反数能编码时，add与sub互换
+        int val = src2->getVal();
+        if (!isShifterOperandVal(val) && val != INT32_MIN && isShifterOperandVal(-val))
+        {
+            add_op = add_op == BinaryMInstruction::ADD ? BinaryMInstruction::SUB : BinaryMInstruction::ADD;
+            src2 = genMachineImm(-val);
+        }
+        else if (!isShifterOperandVal(val))
+            src2 = cur_block->insertLoadImm(src2);
+    }
     if (src2->isImm())
         if (src2->isIllegalShifterOperand())
             src2 = cur_block->insertLoadImm(src2);
     switch (opcode)
     {
     case ADD:
-        cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::ADD, dst, src1, src2);
-        break;
     case SUB:
-        cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::SUB, dst, src1, src2);
+        cur_inst = new BinaryMInstruction(cur_block, add_op, dst, src1, src2);
         break;
     case MUL:
         cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::MUL, dst, src1, src2);
@@ -817,15 +1207,14 @@ void BinaryInstruction::genMachineCode(AsmBuilder *builder)
         break;
     case MOD:
     {
-        // a % b = a - a / b * b
-        auto internal_reg1 = dst;
+        // a % b = a - a / b * b，dst可能和a是同一个虚拟寄存器(PHI消除后)，中间结果不能放在dst里
+        auto internal_reg1 = genMachineVReg();
         cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::DIV, internal_reg1, src1, src2);
         cur_block->insertInst(cur_inst);
         auto internal_reg2 = new MachineOperand(*internal_reg1);
-        cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::MUL, internal_reg2, internal_reg1, src2);
+        cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::MUL, internal_reg2, new MachineOperand(*internal_reg1), new MachineOperand(*src2));
         cur_block->insertInst(cur_inst);
-        dst = new MachineOperand(*internal_reg2);
-        cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::SUB, dst, src1, internal_reg2);
+        cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::SUB, dst, new MachineOperand(*src1), new MachineOperand(*internal_reg2));
         break;
     }
     default:
@@ -842,9 +1231,20 @@ void CmpInstruction::genMachineCode(AsmBuilder *builder)
     MachineInstruction *cur_inst = nullptr;
     if (src1->isImm())
         src1 = cur_block->insertLoadImm(src1);
+    // 立即数不能编码而相反数能编码时用cmn
+    int cmp_op = CmpMInstruction::CMP;
+    if (src2->isImm() && !src2->getValType()->isFloat())
+    {
+        int val = src2->getVal();
+        if (!isShifterOperandVal(val) && val != INT32_MIN && isShifterOperandVal(-val))
+        {
+            cmp_op = CmpMInstruction::CMN;
+            src2 = genMachineImm(-val);
+        }
+    }
     if (src2->isImm() && src2->isIllegalShifterOperand())
         src2 = cur_block->insertLoadImm(src2);
-    cur_inst = new CmpMInstruction(cur_block, src1, src2);
+    cur_inst = new CmpMInstruction(cur_block, cmp_op, src1, src2);
     cur_block->insertInst(cur_inst);
     if (src1->getValType()->isFloat())
     {
@@ -906,6 +1306,8 @@ void RetInstruction::genMachineCode(AsmBuilder *builder)
      * 3. Generate bx instruction */
     auto cur_block = builder->getBlock();
     MachineInstruction *cur_inst = nullptr;
+    if (getPrev()->isCall() && dynamic_cast<FuncCallInstruction *>(getPrev())->isTailCall())
+        return;
     // Generate mov instruction to save return value in r0
     if (!use_list.empty())
     {
@@ -930,20 +1332,39 @@ void ZextInstruction::genMachineCode(AsmBuilder *builder)
     cur_block->insertInst(cur_inst);
 }
 
+void CopyInstruction::genMachineCode(AsmBuilder *builder)
+{
+    auto cur_block = builder->getBlock();
+    auto dst = genMachineOperand(def_list[0]);
+    auto src = genMachineOperand(use_list[0]);
+    if (src->isImm())
+    {
+        if (src->getValType()->isFloat())
+            src = cur_block->insertLoadImm(src);
+        else if (src->isIllegalShifterOperand())
+        {
+            cur_block->insertInst(new LoadMInstruction(cur_block, dst, src));
+            return;
+        }
+    }
+    cur_block->insertInst(new MovMInstruction(cur_block, dst->getValType()->isFloat() ? MovMInstruction::VMOV : MovMInstruction::MOV, dst, src));
+}
+
 void IntFloatCastInstruction::genMachineCode(AsmBuilder *builder)
 {
     MachineInstruction *cur_inst;
     auto cur_block = builder->getBlock();
     auto src = genMachineOperand(use_list[0]);
     auto dst = genMachineOperand(def_list[0]);
-    if (src->isImm() && src->isIllegalShifterOperand())
+    // vmov/vcvt都不接受立即数
+    if (src->isImm())
         src = cur_block->insertLoadImm(src);
     switch (opcode)
     {
     case F2S:
     {
-        auto internal_reg1 = new MachineOperand(*src);
-        cur_inst = new VcvtMInstruction(cur_block, VcvtMInstruction::F2S, internal_reg1, src); // todo：internal_reg1和src应该可以是一个寄存器
+        auto internal_reg1 = genMachineVReg(TypeSystem::floatType); // src在转换之后可能仍活跃，不能原地转换
+        cur_inst = new VcvtMInstruction(cur_block, VcvtMInstruction::F2S, internal_reg1, src);
         cur_block->insertInst(cur_inst);
         auto internal_reg2 = new MachineOperand(*internal_reg1);
         cur_inst = new MovMInstruction(cur_block, MovMInstruction::VMOV, dst, internal_reg2);
@@ -963,10 +1384,28 @@ void IntFloatCastInstruction::genMachineCode(AsmBuilder *builder)
     }
 }
 
+bool FuncCallInstruction::isTailCall()
+{
+    auto ret = getNext();
+    if (!ret->isRet() || use_list.size() > 4)
+        return false;
+    if (!ret->getUses().empty() && ret->getUses()[0]->getEntry() != def_list[0]->getEntry())
+        return false;
+    // 局部变量(含-O0下的标量)在栈帧中，实参可能指向它们
+    auto entry = parent->getParent()->getEntry();
+    for (auto inst = entry->begin(); inst != entry->end(); inst = inst->getNext())
+        if (inst->isAlloca())
+            return false;
+    // 被调函数要求8字节对齐而调用者不要求时，调用者入口处的sp不一定对齐
+    auto caller_se = dynamic_cast<IdentifierSymbolEntry *>(parent->getParent()->getSymPtr());
+    return !func_se->need8BytesAligned() || caller_se->need8BytesAligned();
+}
+
 void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
 {
     auto cur_block = builder->getBlock();
     MachineInstruction *cur_inst = nullptr;
+    std::vector<MachineOperand *> arg_regs;
     // 传递参数
     for (int i = (int)use_list.size() - 1; i != -1; i--)
     {
@@ -975,6 +1414,7 @@ void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
         if (i < 4)
         {
             auto dst = new MachineOperand(MachineOperand::REG, i, arg->getValType());
+            arg_regs.push_back(new MachineOperand(*dst));
             if (arg->isImm() && arg->getValType()->isInt())
             {
                 cur_inst = new LoadMInstruction(cur_block, dst, arg);
@@ -1001,8 +1441,15 @@ void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
             cur_block->insertInst(cur_inst);
         }
     }
+    // 尾调用由被调函数直接返回到调用者的调用者，不需要保存lr，之后的ret也不再生成代码
+    if (isTailCall())
+    {
+        cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::TAIL, new MachineOperand(func_se->toStr()), arg_regs);
+        cur_block->insertInst(cur_inst);
+        return;
+    }
     // 生成跳转指令进入callee函数，保存pc到lr，callee要保存lr
-    cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::BL, new MachineOperand(func_se->toStr()));
+    cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::BL, new MachineOperand(func_se->toStr()), arg_regs);
     cur_block->insertInst(cur_inst);
     cur_block->getParent()->addSavedRegs(14); // lr
     // 传递是否需要8 bytes aligned
@@ -1024,7 +1471,7 @@ void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
         cur_block->insertInst(cur_inst);
     }
     // 如果函数执行结果被用到，还需要保存 R0 寄存器中的返回值。
-    if (def_list[0]->getType() != TypeSystem::voidType) // TODO：这个判断并不精准，返回值非void不代表一定用到,后续可以通过窥孔优化删除无用指令
+    if (def_list[0]->getType() != TypeSystem::voidType && !def_list[0]->getUses().empty())
     {
         auto dst = genMachineOperand(def_list[0]);
         auto src = new MachineOperand(MachineOperand::REG, 0, dst->getValType()); // r0/s0
@@ -1054,7 +1501,11 @@ void GepInstruction::genMachineCode(AsmBuilder *builder)
             cur_block->insertInst(cur_inst);
         }
         else
-            assert(0);
+        {
+            // Mem2Reg之后数组参数直接作为基址
+            assert(((IdentifierSymbolEntry *)(arr->getEntry()))->isParam());
+            base_addr = genMachineOperand(arr);
+        }
     }
     else if (arr->getEntry()->isTemporary())
     {
@@ -1070,7 +1521,8 @@ void GepInstruction::genMachineCode(AsmBuilder *builder)
         }
         else
         {
-            assert(arr->getDef() && (arr->getDef()->isLoad() || arr->getDef()->isGep()));
+            // 强度削弱后基址可以是指针PHI；内联后基址可以是实参中GEP结果的别名(没有def)
+            assert(!arr->getDef() || arr->getDef()->isLoad() || arr->getDef()->isGep() || arr->getDef()->isPHI());
             base_addr = genMachineOperand(arr);
         }
     }
@@ -1089,17 +1541,41 @@ void GepInstruction::genMachineCode(AsmBuilder *builder)
                 internal_reg = new MachineOperand(*dst);
             }
         }
+        else if (use_list[i]->getEntry()->isConstant())
+        {
+            // 常量下标直接算出偏移
+            int offset = (int)use_list[i]->getEntry()->getValue() * cur_size;
+            int op = offset < 0 ? BinaryMInstruction::SUB : BinaryMInstruction::ADD;
+            auto imm = genMachineImm(offset < 0 ? -offset : offset);
+            if (imm->isIllegalShifterOperand())
+                imm = cur_block->insertLoadImm(imm);
+            cur_inst = new BinaryMInstruction(cur_block, op, dst, internal_reg, imm);
+            cur_block->insertInst(cur_inst);
+            internal_reg = new MachineOperand(*dst);
+        }
         else
         {
             auto idx = genMachineOperand(use_list[i]);
-            if (idx->isImm())
-                idx = cur_block->insertLoadImm(idx);
-            auto size = cur_block->insertLoadImm(genMachineImm(cur_size));
-            auto extra_offset = genMachineVReg();
-            cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::MUL, extra_offset, idx, size);
-            cur_block->insertInst(cur_inst);
-            cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::ADD, dst, internal_reg, new MachineOperand(*extra_offset));
-            cur_block->insertInst(cur_inst);
+            // 元素大小是2的幂时直接 add dst, base, idx, lsl #k
+            if ((cur_size & (cur_size - 1)) == 0)
+            {
+                auto add = new BinaryMInstruction(cur_block, BinaryMInstruction::ADD, dst, internal_reg, idx);
+                if (cur_size > 1)
+                    add->setShift(BinaryMInstruction::LSL, __builtin_ctz(cur_size));
+                cur_block->insertInst(add);
+            }
+            else
+            {
+                auto extra_offset = genMachineVReg();
+                if (!genMulByConst(cur_block, extra_offset, idx, cur_size))
+                {
+                    auto size = cur_block->insertLoadImm(genMachineImm(cur_size));
+                    cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::MUL, extra_offset, idx, size);
+                    cur_block->insertInst(cur_inst);
+                }
+                cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::ADD, dst, internal_reg, new MachineOperand(*extra_offset));
+                cur_block->insertInst(cur_inst);
+            }
             internal_reg = new MachineOperand(*dst);
         }
         if (i != use_list.size() - 1)
@@ -0,0 +1,179 @@
+#include "LICM.h"
+#include "Type.h"
+#include <algorithm>
+
+void LICM::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+    {
+        DT = pm->getDomTree(*func);
+        AA = new AliasAnalysis(*func);
+        for (auto loop : pm->getLoopInfo(*func)->getLoops())
+            hoist(loop);
+        delete AA;
+    }
+}
+
+bool LICM::isInvariant(Loop *loop, Operand *op)
+{
+    auto def = AA->getDef(op);
+    return def == nullptr || !loop->contains(def->getParent());
+}
+
+// 进入循环时header中的条件分支是否一定进入循环体：比较的操作数是常量或初值为常量的header PHI
+bool LICM::entersBody(Loop *loop)
+{
+    auto header = loop->getHeader();
+    auto exiting = loop->getExitingBlocks();
+    if (std::find(exiting.begin(), exiting.end(), header) == exiting.end())
+        return true;
+    if (!header->rbegin()->isCond())
+        return false;
+    auto branch = dynamic_cast<CondBrInstruction *>(header->rbegin());
+    auto cmp = branch->getUses()[0]->getDef();
+    if (cmp == nullptr || !cmp->isCmp())
+        return false;
+    double vals[2];
+    for (int i = 0; i < 2; i++)
+    {
+        auto op = cmp->getUses()[i];
+        auto def = op->getDef();
+        if (def != nullptr && def->isPHI() && def->getParent() == header)
+            op = dynamic_cast<PhiInstruction *>(def)->getSrcs()[loop->getPreheader()];
+        if (op == nullptr || !op->getEntry()->isConstant())
+            return false;
+        vals[i] = op->getEntry()->getValue();
+    }
+    bool taken;
+    switch (cmp->getOpcode())
+    {
+    case CmpInstruction::E:
+        taken = vals[0] == vals[1];
+        break;
+    case CmpInstruction::NE:
+        taken = vals[0] != vals[1];
+        break;
+    case CmpInstruction::L:
+        taken = vals[0] < vals[1];
+        break;
+    case CmpInstruction::LE:
+        taken = vals[0] <= vals[1];
+        break;
+    case CmpInstruction::G:
+        taken = vals[0] > vals[1];
+        break;
+    default:
+        taken = vals[0] >= vals[1];
+        break;
+    }
+    return loop->contains(taken ? branch->getTrueBranch() : branch->getFalseBranch());
+}
+
+// 全局标量的地址总是合法的，提升后在循环不执行的路径上读取也不会出错
+static bool isSafeAddress(Operand *addr)
+{
+    auto se = addr->getEntry();
+    if (!se->isVariable() || !dynamic_cast<IdentifierSymbolEntry *>(se)->isGlobal())
+        return false;
+    auto type = dynamic_cast<PointerType *>(se->getType());
+    return type != nullptr && !type->getValType()->isARRAY();
+}
+
+// 进入循环后bb一定执行：bb是header，或循环至少执行一次且bb支配所有latch和header以外的退出块
+bool LICM::isGuaranteed(Loop *loop, BasicBlock *bb, bool enters)
+{
+    if (bb == loop->getHeader())
+        return true;
+    if (!enters)
+        return false;
+    for (auto latch : loop->getLatches())
+        if (!DT->dominates(bb, latch))
+            return false;
+    for (auto exiting : loop->getExitingBlocks())
+        if (exiting != loop->getHeader() && !DT->dominates(bb, exiting))
+            return false;
+    return true;
+}
+
+bool LICM::canHoist(Instruction *inst, bool loadsSafe, const std::vector<Operand *> &stores)
+{
+    if (inst->isBinary())
+    {
+        auto opcode = inst->getOpcode();
+        if ((opcode == BinaryInstruction::DIV || opcode == BinaryInstruction::MOD) && inst->getDef()[0]->getType()->isInt())
+        {
+            auto se = inst->getUses()[1]->getEntry();
+            if (!se->isConstant() || se->getValue() == 0 || se->getValue() == -1)
+                return false;
+        }
+        return true;
+    }
+    if (inst->isCmp())
+    {
+        for (auto user : inst->getDef()[0]->getUses())
+            if (user->isCond())
+                return false;
+        return true;
+    }
+    if (inst->isZext() || inst->isIntFloatCast() || inst->isGep())
+        return true;
+    if (inst->isLoad())
+    {
+        if (!loadsSafe || !(guaranteed.count(inst->getParent()) || isSafeAddress(inst->getUses()[0])))
+            return false;
+        for (auto addr : stores)
+            if (AA->mayAlias(addr, inst->getUses()[0]))
+                return false;
+        return true;
+    }
+    return false;
+}
+
+void LICM::hoist(Loop *loop)
+{
+    auto preheader = loop->getPreheader();
+    if (preheader == nullptr)
+        return;
+    std::vector<BasicBlock *> blocks;
+    for (auto bb : DT->getRPO())
+        if (loop->contains(bb))
+            blocks.push_back(bb);
+    bool loadsSafe = true;
+    std::vector<Operand *> stores;
+    for (auto bb : blocks)
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            if (inst->isStore())
+                stores.push_back(inst->getUses()[0]);
+            else if (inst->isCall() && AliasAnalysis::mayWriteMemory(inst))
+                loadsSafe = false;
+    // load提升到preheader后在循环不执行或不经过该块时也会执行，只提升一定会执行的或地址总是合法的
+    guaranteed.clear();
+    bool enters = entersBody(loop);
+    for (auto bb : blocks)
+        if (isGuaranteed(loop, bb, enters))
+            guaranteed.insert(bb);
+    // 按RPO遍历，定义先于使用，提升后的指令位于循环外，其使用者随之成为不变量
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto bb : blocks)
+        {
+            auto inst = bb->begin();
+            while (inst != bb->end())
+            {
+                auto next = inst->getNext();
+                bool invariant = canHoist(inst, loadsSafe, stores);
+                for (auto use : inst->getUses())
+                    invariant = invariant && isInvariant(loop, use);
+                if (invariant)
+                {
+                    bb->remove(inst);
+                    preheader->insertBefore(inst, preheader->rbegin());
+                    changed = true;
+                }
+                inst = next;
+            }
+        }
+    }
+}
@@ -1,15 +1,16 @@
 #include <algorithm>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
 #include "LinearScan.h"
 #include "MachineCode.h"
-#include "LiveVariableAnalysis.h"
 
-LinearScan::LinearScan(MachineUnit *unit)
+LinearScan::~LinearScan()
 {
-    this->unit = unit;
-    for (int i = 4; i < 11; i++)
-        rregs.push_back(i);
-    for (int i = 5; i < 32; i++)
-        sregs.push_back(i);
+    for (auto &interval : intervals)
+        delete interval;
+    for (auto &interval : fixed)
+        delete interval;
 }
 
 void LinearScan::allocateRegisters()
@@ -17,319 +18,834 @@ void LinearScan::allocateRegisters()
     for (auto &f : unit->getFuncs())
     {
         func = f;
-        bool success;
-        success = false;
-        while (!success) // repeat until all vregs can be mapped
-        {
-            computeLiveIntervals();
-            success = linearScanRegisterAllocation();
-            if (success) // all vregs can be mapped to real regs
-                modifyCode();
-            else // spill vregs that can't be mapped to real regs
-                genSpillCode();
-        }
+        computeLiveIntervals();
+        linearScanRegisterAllocation();
+        resolveDataFlow();
+        genSpillCode();
+        modifyCode();
     }
 }
 
-void LinearScan::makeDuChains()
+void LinearScan::Interval::addRange(int from, int to)
 {
-    MLiveVariableAnalysis lva;
-    lva.pass(func);
-    du_chains.clear();
-    int i = 0;
-    std::map<MachineOperand, std::set<MachineOperand *>> liveVar;
-    for (auto &bb : func->getBlocks())
+    // 逆序扫描时range按位置从后往前加入，ranges.back()是目前最靠前的一段
+    if (ranges.empty() || ranges.back().start > to)
+        ranges.push_back({from, to});
+    else
     {
-        liveVar.clear();
-        for (auto &t : bb->getLiveOut())
-            liveVar[*t].insert(t);
-        int no;
-        no = i = bb->getInsts().size() + i;
-        for (auto inst = bb->getInsts().rbegin(); inst != bb->getInsts().rend(); inst++)
-        {
-            (*inst)->setNo(no--);
-            for (auto &def : (*inst)->getDef())
-            {
-                if (def->isVReg())
-                {
-                    auto &uses = liveVar[*def];
-                    du_chains[def].insert(uses.begin(), uses.end());
-                    auto &kill = lva.getAllUses()[*def];
-                    std::set<MachineOperand *> res;
-                    set_difference(uses.begin(), uses.end(), kill.begin(), kill.end(), inserter(res, res.end()));
-                    liveVar[*def] = res;
-                }
-            }
-            for (auto &use : (*inst)->getUse())
-            {
-                if (use->isVReg())
-                    liveVar[*use].insert(use);
-            }
-        }
+        ranges.back().start = std::min(ranges.back().start, from);
+        ranges.back().end = std::max(ranges.back().end, to);
     }
 }
 
+// pos单调不减，cur_range只需前移
+bool LinearScan::Interval::covers(int pos)
+{
+    while (cur_range < ranges.size() && ranges[cur_range].end <= pos)
+        cur_range++;
+    return cur_range < ranges.size() && ranges[cur_range].start <= pos;
+}
+
+int LinearScan::Interval::intersectPos(Interval *other)
+{
+    size_t i = cur_range, j = other->cur_range;
+    while (i < ranges.size() && j < other->ranges.size())
+    {
+        if (ranges[i].end <= other->ranges[j].start)
+            i++;
+        else if (other->ranges[j].end <= ranges[i].start)
+            j++;
+        else
+            return std::max(ranges[i].start, other->ranges[j].start);
+    }
+    return -1;
+}
+
+int LinearScan::Interval::nextUsePos(int pos)
+{
+    auto it = std::lower_bound(use_pos.begin(), use_pos.end(), pos);
+    return it == use_pos.end() ? INT_MAX : *it;
+}
+
+int LinearScan::Interval::lastUsePos(int pos)
+{
+    auto it = std::lower_bound(use_pos.begin(), use_pos.end(), pos);
+    return it == use_pos.begin() ? -1 : *(it - 1);
+}
+
 void LinearScan::computeLiveIntervals()
 {
-    makeDuChains();
+    lva.pass(func);
+    func->computeLoopDepth();
+    for (auto &interval : intervals)
+        delete interval;
+    for (auto &interval : fixed)
+        delete interval;
     intervals.clear();
-    for (auto &du_chain : du_chains)
+    fixed.clear();
+    vreg2interval.clear();
+    blocks.clear();
+    block_start.clear();
+    numbered_insts.clear();
+    interval_cnt = 0;
+    // 指令编号，同时为每个vreg建立区间
+    int pos = 0;
+    use2interval.assign(lva.getNumOfUses(), nullptr);
+    // 可分配的物理寄存器也建立区间，位置固定
+    auto isFixed = [&](MachineOperand *op)
+    {
+        auto &regs = op->getValType()->isFloat() ? sregs : rregs;
+        return op->isReg() && std::find(regs.begin(), regs.end(), op->getReg()) != regs.end();
+    };
+    auto newInterval = [&](MachineOperand *op)
     {
-        int t = -1;
-        for (auto &use : du_chain.second)
-            t = std::max(t, use->getParent()->getNo());
-        Interval *interval = new Interval({du_chain.first->getParent()->getNo(), t, false, 0, 0, du_chain.first->getValType(), {du_chain.first}, du_chain.second});
+        auto interval = new Interval({0, 0, false, 0, -1, op->getValType(), {}, {}, {}, {}, 0, interval_cnt++, nullptr, {}, op->isReg(), -1, nullptr});
+        if (interval->fixed)
+            interval->real_reg = op->getReg();
+        interval->parent = interval;
+        interval->children.push_back(interval);
+        vreg2interval[*op] = interval;
         intervals.push_back(interval);
-    }
-    for (auto &interval : intervals)
+    };
+    for (auto &bb : func->getBlocks())
     {
-        auto uses = interval->uses;
-        auto begin = interval->start;
-        auto end = interval->end;
-        for (auto block : func->getBlocks())
+        if (bb->getInsts().empty())
+            continue;
+        blocks.push_back(bb);
+        block_start.push_back(pos);
+        for (auto &inst : bb->getInsts())
         {
-            auto liveIn = block->getLiveIn();
-            auto liveOut = block->getLiveOut();
-            bool in = false;
-            bool out = false;
-            for (auto use : uses)
-                if (liveIn.count(use))
+            inst->setNo(pos);
+            numbered_insts.push_back(inst);
+            pos += 2;
+            for (auto &def : inst->getDef())
+                if ((def->isVReg() || isFixed(def)) && !vreg2interval.count(*def))
+                    newInterval(def);
+            for (auto &use : inst->getUse())
+                if (use->isVReg() || isFixed(use))
                 {
-                    in = true;
-                    break;
+                    if (!vreg2interval.count(*use))
+                        newInterval(use);
+                    use2interval[lva.getUseNo(use)] = vreg2interval[*use];
                 }
-            for (auto use : uses)
-                if (liveOut.count(use))
-                {
-                    out = true;
-                    break;
-                }
-            if (in && out)
+            // 与物理寄存器之间的mov，两端分到同一个寄存器时mov不再输出
+            if (dynamic_cast<MovMInstruction *>(inst) && inst->getCond() == MachineInstruction::NONE &&
+                inst->getDef()[0]->getValType()->isFloat() == inst->getUse()[0]->getValType()->isFloat())
             {
-                begin = std::min(begin, (*(block->begin()))->getNo());
-                end = std::max(end, (*(block->rbegin()))->getNo());
+                auto def = inst->getDef()[0], use = inst->getUse()[0];
+                if (def->isVReg() && isFixed(use))
+                    vreg2interval[*def]->hint = use->getReg();
+                else if (use->isVReg() && isFixed(def))
+                    vreg2interval[*use]->hint = def->getReg();
             }
-            else if (!in && out)
+        }
+    }
+    // 前/后方第一个循环深度更低的块
+    int n = blocks.size();
+    outer_prev.assign(n, -1);
+    outer_next.assign(n, -1);
+    std::vector<int> stk;
+    for (int i = 0; i < n; i++)
+    {
+        while (!stk.empty() && blocks[stk.back()]->getLoopDepth() >= blocks[i]->getLoopDepth())
+            stk.pop_back();
+        if (!stk.empty())
+            outer_prev[i] = stk.back();
+        stk.push_back(i);
+    }
+    stk.clear();
+    for (int i = n - 1; i >= 0; i--)
+    {
+        while (!stk.empty() && blocks[stk.back()]->getLoopDepth() >= blocks[i]->getLoopDepth())
+            stk.pop_back();
+        if (!stk.empty())
+            outer_next[i] = stk.back();
+        stk.push_back(i);
+    }
+    // 逆序扫描各块，live记录当前活跃的区间
+    BitVector live(intervals.size());
+    for (auto bb = blocks.rbegin(); bb != blocks.rend(); bb++)
+    {
+        int block_from = (*bb)->getInsts().front()->getNo();
+        int block_to = (*bb)->getInsts().back()->getNo() + 2;
+        live.resetAll();
+        lva.getLiveOutBits(*bb).forEach([&](int no)
+                                        {
+            if (use2interval[no])
+                live.set(use2interval[no]->no); });
+        live.forEach([&](int i)
+                     { intervals[i]->addRange(block_from, block_to); });
+        for (auto inst = (*bb)->rbegin(); inst != (*bb)->rend(); inst++)
+        {
+            int no = (*inst)->getNo();
+            for (auto &def : (*inst)->getDef())
             {
-                for (auto i : block->getInsts())
-                    if (i->getDef().size() > 0 &&
-                        i->getDef()[0] == *(uses.begin()))
-                    {
-                        begin = std::min(begin, i->getNo());
-                        break;
-                    }
-                end = std::max(end, (*(block->rbegin()))->getNo());
+                if (!vreg2interval.count(*def))
+                    continue;
+                auto interval = vreg2interval[*def];
+                if (live.test(interval->no))
+                    interval->ranges.back().start = no + 1;
+                else // 定值后未被使用，也要占住寄存器
+                    interval->addRange(no + 1, no + 2);
+                live.reset(interval->no);
+                interval->defs.push_back(def);
+                interval->use_pos.push_back(no + 1);
             }
-            else if (in && !out)
+            for (auto &use : (*inst)->getUse())
             {
-                begin = std::min(begin, (*(block->begin()))->getNo());
-                int temp = 0;
-                for (auto use : uses)
-                    if (use->getParent()->getParent() == block)
-                        temp = std::max(temp, use->getParent()->getNo());
-                end = std::max(temp, end);
+                if (!vreg2interval.count(*use))
+                    continue;
+                auto interval = vreg2interval[*use];
+                interval->addRange(block_from, no + 1);
+                live.set(interval->no);
+                interval->uses.push_back(use);
+                interval->use_pos.push_back(no);
             }
         }
-        interval->start = begin;
-        interval->end = end;
     }
-    bool change;
-    change = true;
-    while (change)
-    {
-        change = false;
-        std::vector<Interval *> t(intervals.begin(), intervals.end());
-        for (size_t i = 0; i < t.size(); i++)
-            for (size_t j = i + 1; j < t.size(); j++)
-            {
-                Interval *w1 = t[i];
-                Interval *w2 = t[j];
-                if (**w1->defs.begin() == **w2->defs.begin())
-                {
-                    std::set<MachineOperand *> temp;
-                    set_intersection(w1->uses.begin(), w1->uses.end(), w2->uses.begin(), w2->uses.end(), inserter(temp, temp.end()));
-                    if (!temp.empty())
-                    {
-                        change = true;
-                        w1->defs.insert(w2->defs.begin(), w2->defs.end());
-                        w1->uses.insert(w2->uses.begin(), w2->uses.end());
-                        // w1->start = std::min(w1->start, w2->start);
-                        // w1->end = std::max(w1->end, w2->end);
-                        auto w1Min = std::min(w1->start, w1->end);
-                        auto w1Max = std::max(w1->start, w1->end);
-                        auto w2Min = std::min(w2->start, w2->end);
-                        auto w2Max = std::max(w2->start, w2->end);
-                        w1->start = std::min(w1Min, w2Min);
-                        w1->end = std::max(w1Max, w2Max);
-                        auto it = std::find(intervals.begin(), intervals.end(), w2);
-                        if (it != intervals.end())
-                            intervals.erase(it);
-                    }
-                }
-            }
+    for (auto &interval : intervals)
+    {
+        std::reverse(interval->ranges.begin(), interval->ranges.end());
+        std::reverse(interval->use_pos.begin(), interval->use_pos.end());
+        interval->use_pos.erase(std::unique(interval->use_pos.begin(), interval->use_pos.end()), interval->use_pos.end());
+        interval->start = interval->ranges.front().start;
+        interval->end = interval->ranges.back().end;
+        if (interval->fixed)
+            fixed.push_back(interval);
+        else
+        {
+            if (interval->defs.size() == 1)
+                interval->remat = rematerializable(interval->defs[0]);
+            unhandled.push(interval);
+        }
+    }
+    intervals.erase(std::remove_if(intervals.begin(), intervals.end(), [](Interval *interval)
+                                   { return interval->fixed; }),
+                    intervals.end());
+}
+
+// 在pos处把区间切成两段，pos为偶数(某条指令之前)，返回后一段
+LinearScan::Interval *LinearScan::splitInterval(Interval *interval, int pos)
+{
+    auto child = new Interval({0, 0, false, 0, -1, interval->valType, {}, {}, {}, {}, 0, interval_cnt++, interval->parent, {}, false, -1, nullptr});
+    auto &ranges = interval->ranges;
+    size_t i = 0;
+    while (ranges[i].end <= pos)
+        i++;
+    if (ranges[i].start < pos)
+    {
+        child->ranges.push_back({pos, ranges[i].end});
+        ranges[i].end = pos;
+        i++;
+    }
+    child->ranges.insert(child->ranges.end(), ranges.begin() + i, ranges.end());
+    ranges.resize(i);
+    auto use = std::lower_bound(interval->use_pos.begin(), interval->use_pos.end(), pos);
+    child->use_pos.assign(use, interval->use_pos.end());
+    interval->use_pos.erase(use, interval->use_pos.end());
+    interval->end = ranges.back().end;
+    interval->cur_range = std::min(interval->cur_range, ranges.size());
+    child->start = child->ranges.front().start;
+    child->end = child->ranges.back().end;
+    interval->parent->children.push_back(child);
+    intervals.push_back(child);
+    return child;
+}
+
+// 在(min_pos, max_pos]中选择切分点：优先循环深度最低的块入口，否则尽量靠后
+int LinearScan::findSplitPos(int min_pos, int max_pos)
+{
+    max_pos &= ~1;
+    if (max_pos <= min_pos)
+        return max_pos;
+    int i = std::upper_bound(block_start.begin(), block_start.end(), max_pos) - block_start.begin() - 1;
+    int best = max_pos;
+    int best_depth = blocks[i]->getLoopDepth();
+    for (; i >= 0 && block_start[i] > min_pos; i--)
+        if (blocks[i]->getLoopDepth() < best_depth)
+        {
+            best = block_start[i];
+            best_depth = blocks[i]->getLoopDepth();
+        }
+    return best;
+}
+
+// 位置所在块的循环深度对应的执行频率估计
+double LinearScan::weight(int pos)
+{
+    int i = std::upper_bound(block_start.begin(), block_start.end(), pos) - block_start.begin() - 1;
+    return std::pow(10.0, std::min(blocks[std::max(i, 0)]->getLoopDepth(), 9));
+}
+
+// 从pos起有多少use位于pos所在的循环内
+int LinearScan::usesInLoop(Interval *interval, int pos)
+{
+    int i = std::upper_bound(block_start.begin(), block_start.end(), pos) - block_start.begin() - 1;
+    int loop_end = outer_next[i] == -1 ? INT_MAX : block_start[outer_next[i]];
+    return std::lower_bound(interval->use_pos.begin(), interval->use_pos.end(), loop_end) -
+           std::lower_bound(interval->use_pos.begin(), interval->use_pos.end(), pos);
+}
+
+/*
+    栈上的段从spill_pos开始，在min_pos之后选择重新载入的切分点，没有返回-1。
+    载入点比spill_pos处的循环更深、且在该层循环中用得不多时不载入，这些use直接经scratch寄存器访问，
+    否则ldr在循环内、str在回边上，每次迭代都要访存。cost累加估计的访存次数。
+*/
+int LinearScan::reloadPos(Interval *interval, int spill_pos, int min_pos, double &cost)
+{
+    for (auto use = std::lower_bound(interval->use_pos.begin(), interval->use_pos.end(), min_pos); use != interval->use_pos.end(); use++)
+    {
+        int split_pos = findSplitPos(min_pos, *use);
+        if (split_pos > min_pos && (weight(split_pos) <= weight(spill_pos) || usesInLoop(interval, split_pos) > 2))
+        {
+            cost += weight(split_pos);
+            return split_pos;
+        }
+        cost += weight(*use);
     }
-    sort(intervals.begin(), intervals.end(), compareStart);
+    // 之后只经回边活跃，ldr插在回边上
+    if (interval->end > min_pos + 1)
+        cost += weight(spill_pos);
+    return -1;
+}
+
+// 区间从pos起放到栈上的代价：切分处的str，经scratch寄存器访问的use，以及重新载入的ldr
+double LinearScan::spillCost(Interval *interval, int pos)
+{
+    double cost = interval->parent->remat ? 0 : weight(pos);
+    int min_pos = std::max(pos, position - 1);
+    for (auto use = std::lower_bound(interval->use_pos.begin(), interval->use_pos.end(), pos); use != interval->use_pos.end() && *use < min_pos; use++)
+        cost += weight(*use);
+    reloadPos(interval, pos, min_pos, cost);
+    return cost;
+}
+
+// 区间从pos起放到栈上，到重新载入处再切开，剩余部分重新参与分配
+void LinearScan::spillInterval(Interval *interval, int pos)
+{
+    if (pos > interval->start)
+        interval = splitInterval(interval, pos);
+    interval->spill = true;
+    // 重新分配的部分不能早于当前位置
+    double cost = 0;
+    int split_pos = reloadPos(interval, interval->start, std::max(interval->start, position - 1), cost);
+    if (split_pos != -1)
+        unhandled.push(splitInterval(interval, split_pos));
 }
 
-bool LinearScan::linearScanRegisterAllocation()
+/*
+    为了让current占用interval的寄存器，interval从pos起放到栈上，cost为估计代价。
+    当前位置处于内层循环时，也考虑在外层循环的块入口就让出寄存器，整个内层循环中经scratch寄存器访问，
+    避免每次迭代都在循环内str/ldr。
+*/
+bool LinearScan::evictSplitPos(Interval *interval, Interval *current, int &pos, double &cost)
+{
+    cost = -1;
+    if (interval->fixed)
+        return false;
+    auto candidate = [&](int split_pos)
+    {
+        double c = spillCost(interval, split_pos);
+        if (cost < 0 || c < cost)
+        {
+            cost = c;
+            pos = split_pos;
+        }
+    };
+    if (interval->covers(position))
+    {
+        int last_use = interval->lastUsePos(position);
+        int min_pos = std::max(last_use, interval->start);
+        int split_pos = findSplitPos(min_pos, position);
+        if (split_pos > min_pos)
+            candidate(split_pos);
+        else if (last_use < interval->start)
+            // 之前没有用到，整段放到栈上
+            candidate(interval->start);
+        int cur = std::upper_bound(block_start.begin(), block_start.end(), position) - block_start.begin() - 1;
+        for (int b = outer_prev[cur]; b != -1; b = outer_prev[b])
+        {
+            if (block_start[b] > min_pos)
+                continue;
+            candidate(std::max(block_start[b], interval->start));
+            if (block_start[b] <= interval->start)
+                break;
+        }
+        return cost >= 0;
+    }
+    int intersect_pos = interval->intersectPos(current);
+    int min_pos = std::max(interval->lastUsePos(intersect_pos), position - 1);
+    int split_pos = findSplitPos(min_pos, intersect_pos);
+    if (split_pos > min_pos)
+        candidate(split_pos);
+    return cost >= 0;
+}
+
+void LinearScan::linearScanRegisterAllocation()
 {
     active.clear();
-    rregs.clear();
-    sregs.clear();
-    for (int i = 4; i < 11; i++)
-        rregs.push_back(i);
-    for (int i = 5; i < 32; i++)
-        sregs.push_back(i);
-    bool flag = true;
-    for (auto &interval : intervals)
+    inactive = fixed;
+    while (!unhandled.empty())
     {
+        auto interval = unhandled.top();
+        unhandled.pop();
+        position = interval->start;
         expireOldIntervals(interval);
+        if (!tryAllocateFreeReg(interval))
+            allocateBlockedReg(interval);
+        if (!interval->spill)
+        {
+            interval->covers(position);
+            active.insert(interval);
+        }
+    }
+}
 
-        auto comp = [&](Interval *a, Interval *b) -> bool
+bool LinearScan::tryAllocateFreeReg(Interval *interval)
+{
+    bool isFloat = interval->valType->isFloat();
+    std::vector<int> free_until(32, INT_MAX);
+    for (auto &inter : active)
+        if (inter->valType->isFloat() == isFloat)
+            free_until[inter->real_reg] = 0;
+    for (auto &inter : inactive)
+        if (inter->valType->isFloat() == isFloat && free_until[inter->real_reg] > position)
         {
-            return a->end < b->end;
-        };
-        if (interval->valType->isFloat())
+            int pos = inter->intersectPos(interval);
+            if (pos != -1)
+                free_until[inter->real_reg] = std::min(free_until[inter->real_reg], pos);
+        }
+    auto &regs = isFloat ? sregs : rregs;
+    int reg = -1;
+    int hint = interval->parent->hint;
+    if (hint != -1 && free_until[hint] >= interval->end)
+        reg = hint;
+    for (auto r : regs)
+        if (reg == -1 && free_until[r] >= interval->end)
         {
-            if (!sregs.size())
-            {
-                spillAtInterval(interval);
-                flag = false;
-            }
-            else
-            {
-                interval->real_reg = (*sregs.rbegin());
-                sregs.pop_back();
-                // active.push_back(interval);
-                // sort(active.begin(), active.end(), comp);
-                auto insertPos = std::lower_bound(active.begin(), active.end(), interval, comp);
-                active.insert(insertPos, interval);
-            }
+            reg = r;
+            break;
         }
-        else
+    if (reg == -1)
+    {
+        // 只空闲一段，在空闲结束前切开
+        for (auto r : regs)
+            if (reg == -1 || free_until[r] > free_until[reg])
+                reg = r;
+        int split_pos = findSplitPos(position, free_until[reg]);
+        if (split_pos <= position)
+            return false;
+        unhandled.push(splitInterval(interval, split_pos));
+    }
+    interval->real_reg = reg;
+    return true;
+}
+
+void LinearScan::allocateBlockedReg(Interval *interval)
+{
+    bool isFloat = interval->valType->isFloat();
+    auto &regs = isFloat ? sregs : rregs;
+    // next_use为占用该寄存器的区间下一次使用的位置，无法让出的寄存器记为0；cost为让出寄存器的代价
+    std::vector<int> next_use(32, INT_MAX);
+    std::vector<double> cost(32, 0);
+    struct Evict
+    {
+        Interval *interval;
+        int pos;
+    };
+    std::vector<Evict> evict;
+    auto collect = [&](Interval *inter)
+    {
+        Evict e = {inter, 0};
+        double c;
+        if (evictSplitPos(inter, interval, e.pos, c))
         {
-            if (!rregs.size())
-            {
-                spillAtInterval(interval);
-                flag = false;
-            }
-            else
-            {
-                interval->real_reg = (*rregs.rbegin());
-                rregs.pop_back();
-                // active.push_back(interval);
-                // sort(active.begin(), active.end(), comp);
-                auto insertPos = std::lower_bound(active.begin(), active.end(), interval, comp);
-                active.insert(insertPos, interval);
-            }
+            next_use[inter->real_reg] = std::min(next_use[inter->real_reg], inter->nextUsePos(position));
+            cost[inter->real_reg] += c;
         }
+        else
+            next_use[inter->real_reg] = 0;
+        evict.push_back(e);
+    };
+    for (auto &inter : active)
+        if (inter->valType->isFloat() == isFloat)
+            collect(inter);
+    for (auto &inter : inactive)
+        if (inter->valType->isFloat() == isFloat && inter->intersectPos(interval) != -1)
+            collect(inter);
+    int farthest = regs[0];
+    for (auto r : regs)
+        if (next_use[r] > next_use[farthest])
+            farthest = r;
+    // 当前区间的第一次使用不比其他区间早，溢出当前区间
+    if (interval->nextUsePos(position) >= next_use[farthest])
+    {
+        spillInterval(interval, interval->start);
+        return;
+    }
+    // 当前位置之后还要用到的寄存器中选让出代价最小的，代价相同时选下一次使用最远的
+    int reg = -1;
+    for (auto r : regs)
+        if (next_use[r] > position &&
+            (reg == -1 || cost[r] < cost[reg] || (cost[r] == cost[reg] && next_use[r] > next_use[reg])))
+            reg = r;
+    interval->real_reg = reg;
+    for (auto &e : evict)
+    {
+        auto inter = e.interval;
+        if (inter->real_reg != reg)
+            continue;
+        active.erase(inter);
+        auto it = std::find(inactive.begin(), inactive.end(), inter);
+        if (it != inactive.end())
+            inactive.erase(it);
+        spillInterval(inter, e.pos);
     }
-    return flag;
 }
 
-void LinearScan::modifyCode()
+void LinearScan::expireOldIntervals(Interval *interval)
 {
-    for (auto &interval : intervals)
+    int pos = interval->start;
+    while (!active.empty() && (*active.begin())->end <= pos)
+        active.erase(active.begin());
+    // active中进入hole的区间移到inactive，inactive中重新覆盖pos的区间移回active
+    for (auto inter = active.begin(); inter != active.end();)
     {
-        func->addSavedRegs(interval->real_reg, interval->valType->isFloat());
-        for (auto def : interval->defs)
-            def->setReg(interval->real_reg);
-        for (auto use : interval->uses)
-            use->setReg(interval->real_reg);
+        if (!(*inter)->covers(pos))
+        {
+            inactive.push_back(*inter);
+            inter = active.erase(inter);
+        }
+        else
+            inter++;
     }
+    size_t j = 0;
+    for (size_t i = 0; i < inactive.size(); i++)
+    {
+        auto inter = inactive[i];
+        if (inter->end <= pos)
+            continue;
+        if (inter->covers(pos))
+            active.insert(inter);
+        else
+            inactive[j++] = inter;
+    }
+    inactive.resize(j);
 }
 
-void LinearScan::genSpillCode()
+// vreg在pos处所在的分段
+LinearScan::Interval *LinearScan::childAt(Interval *interval, int pos)
+{
+    auto &children = interval->children;
+    auto it = std::upper_bound(children.begin(), children.end(), pos, [](int pos, Interval *child)
+                               { return pos < child->start; });
+    return it == children.begin() ? nullptr : *(it - 1);
+}
+
+/*
+    同一个vreg相邻两段位置不同时需要插入move：
+        1) 切分点在块内，move插在切分点对应的指令之前
+        2) 切分点在块入口，或者vreg跨越控制流边，move插在边上：
+           前驱只有一个后继时放在前驱的跳转指令之前，后继只有一个前驱时放在后继开头，否则拆分关键边
+*/
+void LinearScan::resolveDataFlow()
 {
     for (auto &interval : intervals)
+        if (interval->parent == interval)
+            std::sort(interval->children.begin(), interval->children.end(), [](Interval *a, Interval *b)
+                      { return a->start < b->start; });
+    assignStackSlots();
+    std::set<int> starts(block_start.begin(), block_start.end());
+    // 每条控制流边上vreg的前后两段
+    std::vector<std::pair<std::pair<MachineBlock *, MachineBlock *>, std::vector<std::pair<Interval *, Interval *>>>> edges;
+    for (auto &block : blocks)
     {
-        if (!interval->spill)
-            continue;
-        /* HINT:
-         * The vreg should be spilled to memory.
-         * 1. insert ldr inst before the use of vreg
-         * 2. insert str inst after the def of vreg
-         */
-        interval->disp = func->AllocSpace(/*interval->valType->getSize()*/ 4);
-        for (auto use : interval->uses)
+        int from = block->getInsts().front()->getNo();
+        std::set<MachineBlock *> preds(block->getPreds().begin(), block->getPreds().end());
+        std::vector<Interval *> live_in;
+        lva.getLiveInBits(block).forEach([&](int no)
+                                         {
+            auto interval = use2interval[no];
+            if (interval && !interval->fixed && (live_in.empty() || live_in.back() != interval))
+                live_in.push_back(interval); });
+        for (auto &pred : preds)
         {
-            MachineBlock *block = use->getParent()->getParent();
-            auto pos = use->getParent();
-            auto offset = new MachineOperand(MachineOperand::IMM, -interval->disp);
-            if (offset->isIllegalShifterOperand())
-            {
-                auto internal_reg = new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel());
-                auto ldr = new LoadMInstruction(use->getParent()->getParent(), internal_reg, offset);
-                block->insertBefore(pos, ldr);
-                offset = new MachineOperand(*internal_reg);
-            }
-            block->insertBefore(pos, new LoadMInstruction(block, new MachineOperand(*use), new MachineOperand(MachineOperand::REG, 11), offset));
+            if (pred->getInsts().empty())
+                continue;
+            int to = pred->getInsts().back()->getNo() + 1;
+            std::vector<std::pair<Interval *, Interval *>> pieces;
+            for (auto &interval : live_in)
+                pieces.push_back(std::make_pair(childAt(interval, to), childAt(interval, from)));
+            edges.push_back(std::make_pair(std::make_pair(pred, block), pieces));
         }
-
+    }
+    // 寄存器中的段内没有定值，且只从栈上载入时，与栈上的值一致，之后放回栈上不需要str
+    std::set<Interval *> dirty;
+    for (auto &interval : intervals)
+    {
+        if (interval->parent != interval)
+            continue;
+        auto &children = interval->children;
+        dirty.insert(children[0]);
         for (auto def : interval->defs)
+            dirty.insert(childAt(interval, def->getParent()->getNo() + 1));
+        for (size_t i = 1; i < children.size(); i++)
+            if (children[i - 1]->end == children[i]->start && !children[i - 1]->spill)
+                dirty.insert(children[i]);
+    }
+    for (auto &edge : edges)
+        for (auto &p : edge.second)
+            if (p.first != p.second && !p.first->spill)
+                dirty.insert(p.second);
+    clean.clear();
+    for (auto &interval : intervals)
+        if (!interval->spill && !dirty.count(interval))
+            clean.insert(interval);
+    auto needMove = [&](Interval *from, Interval *to)
+    {
+        if (from == to || (from->spill && to->spill) || (!from->spill && to->spill && clean.count(from)))
+            return false;
+        return from->spill || to->spill || from->real_reg != to->real_reg;
+    };
+    std::map<MachineInstruction *, std::vector<std::pair<Interval *, Interval *>>> inner_moves;
+    for (auto &interval : intervals)
+    {
+        if (interval->parent != interval)
+            continue;
+        auto &children = interval->children;
+        for (size_t i = 1; i < children.size(); i++)
+            if (children[i - 1]->end == children[i]->start && !starts.count(children[i]->start) && needMove(children[i - 1], children[i]))
+                inner_moves[numbered_insts[children[i]->start / 2]].push_back(std::make_pair(children[i - 1], children[i]));
+    }
+    std::map<MachineBlock *, std::vector<std::pair<Interval *, Interval *>>> head_moves, tail_moves;
+    std::vector<std::pair<std::pair<MachineBlock *, MachineBlock *>, std::vector<std::pair<Interval *, Interval *>>>> edge_moves;
+    for (auto &edge : edges)
+    {
+        auto pred = edge.first.first;
+        auto block = edge.first.second;
+        std::vector<std::pair<Interval *, Interval *>> moves;
+        for (auto &p : edge.second)
+            if (needMove(p.first, p.second))
+                moves.push_back(p);
+        if (moves.empty())
+            continue;
+        std::set<MachineBlock *> succs(pred->getSuccs().begin(), pred->getSuccs().end());
+        std::set<MachineBlock *> preds(block->getPreds().begin(), block->getPreds().end());
+        if (succs.size() == 1)
+            tail_moves[pred] = moves;
+        else if (preds.size() == 1)
+            head_moves[block] = moves;
+        else
+            edge_moves.push_back(std::make_pair(edge.first, moves));
+    }
+    for (auto &block : blocks)
+    {
+        std::vector<MachineInstruction *> insts;
+        if (head_moves.count(block))
+            insertMoves(block, head_moves[block], insts);
+        for (auto &inst : block->getInsts())
+        {
+            if (inner_moves.count(inst))
+                insertMoves(block, inner_moves[inst], insts);
+            insts.push_back(inst);
+        }
+        if (tail_moves.count(block))
         {
-            MachineBlock *block = def->getParent()->getParent();
-            auto pos = def->getParent();
-            auto offset = new MachineOperand(MachineOperand::IMM, -interval->disp);
-            if (offset->isIllegalShifterOperand())
+            // 放在块末尾的跳转指令之前
+            std::vector<MachineInstruction *> branches;
+            while (!insts.empty() && insts.back()->isBranch() && insts.back()->getOpType() == BranchMInstruction::B)
             {
-                auto internal_reg = new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel());
-                auto ldr = new LoadMInstruction(def->getParent()->getParent(), internal_reg, offset);
-                block->insertAfter(pos, ldr);
-                offset = new MachineOperand(*internal_reg);
-                pos = ldr;
+                branches.push_back(insts.back());
+                insts.pop_back();
             }
-            block->insertAfter(pos, new StoreMInstruction(block, new MachineOperand(*def), new MachineOperand(MachineOperand::REG, 11), offset));
+            insertMoves(block, tail_moves[block], insts);
+            insts.insert(insts.end(), branches.rbegin(), branches.rend());
         }
+        block->getInsts() = insts;
+    }
+    // 拆分关键边
+    for (auto &edge : edge_moves)
+    {
+        auto pred = edge.first.first;
+        auto succ = edge.first.second;
+        auto new_block = new MachineBlock(func, SymbolTable::getLabel());
+        insertMoves(new_block, edge.second, new_block->getInsts());
+        new_block->insertInst(new BranchMInstruction(new_block, BranchMInstruction::B, new MachineOperand(".L" + std::to_string(succ->getNo()))));
+        for (auto &inst : pred->getInsts())
+            if (inst->isBranch() && inst->getOpType() == BranchMInstruction::B && inst->getDef()[0]->getLabel() == ".L" + std::to_string(succ->getNo()))
+            {
+                inst->getDef()[0] = new MachineOperand(".L" + std::to_string(new_block->getNo()));
+                inst->getDef()[0]->setParent(inst);
+            }
+        std::replace(pred->getSuccs().begin(), pred->getSuccs().end(), succ, new_block);
+        std::replace(succ->getPreds().begin(), succ->getPreds().end(), pred, new_block);
+        new_block->addPred(pred);
+        new_block->addSucc(succ);
+        func->insertBlock(new_block);
     }
 }
 
-void LinearScan::expireOldIntervals(Interval *interval)
+/*
+    栈槽着色：有分段放到栈上的vreg，以所有分段的range之并作为栈槽的生存期，
+    按起点顺序贪心地放进第一个生存期不相交的栈槽，栈帧更小，fp偏移也更容易编码在指令中
+*/
+void LinearScan::assignStackSlots()
 {
-    for (auto inter = active.begin(); inter != active.end(); inter = active.erase(find(active.begin(), active.end(), (*inter))))
+    auto overlap = [](const std::vector<Range> &a, const std::vector<Range> &b)
     {
-        if ((*inter)->end >= interval->start)
-            return;
-        if ((*inter)->valType->isFloat())
+        size_t i = 0, j = 0;
+        while (i < a.size() && j < b.size())
         {
-            auto insertPos = std::lower_bound(sregs.begin(), sregs.end(), (*inter)->real_reg);
-            sregs.insert(insertPos, (*inter)->real_reg);
-            // sregs.push_back((*inter)->real_reg);
-            // sort(sregs.begin(), sregs.end());
+            if (a[i].end <= b[j].start)
+                i++;
+            else if (b[j].end <= a[i].start)
+                j++;
+            else
+                return true;
         }
-        else
+        return false;
+    };
+    auto merge = [](std::vector<Range> &ranges)
+    {
+        std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b)
+                  { return a.start < b.start; });
+        size_t j = 0;
+        for (size_t i = 1; i < ranges.size(); i++)
         {
-            auto insertPos = std::lower_bound(rregs.begin(), rregs.end(), (*inter)->real_reg);
-            rregs.insert(insertPos, (*inter)->real_reg);
-            // regs.push_back((*inter)->real_reg);
-            // sort(regs.begin(), regs.end());
+            if (ranges[i].start <= ranges[j].end)
+                ranges[j].end = std::max(ranges[j].end, ranges[i].end);
+            else
+                ranges[++j] = ranges[i];
         }
+        ranges.resize(ranges.empty() ? 0 : j + 1);
+    };
+    std::vector<std::pair<Interval *, std::vector<Range>>> spilled;
+    for (auto &interval : intervals)
+    {
+        if (interval->parent != interval || interval->remat ||
+            std::none_of(interval->children.begin(), interval->children.end(), [](Interval *child)
+                         { return child->spill; }))
+            continue;
+        std::vector<Range> ranges;
+        for (auto &child : interval->children)
+            ranges.insert(ranges.end(), child->ranges.begin(), child->ranges.end());
+        merge(ranges);
+        spilled.push_back(std::make_pair(interval, ranges));
+    }
+    std::sort(spilled.begin(), spilled.end(), [](const std::pair<Interval *, std::vector<Range>> &a, const std::pair<Interval *, std::vector<Range>> &b)
+              { return a.second[0].start < b.second[0].start || (a.second[0].start == b.second[0].start && a.first->no < b.first->no); });
+    // 栈槽偏移 -> 已占用的range
+    std::vector<std::pair<int, std::vector<Range>>> slots;
+    for (auto &p : spilled)
+    {
+        auto slot = std::find_if(slots.begin(), slots.end(), [&](const std::pair<int, std::vector<Range>> &s)
+                                 { return !overlap(s.second, p.second); });
+        if (slot == slots.end())
+        {
+            slots.push_back(std::make_pair(func->AllocSpace(/*interval->valType->getSize()*/ 4), std::vector<Range>()));
+            slot = slots.end() - 1;
+        }
+        p.first->disp = slot->first;
+        slot->second.insert(slot->second.end(), p.second.begin(), p.second.end());
+        merge(slot->second);
     }
 }
 
-void LinearScan::spillAtInterval(Interval *interval)
+// 并行地完成一组move：先存栈，再做寄存器间的move(环用scratch寄存器打破)，最后从栈中取
+void LinearScan::insertMoves(MachineBlock *block, std::vector<std::pair<Interval *, Interval *>> &moves, std::vector<MachineInstruction *> &insts)
 {
-    if ((*active.rbegin())->end > interval->end)
+    struct RegMove
+    {
+        int src, dst;
+        bool isFloat;
+    };
+    std::vector<RegMove> reg_moves;
+    for (auto &move : moves)
+    {
+        if (!move.first->spill && move.second->spill && !clean.count(move.first))
+            insertSpillStore(block, insts, move.first->real_reg, {move.first->parent->disp, move.first->valType, move.first->parent->remat}, MachineInstruction::NONE);
+        else if (!move.first->spill && !move.second->spill)
+            reg_moves.push_back({move.first->real_reg, move.second->real_reg, move.first->valType->isFloat()});
+    }
+    auto emitMove = [&](int dst, int src, bool isFloat)
+    {
+        auto type = isFloat ? TypeSystem::floatType : TypeSystem::intType;
+        insts.push_back(new MovMInstruction(block, isFloat ? MovMInstruction::VMOV : MovMInstruction::MOV,
+                                            new MachineOperand(MachineOperand::REG, dst, type),
+                                            new MachineOperand(MachineOperand::REG, src, type)));
+    };
+    while (!reg_moves.empty())
     {
-        (*active.rbegin())->spill = true;
-        interval->real_reg = (*active.rbegin())->real_reg;
-        active.pop_back();
-        auto comp = [&](Interval *a, Interval *b) -> bool
+        bool progress = false;
+        for (size_t i = 0; i < reg_moves.size(); i++)
         {
-            return a->end < b->end;
-        };
-        auto insertPos = std::lower_bound(active.begin(), active.end(), interval, comp);
-        active.insert(insertPos, interval);
-        // active.push_back(interval);
-        // sort(active.begin(), active.end(), comp);
+            bool blocked = false;
+            for (size_t j = 0; j < reg_moves.size(); j++)
+                if (j != i && reg_moves[j].src == reg_moves[i].dst && reg_moves[j].isFloat == reg_moves[i].isFloat)
+                    blocked = true;
+            if (!blocked)
+            {
+                emitMove(reg_moves[i].dst, reg_moves[i].src, reg_moves[i].isFloat);
+                reg_moves.erase(reg_moves.begin() + i);
+                progress = true;
+                break;
+            }
+        }
+        if (!progress)
+        {
+            // 剩下的都在环上，把一个目的寄存器的旧值先移到scratch寄存器
+            auto &move = reg_moves[0];
+            int tmp = move.isFloat ? spill_sregs[0] : spill_rregs[0];
+            emitMove(tmp, move.dst, move.isFloat);
+            for (auto &m : reg_moves)
+                if (m.src == move.dst && m.isFloat == move.isFloat)
+                    m.src = tmp;
+        }
     }
-    else
+    for (auto &move : moves)
+        if (move.first->spill && !move.second->spill)
+            insertSpillLoad(block, insts, move.second->real_reg, {move.first->parent->disp, move.first->valType, move.first->parent->remat});
+}
+
+void LinearScan::modifyCode()
+{
+    for (auto &interval : intervals)
     {
-        interval->spill = true;
+        if (interval->parent != interval)
+            continue;
+        for (auto &child : interval->children)
+            if (!child->spill)
+                func->addSavedRegs(child->real_reg, interval->valType->isFloat());
+        for (auto def : interval->defs)
+        {
+            auto child = childAt(interval, def->getParent()->getNo() + 1);
+            if (!child->spill)
+                def->setReg(child->real_reg);
+        }
+        for (auto use : interval->uses)
+        {
+            auto child = childAt(interval, use->getParent()->getNo());
+            if (!child->spill)
+                use->setReg(child->real_reg);
+        }
     }
 }
 
-bool LinearScan::compareStart(Interval *a, Interval *b)
+void LinearScan::genSpillCode()
 {
-    return a->start < b->start;
-}
\ No newline at end of file
+    // 位于栈上分段的操作数
+    std::map<MachineOperand *, StackSlot> spilled;
+    for (auto &interval : intervals)
+    {
+        if (interval->parent != interval || (interval->disp == 0 && !interval->remat))
+            continue;
+        StackSlot slot = {interval->disp, interval->valType, interval->remat};
+        for (auto def : interval->defs)
+            if (childAt(interval, def->getParent()->getNo() + 1)->spill)
+                spilled[def] = slot;
+        for (auto use : interval->uses)
+            if (childAt(interval, use->getParent()->getNo())->spill)
+                spilled[use] = slot;
+    }
+    RegisterAllocator::genSpillCode(spilled);
+}
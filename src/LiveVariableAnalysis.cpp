@@ -6,139 +6,194 @@
 void LiveVariableAnalysis::pass(Unit *unit)
 {
     for (auto func = unit->begin(); func != unit->end(); func++)
-    {
-        computeUsePos(*func);
-        computeDefUse(*func);
-        computeLiveInOut(*func);
-    }
+        pass(*func);
 }
 
 void LiveVariableAnalysis::pass(Function *func)
 {
     computeUsePos(func);
-    computeDefUse(func);
     computeLiveInOut(func);
 }
 
-void LiveVariableAnalysis::computeUsePos(Function *func)
+int LiveVariableAnalysis::getUseNo(Operand *use) const
 {
-    for (auto block = func->begin(); block != func->end(); block++)
-        for (auto inst = (*block)->begin(); inst != (*block)->end(); inst = inst->getNext())
-        {
-            auto uses = inst->getUses();
-            for (auto &use : uses)
-                all_uses[*use].insert(use);
-        }
+    auto it = use_no.find(use);
+    return it == use_no.end() ? -1 : it->second;
+}
+
+std::pair<int, int> LiveVariableAnalysis::getUseRange(Operand *value) const
+{
+    auto it = use_range.find(*value);
+    return it == use_range.end() ? std::make_pair(0, 0) : it->second;
 }
 
-void LiveVariableAnalysis::computeDefUse(Function *func)
+// 给use编号：先按值分组，再按组依次编号，保证同一个值的use编号连续
+void LiveVariableAnalysis::computeUsePos(Function *func)
 {
+    use_ops.clear();
+    use_no.clear();
+    use_range.clear();
+    std::map<Operand, std::vector<Operand *>> groups;
     for (auto block = func->begin(); block != func->end(); block++)
         for (auto inst = (*block)->begin(); inst != (*block)->end(); inst = inst->getNext())
+            for (auto &use : inst->getUses())
+            {
+                if (use->getEntry()->isConstant() || use_no.count(use))
+                    continue;
+                use_no[use] = -1;
+                groups[*use].push_back(use);
+            }
+    for (auto &kv : groups)
+    {
+        int begin = use_ops.size();
+        for (auto use : kv.second)
         {
-            auto uses = inst->getUses();
-            set_difference(uses.begin(), uses.end(), def[(*block)].begin(), def[(*block)].end(),
-                           inserter(use[(*block)], use[(*block)].end()));
-            auto defs = inst->getDef();
-            for (auto &d : defs)
-                def[(*block)].insert(all_uses[*d].begin(), all_uses[*d].end());
+            use_no[use] = use_ops.size();
+            use_ops.push_back(use);
         }
+        use_range[kv.first] = std::make_pair(begin, (int)use_ops.size());
+    }
 }
 
 void LiveVariableAnalysis::computeLiveInOut(Function *func)
 {
-    for (auto block = func->begin(); block != func->end(); block++)
-        (*block)->getLiveIn().clear();
-    bool change;
-    change = true;
-    while (change)
+    auto &blocks = func->getBlockList();
+    int n = blocks.size();
+    block_no.clear();
+    for (int i = 0; i < n; i++)
+        block_no[blocks[i]] = i;
+    DataflowSolver<BACKWARD, MEET_UNION> solver(n, use_ops.size());
+    for (int i = 0; i < n; i++)
     {
-        change = false;
-        for (auto block = func->begin(); block != func->end(); block++)
+        for (auto succ = blocks[i]->succ_begin(); succ != blocks[i]->succ_end(); succ++)
+            solver.addEdge(i, block_no[*succ]);
+        // gen: 块内未被先定值的use；kill: 块内定值的值的所有use
+        auto &gen = solver.gen[i];
+        auto &kill = solver.kill[i];
+        for (auto inst = blocks[i]->begin(); inst != blocks[i]->end(); inst = inst->getNext())
         {
-            (*block)->getLiveOut().clear();
-            auto old = (*block)->getLiveIn();
-            for (auto succ = (*block)->succ_begin(); succ != (*block)->succ_end(); succ++)
-                (*block)->getLiveOut().insert((*succ)->getLiveIn().begin(), (*succ)->getLiveIn().end());
-            (*block)->getLiveIn() = use[(*block)];
-            set_difference((*block)->getLiveOut().begin(), (*block)->getLiveOut().end(),
-                           def[(*block)].begin(), def[(*block)].end(), inserter((*block)->getLiveIn(), (*block)->getLiveIn().end()));
-            if (old != (*block)->getLiveIn())
-                change = true;
+            for (auto &use : inst->getUses())
+            {
+                int no = getUseNo(use);
+                if (no >= 0 && !kill.test(no))
+                    gen.set(no);
+            }
+            for (auto &def : inst->getDef())
+            {
+                auto range = getUseRange(def);
+                kill.setRange(range.first, range.second);
+            }
         }
     }
+    solver.solve(block_no[func->getEntry()]);
+    live_in = std::move(solver.in);
+    live_out = std::move(solver.out);
+    for (int i = 0; i < n; i++)
+    {
+        auto &in = blocks[i]->getLiveIn();
+        auto &out = blocks[i]->getLiveOut();
+        in.clear();
+        out.clear();
+        live_in[i].forEach([&](int no)
+                           { in.insert(use_ops[no]); });
+        live_out[i].forEach([&](int no)
+                            { out.insert(use_ops[no]); });
+    }
 }
 
 void MLiveVariableAnalysis::pass(MachineUnit *unit)
 {
     for (auto &func : unit->getFuncs())
-    {
-        computeUsePos(func);
-        computeDefUse(func);
-        computeLiveInOut(func);
-    }
+        pass(func);
 }
 
 void MLiveVariableAnalysis::pass(MachineFunction *func)
 {
     computeUsePos(func);
-    computeDefUse(func);
     computeLiveInOut(func);
 }
 
+int MLiveVariableAnalysis::getUseNo(MachineOperand *use) const
+{
+    auto it = use_no.find(use);
+    return it == use_no.end() ? -1 : it->second;
+}
+
+std::pair<int, int> MLiveVariableAnalysis::getUseRange(MachineOperand *value) const
+{
+    auto it = use_range.find(*value);
+    return it == use_range.end() ? std::make_pair(0, 0) : it->second;
+}
+
+// 只关心寄存器(虚拟寄存器和物理寄存器)，立即数和label不参与活跃变量分析
 void MLiveVariableAnalysis::computeUsePos(MachineFunction *func)
 {
+    use_ops.clear();
+    use_no.clear();
+    use_range.clear();
+    std::map<MachineOperand, std::vector<MachineOperand *>> groups;
     for (auto &block : func->getBlocks())
-    {
         for (auto &inst : block->getInsts())
-        {
-            auto uses = inst->getUse();
-            for (auto &use : uses)
+            for (auto &use : inst->getUse())
             {
-                // assert(!use->isLabel());
-                all_uses[*use].insert(use);
+                if (!(use->isVReg() || use->isReg()) || use_no.count(use))
+                    continue;
+                use_no[use] = -1;
+                groups[*use].push_back(use);
             }
-        }
-    }
-}
-
-void MLiveVariableAnalysis::computeDefUse(MachineFunction *func)
-{
-    for (auto &block : func->getBlocks())
+    for (auto &kv : groups)
     {
-        for (auto inst = block->getInsts().begin(); inst != block->getInsts().end(); inst++)
+        int begin = use_ops.size();
+        for (auto use : kv.second)
         {
-            auto user = (*inst)->getUse();
-            std::set<MachineOperand *> temp(user.begin(), user.end());
-            set_difference(temp.begin(), temp.end(),
-                           def[block].begin(), def[block].end(), inserter(use[block], use[block].end()));
-            auto defs = (*inst)->getDef();
-            for (auto &d : defs)
-                def[block].insert(all_uses[*d].begin(), all_uses[*d].end());
+            use_no[use] = use_ops.size();
+            use_ops.push_back(use);
         }
+        use_range[kv.first] = std::make_pair(begin, (int)use_ops.size());
     }
 }
 
 void MLiveVariableAnalysis::computeLiveInOut(MachineFunction *func)
 {
-    for (auto &block : func->getBlocks())
-        block->getLiveIn().clear();
-    bool change;
-    change = true;
-    while (change)
+    auto &blocks = func->getBlocks();
+    int n = blocks.size();
+    block_no.clear();
+    for (int i = 0; i < n; i++)
+        block_no[blocks[i]] = i;
+    DataflowSolver<BACKWARD, MEET_UNION> solver(n, use_ops.size());
+    for (int i = 0; i < n; i++)
     {
-        change = false;
-        for (auto &block : func->getBlocks())
+        for (auto &succ : blocks[i]->getSuccs())
+            solver.addEdge(i, block_no[succ]);
+        auto &gen = solver.gen[i];
+        auto &kill = solver.kill[i];
+        for (auto &inst : blocks[i]->getInsts())
         {
-            block->getLiveOut().clear();
-            auto old = block->getLiveIn();
-            for (auto &succ : block->getSuccs())
-                block->getLiveOut().insert(succ->getLiveIn().begin(), succ->getLiveIn().end());
-            block->getLiveIn() = use[block];
-            set_difference(block->getLiveOut().begin(), block->getLiveOut().end(),
-                           def[block].begin(), def[block].end(), inserter(block->getLiveIn(), block->getLiveIn().end()));
-            if (old != block->getLiveIn())
-                change = true;
+            for (auto &use : inst->getUse())
+            {
+                int no = getUseNo(use);
+                if (no >= 0 && !kill.test(no))
+                    gen.set(no);
+            }
+            for (auto &def : inst->getDef())
+            {
+                auto range = getUseRange(def);
+                kill.setRange(range.first, range.second);
+            }
         }
     }
+    solver.solve(0);
+    live_in = std::move(solver.in);
+    live_out = std::move(solver.out);
+    for (int i = 0; i < n; i++)
+    {
+        auto &in = blocks[i]->getLiveIn();
+        auto &out = blocks[i]->getLiveOut();
+        in.clear();
+        out.clear();
+        live_in[i].forEach([&](int no)
+                           { in.insert(use_ops[no]); });
+        live_out[i].forEach([&](int no)
+                            { out.insert(use_ops[no]); });
+    }
 }
@@ -0,0 +1,185 @@
+#include "LoopInfo.h"
+#include "DominatorTree.h"
+#include "Function.h"
+#include "Type.h"
+
+bool Loop::contains(const Loop *loop) const
+{
+    for (; loop != nullptr; loop = loop->parent)
+        if (loop == this)
+            return true;
+    return false;
+}
+
+void Loop::addBlock(BasicBlock *bb)
+{
+    for (auto loop = this; loop != nullptr; loop = loop->parent)
+        loop->blocks.insert(bb);
+}
+
+BasicBlock *Loop::getPreheader() const
+{
+    BasicBlock *preheader = nullptr;
+    for (auto pred = header->pred_begin(); pred != header->pred_end(); pred++)
+    {
+        if (contains(*pred))
+            continue;
+        if (preheader != nullptr)
+            return nullptr;
+        preheader = *pred;
+    }
+    if (preheader == nullptr || preheader->getNumOfSucc() != 1)
+        return nullptr;
+    return preheader;
+}
+
+std::vector<BasicBlock *> Loop::getExitingBlocks() const
+{
+    std::vector<BasicBlock *> exiting;
+    for (auto bb : blocks)
+        for (auto succ = bb->succ_begin(); succ != bb->succ_end(); succ++)
+            if (!contains(*succ))
+            {
+                exiting.push_back(bb);
+                break;
+            }
+    return exiting;
+}
+
+std::vector<BasicBlock *> Loop::getExitBlocks() const
+{
+    std::set<BasicBlock *> exits;
+    for (auto bb : blocks)
+        for (auto succ = bb->succ_begin(); succ != bb->succ_end(); succ++)
+            if (!contains(*succ))
+                exits.insert(*succ);
+    return std::vector<BasicBlock *>(exits.begin(), exits.end());
+}
+
+static bool isIntConstant(Operand *op)
+{
+    return op->getEntry()->isConstant() && op->getType()->isInt();
+}
+
+std::vector<InductionVar> Loop::getInductionVars() const
+{
+    std::vector<InductionVar> ivs;
+    auto preheader = getPreheader();
+    if (preheader == nullptr || latches.size() != 1)
+        return ivs;
+    auto latch = latches[0];
+    for (auto inst = header->begin(); inst != header->end() && inst->isPHI(); inst = inst->getNext())
+    {
+        auto phi = dynamic_cast<PhiInstruction *>(inst);
+        auto dst = phi->getDef()[0];
+        auto &srcs = phi->getSrcs();
+        if (!dst->getType()->isInt() || srcs.size() != 2 || !srcs.count(preheader) || !srcs.count(latch))
+            continue;
+        auto inc = srcs[latch]->getDef();
+        if (inc == nullptr || !inc->isBinary())
+            continue;
+        auto lhs = inc->getUses()[0], rhs = inc->getUses()[1];
+        if (inc->getOpcode() == BinaryInstruction::ADD && isIntConstant(lhs))
+            std::swap(lhs, rhs);
+        if (lhs->getEntry() != dst->getEntry() || !isIntConstant(rhs))
+            continue;
+        int step = rhs->getEntry()->getValue();
+        if (inc->getOpcode() == BinaryInstruction::SUB)
+            step = -step;
+        else if (inc->getOpcode() != BinaryInstruction::ADD)
+            continue;
+        ivs.push_back({phi, inc, srcs[preheader], step});
+    }
+    return ivs;
+}
+
+LoopInfo::LoopInfo(Function *func, DominatorTree *DT)
+{
+    auto preorder = DT->getPreOrder();
+    for (auto it = preorder.rbegin(); it != preorder.rend(); it++)
+    {
+        auto header = *it;
+        std::vector<BasicBlock *> latches;
+        for (auto pred = header->pred_begin(); pred != header->pred_end(); pred++)
+            if (DT->isReachable(*pred) && DT->dominates(header, *pred))
+                latches.push_back(*pred);
+        if (latches.empty())
+            continue;
+        auto loop = new Loop(header);
+        loop->latches = latches;
+        bb_loop[header] = loop;
+        std::vector<BasicBlock *> worklist(latches.begin(), latches.end());
+        while (!worklist.empty())
+        {
+            auto bb = worklist.back();
+            worklist.pop_back();
+            auto it = bb_loop.find(bb);
+            if (it == bb_loop.end())
+            {
+                bb_loop[bb] = loop;
+                for (auto pred = bb->pred_begin(); pred != bb->pred_end(); pred++)
+                    if (DT->isReachable(*pred))
+                        worklist.push_back(*pred);
+                continue;
+            }
+            // 已属于某个内层循环，挂到本循环下，从内层循环的header继续
+            auto sub = it->second;
+            while (sub->parent != nullptr)
+                sub = sub->parent;
+            if (sub == loop)
+                continue;
+            sub->parent = loop;
+            loop->sub_loops.push_back(sub);
+            for (auto pred = sub->header->pred_begin(); pred != sub->header->pred_end(); pred++)
+            {
+                auto pred_loop = bb_loop.find(*pred);
+                if (DT->isReachable(*pred) && (pred_loop == bb_loop.end() || !sub->contains(pred_loop->second)))
+                    worklist.push_back(*pred);
+            }
+        }
+        loops.push_back(loop);
+    }
+    for (auto &kv : bb_loop)
+        kv.second->addBlock(kv.first);
+    // loops中内层在前，逆序遍历时父循环的深度已经确定
+    for (auto it = loops.rbegin(); it != loops.rend(); it++)
+    {
+        auto loop = *it;
+        if (loop->parent == nullptr)
+            top_loops.push_back(loop);
+        else
+            loop->depth = loop->parent->depth + 1;
+    }
+}
+
+LoopInfo::~LoopInfo()
+{
+    for (auto loop : loops)
+        delete loop;
+}
+
+Loop *LoopInfo::getLoopFor(BasicBlock *bb) const
+{
+    auto it = bb_loop.find(bb);
+    return it == bb_loop.end() ? nullptr : it->second;
+}
+
+int LoopInfo::getLoopDepth(BasicBlock *bb) const
+{
+    auto loop = getLoopFor(bb);
+    return loop == nullptr ? 0 : loop->getDepth();
+}
+
+bool LoopInfo::isLoopHeader(BasicBlock *bb) const
+{
+    auto loop = getLoopFor(bb);
+    return loop != nullptr && loop->getHeader() == bb;
+}
+
+void LoopInfo::addBlock(BasicBlock *bb, Loop *loop)
+{
+    if (loop == nullptr)
+        return;
+    bb_loop[bb] = loop;
+    loop->addBlock(bb);
+}
@@ -0,0 +1,89 @@
+#include "LoopSimplify.h"
+#include "Type.h"
+
+void LoopSimplify::pass()
+{
+    for (auto f = unit->begin(); f != unit->end(); f++)
+    {
+        func = *f;
+        LI = pm->getLoopInfo(func);
+        for (auto loop : LI->getLoops())
+        {
+            insertPreheader(loop);
+            formDedicatedExits(loop);
+        }
+    }
+}
+
+// 新建块，preds改为跳到新块，新块跳到bb
+BasicBlock *LoopSimplify::splitPredecessors(BasicBlock *bb, const std::vector<BasicBlock *> &preds)
+{
+    auto newBlock = new BasicBlock(func);
+    func->moveBlockBefore(newBlock, bb);
+    for (auto phi = bb->begin(); phi != bb->end() && phi->isPHI(); phi = phi->getNext())
+    {
+        auto PHI = dynamic_cast<PhiInstruction *>(phi);
+        auto &srcs = PHI->getSrcs();
+        Operand *same = srcs[preds[0]];
+        for (auto pred : preds)
+            if (srcs[pred]->getEntry() != same->getEntry())
+                same = nullptr;
+        Operand *val = same;
+        if (same == nullptr)
+        {
+            val = new Operand(new TemporarySymbolEntry(PHI->getDef()[0]->getType(), SymbolTable::getLabel()));
+            auto newPHI = new PhiInstruction(val);
+            newBlock->insertFront(newPHI);
+            newPHI->updateDst(val);
+            for (auto pred : preds)
+                newPHI->addEdge(pred, srcs[pred]);
+        }
+        for (auto pred : preds)
+            PHI->removeEdge(pred);
+        PHI->addEdge(newBlock, val);
+    }
+    for (auto pred : preds)
+        pred->replaceSucc(bb, newBlock);
+    new UncondBrInstruction(bb, newBlock);
+    newBlock->addSucc(bb);
+    bb->addPred(newBlock);
+    return newBlock;
+}
+
+void LoopSimplify::insertPreheader(Loop *loop)
+{
+    auto header = loop->getHeader();
+    if (loop->getPreheader() != nullptr)
+        return;
+    std::vector<BasicBlock *> outside;
+    for (auto pred = header->pred_begin(); pred != header->pred_end(); pred++)
+        if (!loop->contains(*pred))
+            outside.push_back(*pred);
+    // 入口块作为header时没有循环外前驱
+    if (outside.empty())
+        return;
+    auto preheader = splitPredecessors(header, outside);
+    LI->addBlock(preheader, loop->getParent());
+}
+
+void LoopSimplify::formDedicatedExits(Loop *loop)
+{
+    for (auto exit : loop->getExitBlocks())
+    {
+        std::vector<BasicBlock *> inside;
+        bool dedicated = true;
+        for (auto pred = exit->pred_begin(); pred != exit->pred_end(); pred++)
+            if (loop->contains(*pred))
+                inside.push_back(*pred);
+            else
+                dedicated = false;
+        if (dedicated)
+            continue;
+        auto newExit = splitPredecessors(exit, inside);
+        // 新出口属于同时包含本循环和原出口块的最内层循环
+        auto parent = loop->getParent();
+        while (parent != nullptr && !parent->contains(exit))
+            parent = parent->getParent();
+        LI->addBlock(newExit, parent);
+    }
+}
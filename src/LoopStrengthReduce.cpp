@@ -0,0 +1,198 @@
+#include "LoopStrengthReduce.h"
+#include "Type.h"
+
+void LoopStrengthReduce::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+    {
+        DT = pm->getDomTree(*func);
+        AA = new AliasAnalysis(*func);
+        for (auto loop : pm->getLoopInfo(*func)->getLoops())
+            reduce(loop);
+        delete AA;
+    }
+}
+
+static void removeInst(Instruction *inst)
+{
+    for (auto use : inst->getUses())
+        use->removeUse(inst);
+    inst->getParent()->remove(inst);
+}
+
+static Operand *newConstant(int value)
+{
+    return new Operand(new ConstantSymbolEntry(TypeSystem::constIntType, value));
+}
+
+static bool isConstant(Operand *op)
+{
+    return op->getEntry()->isConstant() && op->getType()->isInt();
+}
+
+bool LoopStrengthReduce::isInvariant(Loop *loop, Operand *op)
+{
+    auto def = AA->getDef(op);
+    return def == nullptr || !loop->contains(def->getParent());
+}
+
+// 下标是归纳变量i或i±常量时返回i，offset为常量部分
+InductionVar *LoopStrengthReduce::matchIndex(Operand *idx, int &offset)
+{
+    auto def = idx->getDef();
+    for (auto &iv : ivs)
+    {
+        auto iv_se = iv.phi->getDef()[0]->getEntry();
+        offset = 0;
+        if (idx->getEntry() == iv_se)
+            return &iv;
+        if (def == nullptr || !def->isBinary())
+            continue;
+        auto lhs = def->getUses()[0], rhs = def->getUses()[1];
+        if (def->getOpcode() == BinaryInstruction::ADD && isConstant(lhs))
+            std::swap(lhs, rhs);
+        if (lhs->getEntry() != iv_se || !isConstant(rhs))
+            continue;
+        offset = rhs->getEntry()->getValue();
+        if (def->getOpcode() == BinaryInstruction::SUB)
+            offset = -offset;
+        else if (def->getOpcode() != BinaryInstruction::ADD)
+            continue;
+        return &iv;
+    }
+    return nullptr;
+}
+
+std::string LoopStrengthReduce::operandKey(Operand *op)
+{
+    auto se = op->getEntry();
+    if (se->isConstant())
+        return "i" + std::to_string((int)se->getValue());
+    if (se->isTemporary())
+        return "t" + std::to_string(dynamic_cast<TemporarySymbolEntry *>(se)->getLabel());
+    return "v" + std::to_string((long long)se);
+}
+
+void LoopStrengthReduce::reduce(Loop *loop)
+{
+    auto preheader = loop->getPreheader();
+    if (preheader == nullptr || loop->getLatches().size() != 1)
+        return;
+    auto header = loop->getHeader();
+    auto latch = loop->getLatches()[0];
+    ivs = loop->getInductionVars();
+    if (ivs.empty())
+        return;
+    std::vector<Instruction *> geps;
+    for (auto bb : DT->getRPO())
+        if (loop->contains(bb))
+            for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+                if (inst->isGep())
+                    geps.push_back(inst);
+    std::map<std::string, std::pair<Operand *, int>> reduced; // -> (指针PHI, 其下标的常量部分)
+    std::vector<Instruction *> dead_idx;
+    for (auto gep : geps)
+    {
+        auto &uses = gep->getUses();
+        auto dst = gep->getDef()[0];
+        if (!isInvariant(loop, uses[0]))
+            continue;
+        int pos = -1, offset = 0;
+        InductionVar *iv = nullptr;
+        for (size_t i = 1; i < uses.size(); i++)
+        {
+            if (isInvariant(loop, uses[i]))
+                continue;
+            if (pos != -1)
+            {
+                iv = nullptr;
+                break;
+            }
+            pos = i;
+            iv = matchIndex(uses[i], offset);
+            if (iv == nullptr)
+                break;
+        }
+        if (iv == nullptr)
+            continue;
+        // 第pos个下标的跨度，与GepInstruction::genMachineCode中的计算一致
+        auto valType = dynamic_cast<PointerType *>(uses[0]->getType())->getValType();
+        int stride = valType->getSize();
+        auto dims = valType->isARRAY() ? dynamic_cast<ArrayType *>(valType)->fetch() : std::vector<int>{1};
+        for (int i = 1; i < pos; i++)
+            stride /= dims[i - 1];
+        int elem_size = dynamic_cast<PointerType *>(dst->getType())->getValType()->getSize();
+        if (elem_size == 0 || iv->step * stride % elem_size != 0)
+            continue;
+        std::string key = operandKey(uses[0]);
+        for (size_t i = 1; i < uses.size(); i++)
+            key += "/" + ((int)i == pos ? "iv" + operandKey(iv->phi->getDef()[0]) : operandKey(uses[i]));
+        key += ":" + dst->getType()->toStr();
+        auto it = reduced.find(key);
+        if (it == reduced.end())
+        {
+            // preheader中按初值计算起始地址
+            Operand *start = iv->init;
+            if (offset != 0 && isConstant(start))
+                start = newConstant(start->getEntry()->getValue() + offset);
+            else if (offset != 0)
+            {
+                start = new Operand(new TemporarySymbolEntry(TypeSystem::intType, SymbolTable::getLabel()));
+                preheader->insertBeforeTerminator(new BinaryInstruction(BinaryInstruction::ADD, start, iv->init, newConstant(offset)));
+            }
+            std::vector<Operand *> idx_list(uses.begin() + 1, uses.end());
+            idx_list[pos - 1] = start;
+            auto init_ptr = new Operand(new TemporarySymbolEntry(dst->getType(), SymbolTable::getLabel()));
+            preheader->insertBeforeTerminator(new GepInstruction(init_ptr, uses[0], idx_list));
+            // header中的指针PHI，latch中前进一步
+            auto ptr = new Operand(new TemporarySymbolEntry(dst->getType(), SymbolTable::getLabel()));
+            auto phi = new PhiInstruction(ptr);
+            header->insertFront(phi);
+            phi->updateDst(ptr);
+            auto next_ptr = new Operand(new TemporarySymbolEntry(dst->getType(), SymbolTable::getLabel()));
+            latch->insertBeforeTerminator(new GepInstruction(next_ptr, ptr, {newConstant(iv->step * stride / elem_size)}));
+            phi->addEdge(preheader, init_ptr);
+            phi->addEdge(latch, next_ptr);
+            it = reduced.insert(std::make_pair(key, std::make_pair(ptr, offset))).first;
+        }
+        // 常量部分不同的访问共用同一个指针，在原位置加上偏移
+        auto ptr = it->second.first;
+        int diff = (offset - it->second.second) * stride;
+        if (diff % elem_size != 0)
+            continue;
+        if (diff != 0)
+        {
+            auto new_ptr = new Operand(new TemporarySymbolEntry(dst->getType(), SymbolTable::getLabel()));
+            gep->getParent()->insertBefore(new GepInstruction(new_ptr, ptr, {newConstant(diff / elem_size)}), gep);
+            ptr = new_ptr;
+        }
+        auto idx_def = uses[pos]->getDef();
+        if (idx_def != nullptr && idx_def != iv->phi && idx_def != iv->inc)
+            dead_idx.push_back(idx_def);
+        AA->replaceGep(gep, ptr);
+        gep->replaceAllUsesWith(ptr);
+        removeInst(gep);
+    }
+    for (auto inst : dead_idx)
+        if (inst->getParent() != nullptr && inst->getDef()[0]->getUses().empty())
+        {
+            removeInst(inst);
+            inst->setParent(nullptr);
+        }
+    // 只剩自身更新的归纳变量
+    for (auto &iv : ivs)
+    {
+        auto phi_users = iv.phi->getDef()[0]->getUses();
+        auto inc_users = iv.inc->getDef()[0]->getUses();
+        bool dead = true;
+        for (auto user : phi_users)
+            dead = dead && user == iv.inc;
+        for (auto user : inc_users)
+            dead = dead && user == iv.phi;
+        if (dead)
+        {
+            removeInst(iv.phi);
+            removeInst(iv.inc);
+        }
+    }
+}
@@ -0,0 +1,510 @@
+#include "LoopUnroll.h"
+#include "Type.h"
+#include <set>
+
+const int MAX_FULL_UNROLL_SIZE = 256; // 完全展开后的指令数
+const int MAX_FULL_UNROLL_TRIP = 128;
+const int FUNC_UNROLL_BUDGET = 2000; // 每个函数新增的指令数
+
+void LoopUnroll::pass()
+{
+    for (auto f = unit->begin(); f != unit->end(); f++)
+    {
+        func = *f;
+        budget = FUNC_UNROLL_BUDGET;
+        // 只展开最内层循环，互不相交，先分析再统一变换
+        std::vector<UnrollInfo> infos;
+        for (auto loop : pm->getLoopInfo(func)->getLoops())
+        {
+            UnrollInfo info;
+            if (analyze(loop, info))
+                infos.push_back(info);
+        }
+        for (auto &info : infos)
+        {
+            int trip_count = getTripCount(info);
+            if (trip_count > 0 && trip_count * info.size <= MAX_FULL_UNROLL_SIZE && trip_count * info.size <= budget)
+            {
+                budget -= trip_count * info.size;
+                fullUnroll(info, trip_count);
+                continue;
+            }
+            bool increasing = (info.pred == CmpInstruction::L || info.pred == CmpInstruction::LE) && info.iv.step > 0;
+            bool decreasing = (info.pred == CmpInstruction::G || info.pred == CmpInstruction::GE) && info.iv.step < 0;
+            if (!increasing && !decreasing)
+                continue;
+            int factor = info.size <= 20 ? 4 : info.size <= 60 ? 2 : 1;
+            // 常量边界减去(N-1)*step溢出时展开后的循环体一次也不会执行
+            auto bound = info.bound->getEntry();
+            long long limit = bound->isConstant() ? (long long)(int)bound->getValue() - (long long)(factor - 1) * info.iv.step : 0;
+            if (limit < INT32_MIN || limit > INT32_MAX)
+                continue;
+            if (factor > 1 && factor * info.size <= budget)
+            {
+                budget -= factor * info.size;
+                runtimeUnroll(info, factor);
+            }
+        }
+    }
+}
+
+static void removeInst(Instruction *inst)
+{
+    for (auto use : inst->getUses())
+        use->removeUse(inst);
+    inst->getParent()->remove(inst);
+}
+
+static Operand *newConstant(int value)
+{
+    return new Operand(new ConstantSymbolEntry(TypeSystem::constIntType, value));
+}
+
+static Operand *newTemporary(Type *type)
+{
+    return new Operand(new TemporarySymbolEntry(type, SymbolTable::getLabel()));
+}
+
+static int getLabel(Operand *op)
+{
+    return dynamic_cast<TemporarySymbolEntry *>(op->getEntry())->getLabel();
+}
+
+// 按终结指令建立前驱/后继
+static void linkSuccs(BasicBlock *bb)
+{
+    auto term = bb->rbegin();
+    std::vector<BasicBlock *> targets;
+    if (term->isCond())
+    {
+        targets.push_back(dynamic_cast<CondBrInstruction *>(term)->getTrueBranch());
+        targets.push_back(dynamic_cast<CondBrInstruction *>(term)->getFalseBranch());
+    }
+    else if (term->isUncond())
+        targets.push_back(dynamic_cast<UncondBrInstruction *>(term)->getBranch());
+    for (auto succ : targets)
+    {
+        bb->addSucc(succ);
+        succ->addPred(bb);
+    }
+}
+
+// 终结指令改为跳到to的无条件跳转
+static void setUncond(BasicBlock *bb, BasicBlock *to)
+{
+    std::vector<BasicBlock *> succs(bb->succ_begin(), bb->succ_end());
+    for (auto succ : succs)
+    {
+        bb->removeSucc(succ);
+        succ->removePred(bb);
+    }
+    removeInst(bb->rbegin());
+    new UncondBrInstruction(to, bb);
+    linkSuccs(bb);
+}
+
+static bool evalCmp(unsigned pred, long long a, long long b)
+{
+    switch (pred)
+    {
+    case CmpInstruction::E:
+        return a == b;
+    case CmpInstruction::NE:
+        return a != b;
+    case CmpInstruction::L:
+        return a < b;
+    case CmpInstruction::LE:
+        return a <= b;
+    case CmpInstruction::G:
+        return a > b;
+    case CmpInstruction::GE:
+        return a >= b;
+    }
+    return false;
+}
+
+bool LoopUnroll::analyze(Loop *loop, UnrollInfo &info)
+{
+    if (!loop->getSubLoops().empty() || loop->getLatches().size() != 1)
+        return false;
+    info.preheader = loop->getPreheader();
+    info.header = loop->getHeader();
+    info.latch = loop->getLatches()[0];
+    if (info.preheader == nullptr || info.latch == info.header)
+        return false;
+    auto exiting = loop->getExitingBlocks();
+    if (exiting.size() != 1 || exiting[0] != info.header || !info.header->rbegin()->isCond())
+        return false;
+    auto branch = dynamic_cast<CondBrInstruction *>(info.header->rbegin());
+    info.body = branch->getTrueBranch();
+    info.exit = branch->getFalseBranch();
+    if (!loop->contains(info.body) || loop->contains(info.exit))
+        return false;
+    auto cmp = branch->getUses()[0]->getDef();
+    if (cmp == nullptr || !cmp->isCmp() || cmp->getParent() != info.header)
+        return false;
+    // 比较的一边是归纳变量，另一边是循环不变量
+    auto lhs = cmp->getUses()[0], rhs = cmp->getUses()[1];
+    bool found = false;
+    info.ivs = loop->getInductionVars();
+    for (auto &iv : info.ivs)
+    {
+        auto iv_se = iv.phi->getDef()[0]->getEntry();
+        info.iv = iv;
+        info.pred = cmp->getOpcode();
+        if (lhs->getEntry() == iv_se)
+            info.bound = rhs;
+        else if (rhs->getEntry() == iv_se)
+        {
+            info.bound = lhs;
+            const unsigned swapped[] = {CmpInstruction::E, CmpInstruction::NE, CmpInstruction::G,
+                                        CmpInstruction::GE, CmpInstruction::L, CmpInstruction::LE};
+            info.pred = swapped[info.pred];
+        }
+        else
+            continue;
+        found = true;
+        break;
+    }
+    if (!found || !info.bound->getType()->isInt() || info.iv.step == 0)
+        return false;
+    auto bound_def = info.bound->getDef();
+    if (bound_def != nullptr && loop->contains(bound_def->getParent()))
+        return false;
+    info.blocks.clear();
+    info.size = 0;
+    for (auto bb : pm->getDomTree(func)->getRPO())
+        if (loop->contains(bb))
+        {
+            info.blocks.push_back(bb);
+            for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+                info.size += !inst->isPHI();
+        }
+    return true;
+}
+
+// 初值、边界都是常量时模拟得到迭代次数，否则返回-1
+int LoopUnroll::getTripCount(UnrollInfo &info)
+{
+    auto init = info.iv.init->getEntry(), bound = info.bound->getEntry();
+    if (!init->isConstant() || !bound->isConstant())
+        return -1;
+    long long i = (int)init->getValue(), n = (int)bound->getValue();
+    int count = 0;
+    while (evalCmp(info.pred, i, n))
+    {
+        if (++count > MAX_FULL_UNROLL_TRIP)
+            return -1;
+        i += info.iv.step;
+        if (i < INT32_MIN || i > INT32_MAX)
+            return -1;
+    }
+    return count;
+}
+
+void LoopUnroll::mapValue(Operand *from, Operand *to)
+{
+    vmap[from] = to;
+    if (from->getEntry()->isTemporary())
+        label_map[getLabel(from)] = to;
+}
+
+// 前端对GEP的结果换类型时新建同label、没有def的操作数，按label找到对应的值后同样新建别名
+Operand *LoopUnroll::remap(Operand *op)
+{
+    auto it = vmap.find(op);
+    if (it != vmap.end())
+        return it->second;
+    if (!op->getEntry()->isTemporary() || op->getDef() != nullptr)
+        return op;
+    auto label_it = label_map.find(getLabel(op));
+    if (label_it == label_map.end())
+        return op;
+    auto value = label_it->second;
+    if (!value->getEntry()->isTemporary())
+        return value;
+    return new Operand(new TemporarySymbolEntry(op->getType(), getLabel(value)));
+}
+
+// 复制一份循环体放在pos之前，header的PHI已在vmap中映射为这一份的值；回边仍指向原header，由调用者重定向
+void LoopUnroll::cloneIteration(UnrollInfo &info, bool headerOnly, BasicBlock *pos)
+{
+    std::vector<BasicBlock *> blocks = info.blocks;
+    if (headerOnly)
+        blocks = {info.header};
+    bmap.clear();
+    for (auto bb : blocks)
+    {
+        auto new_bb = new BasicBlock(func);
+        func->moveBlockBefore(new_bb, pos);
+        bmap[bb] = new_bb;
+        new_blocks.push_back(new_bb);
+    }
+    auto mapBlock = [&](BasicBlock *bb)
+    { return bb != info.header && bmap.count(bb) ? bmap[bb] : bb; };
+    // 按RPO复制，除header的PHI外定值都先于使用
+    for (auto bb : blocks)
+    {
+        auto new_bb = bmap[bb];
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+        {
+            if (bb == info.header && inst->isPHI())
+                continue;
+            auto clone = inst->copy();
+            auto uses = clone->getUses();
+            for (auto use : uses)
+            {
+                auto rep = remap(use);
+                if (rep != use)
+                    clone->replaceUse(use, rep);
+            }
+            if (clone->isPHI())
+            {
+                auto &srcs = dynamic_cast<PhiInstruction *>(clone)->getSrcs();
+                std::map<BasicBlock *, Operand *> new_srcs;
+                for (auto &src : srcs)
+                    new_srcs[mapBlock(src.first)] = src.second;
+                srcs = new_srcs;
+            }
+            else if (clone->isCond())
+            {
+                auto branch = dynamic_cast<CondBrInstruction *>(clone);
+                branch->setTrueBranch(mapBlock(branch->getTrueBranch()));
+                branch->setFalseBranch(mapBlock(branch->getFalseBranch()));
+            }
+            else if (clone->isUncond())
+            {
+                auto branch = dynamic_cast<UncondBrInstruction *>(clone);
+                branch->setBranch(mapBlock(branch->getBranch()));
+            }
+            if (!inst->getDef().empty())
+                mapValue(inst->getDef()[0], clone->getDef()[0]);
+            new_bb->insertBack(clone);
+        }
+    }
+    for (auto bb : blocks)
+        linkSuccs(bmap[bb]);
+}
+
+// 基本归纳变量的值：base + offset，base为常量时直接折叠，否则把加法放入pending，由调用者插入
+Operand *LoopUnroll::offsetValue(Operand *base, int offset)
+{
+    if (base->getEntry()->isConstant())
+        return newConstant((int)base->getEntry()->getValue() + offset);
+    auto value = newTemporary(TypeSystem::intType);
+    pending.push_back(new BinaryInstruction(BinaryInstruction::ADD, value, base, newConstant(offset)));
+    return value;
+}
+
+// 第j份中header PHI的值：基本归纳变量取 bases + j*step，其他PHI取上一份latch的值
+void LoopUnroll::nextIteration(UnrollInfo &info, int j, std::map<PhiInstruction *, Operand *> &bases)
+{
+    std::map<Operand *, Operand *> next;
+    for (auto inst = info.header->begin(); inst != info.header->end() && inst->isPHI(); inst = inst->getNext())
+    {
+        auto phi = dynamic_cast<PhiInstruction *>(inst);
+        auto value = remap(phi->getSrcs()[info.latch]);
+        for (auto &iv : info.ivs)
+            if (iv.phi == phi)
+                value = offsetValue(bases[phi], j * iv.step);
+        next[phi->getDef()[0]] = value;
+    }
+    vmap.clear();
+    label_map.clear();
+    for (auto &kv : next)
+        mapValue(kv.first, kv.second);
+}
+
+// 把pending中的加法插到这一份header的开头
+void LoopUnroll::insertPending(BasicBlock *bb)
+{
+    for (auto it = pending.rbegin(); it != pending.rend(); it++)
+        bb->insertFront(*it);
+    pending.clear();
+}
+
+void LoopUnroll::fullUnroll(UnrollInfo &info, int trip_count)
+{
+    new_blocks.clear();
+    vmap.clear();
+    label_map.clear();
+    std::map<PhiInstruction *, Operand *> bases;
+    for (auto &iv : info.ivs)
+        bases[iv.phi] = iv.init;
+    // 原循环作为第0份，之后每份的header都已知要进入循环体，最后一份只有header，跳到出口
+    // 原循环的分支最后再修改，之后的每一份都从原循环复制
+    BasicBlock *prev_latch = nullptr, *first_header = nullptr, *last_header = nullptr;
+    for (int k = 1; k <= trip_count; k++)
+    {
+        nextIteration(info, k, bases);
+        cloneIteration(info, k == trip_count, info.exit);
+        last_header = bmap[info.header];
+        insertPending(last_header);
+        if (k == 1)
+            first_header = last_header;
+        else
+            prev_latch->replaceSucc(info.header, last_header);
+        if (k < trip_count)
+        {
+            setUncond(last_header, bmap[info.body]);
+            prev_latch = bmap[info.latch];
+        }
+        else
+            setUncond(last_header, info.exit);
+    }
+    info.latch->replaceSucc(info.header, first_header);
+    setUncond(info.header, info.body);
+    // 出口只从最后一份header进入，循环外对header中的值的使用改为最后一份的值
+    for (auto inst = info.exit->begin(); inst != info.exit->end() && inst->isPHI(); inst = inst->getNext())
+    {
+        auto phi = dynamic_cast<PhiInstruction *>(inst);
+        auto value = phi->getSrcs()[info.header];
+        phi->removeEdge(info.header);
+        phi->addEdge(last_header, value);
+    }
+    std::set<BasicBlock *> inside(info.blocks.begin(), info.blocks.end());
+    inside.insert(new_blocks.begin(), new_blocks.end());
+    for (auto bb : func->getBlockList())
+    {
+        if (inside.count(bb))
+            continue;
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+        {
+            auto uses = inst->getUses();
+            for (auto use : uses)
+            {
+                auto rep = remap(use);
+                if (rep != use)
+                    inst->replaceUse(use, rep);
+            }
+        }
+    }
+    // 原header只剩preheader一个前驱
+    auto inst = info.header->begin();
+    while (inst != info.header->end() && inst->isPHI())
+    {
+        auto next = inst->getNext();
+        auto phi = dynamic_cast<PhiInstruction *>(inst);
+        phi->removeEdge(info.latch);
+        phi->replaceAllUsesWith(phi->getSrcs()[info.preheader]);
+        removeInst(phi);
+        inst = next;
+    }
+    removeDeadInsts(info);
+}
+
+void LoopUnroll::runtimeUnroll(UnrollInfo &info, int factor)
+{
+    new_blocks.clear();
+    vmap.clear();
+    label_map.clear();
+    auto header = info.header;
+    // 展开后的header：PHI对应原header的PHI，判断剩余的迭代是否还有factor次
+    auto unrolled = new BasicBlock(func);
+    func->moveBlockBefore(unrolled, header);
+    new_blocks.push_back(unrolled);
+    info.preheader->replaceSucc(header, unrolled);
+    // 判断 i pred bound - (N-1)*step，避免 i + (N-1)*step 溢出；边界不是常量时在preheader中计算，
+    // 相减会溢出时边界已接近INT_MIN/INT_MAX，i + (N-1)*step不可能满足条件，直接进入原循环
+    int offset = (factor - 1) * info.iv.step;
+    Operand *limit;
+    bool guarded = !info.bound->getEntry()->isConstant();
+    if (guarded)
+    {
+        limit = newTemporary(TypeSystem::intType);
+        info.preheader->insertBeforeTerminator(new BinaryInstruction(BinaryInstruction::SUB, limit, info.bound, newConstant(offset)));
+        auto ok = newTemporary(TypeSystem::boolType);
+        if (offset > 0)
+            info.preheader->insertBeforeTerminator(new CmpInstruction(CmpInstruction::GE, ok, info.bound, newConstant(INT32_MIN + offset)));
+        else
+            info.preheader->insertBeforeTerminator(new CmpInstruction(CmpInstruction::LE, ok, info.bound, newConstant(INT32_MAX + offset)));
+        info.preheader->removeSucc(unrolled);
+        unrolled->removePred(info.preheader);
+        removeInst(info.preheader->rbegin());
+        new CondBrInstruction(unrolled, header, ok, info.preheader);
+        linkSuccs(info.preheader);
+    }
+    else
+        limit = newConstant((int)info.bound->getEntry()->getValue() - offset);
+    std::map<PhiInstruction *, PhiInstruction *> phis;
+    std::map<PhiInstruction *, Operand *> bases;
+    for (auto inst = header->begin(); inst != header->end() && inst->isPHI(); inst = inst->getNext())
+    {
+        auto phi = dynamic_cast<PhiInstruction *>(inst);
+        auto dst = newTemporary(phi->getDef()[0]->getType());
+        auto new_phi = new PhiInstruction(dst, unrolled);
+        new_phi->updateDst(dst);
+        new_phi->addEdge(info.preheader, phi->getSrcs()[info.preheader]);
+        phis[phi] = new_phi;
+        bases[phi] = dst;
+        mapValue(phi->getDef()[0], dst);
+    }
+    auto cond = newTemporary(TypeSystem::boolType);
+    new CmpInstruction(info.pred, cond, bases[info.iv.phi], limit, unrolled);
+    BasicBlock *prev_latch = nullptr;
+    for (int j = 0; j < factor; j++)
+    {
+        if (j > 0)
+            nextIteration(info, j, bases);
+        cloneIteration(info, false, header);
+        auto new_header = bmap[header];
+        insertPending(new_header);
+        setUncond(new_header, bmap[info.body]);
+        if (j == 0)
+        {
+            new CondBrInstruction(new_header, header, cond, unrolled);
+            linkSuccs(unrolled);
+        }
+        else
+            prev_latch->replaceSucc(header, new_header);
+        prev_latch = bmap[info.latch];
+    }
+    // 回到展开后的header，基本归纳变量前进factor步
+    for (auto &kv : phis)
+    {
+        auto value = remap(kv.first->getSrcs()[info.latch]);
+        for (auto &iv : info.ivs)
+            if (iv.phi == kv.first)
+                value = offsetValue(bases[kv.first], factor * iv.step);
+        kv.second->addEdge(prev_latch, value);
+    }
+    for (auto inst : pending)
+        prev_latch->insertBeforeTerminator(inst);
+    pending.clear();
+    prev_latch->replaceSucc(header, unrolled);
+    // 原循环处理剩余的迭代，从展开后的header进入；preheader中的判断不成立时也从preheader进入
+    for (auto &kv : phis)
+    {
+        if (!guarded)
+            kv.first->removeEdge(info.preheader);
+        kv.first->addEdge(unrolled, kv.second->getDef()[0]);
+    }
+    removeDeadInsts(info);
+}
+
+void LoopUnroll::removeDeadInsts(UnrollInfo &info)
+{
+    std::vector<BasicBlock *> blocks(info.blocks);
+    blocks.insert(blocks.end(), new_blocks.begin(), new_blocks.end());
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto bb : blocks)
+        {
+            auto inst = bb->begin();
+            while (inst != bb->end())
+            {
+                auto next = inst->getNext();
+                // GEP的结果可能经别名操作数使用，不在use表中，不删除
+                bool pure = inst->isBinary() || inst->isCmp() || inst->isZext() || inst->isIntFloatCast();
+                if (pure && inst->getDef()[0]->getUses().empty())
+                {
+                    removeInst(inst);
+                    changed = true;
+                }
+                inst = next;
+            }
+        }
+    }
+}
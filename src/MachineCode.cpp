@@ -1,4 +1,8 @@
 #include "MachineCode.h"
+#include "DataflowAnalysis.h"
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
 extern FILE *yyout;
 
 static std::vector<MachineOperand *> newMachineOperands; // 用来回收new出来的SymbolEntry
@@ -15,6 +19,17 @@ bool isShifterOperandVal(unsigned bin_val)
     return false;
 }
 
+// ±(16 + n) / 16 * 2^k，0 <= n <= 15，-3 <= k <= 4
+bool isVFPImmediate(float val)
+{
+    float abs_val = val < 0 ? -val : val;
+    for (int k = -3; k <= 4; k++)
+        for (int n = 0; n <= 15; n++)
+            if (abs_val == ldexpf((16 + n) / 16.0f, k))
+                return true;
+    return false;
+}
+
 MachineOperand::MachineOperand(int tp, double val, Type *valType)
 {
     this->type = tp;
@@ -178,6 +193,24 @@ void MachineInstruction::printCond()
     }
 }
 
+void MachineInstruction::printShift()
+{
+    switch (shift_type)
+    {
+    case BinaryMInstruction::LSL:
+        fprintf(yyout, ", lsl #%d", shift_amount);
+        break;
+    case BinaryMInstruction::LSR:
+        fprintf(yyout, ", lsr #%d", shift_amount);
+        break;
+    case BinaryMInstruction::ASR:
+        fprintf(yyout, ", asr #%d", shift_amount);
+        break;
+    default:
+        break;
+    }
+}
+
 MachineInstruction::~MachineInstruction()
 {
     parent->removeInst(this);
@@ -238,6 +271,21 @@ void BinaryMInstruction::output()
         case BinaryMInstruction::DIV:
             fprintf(yyout, "\tsdiv");
             break;
+        case BinaryMInstruction::RSB:
+            fprintf(yyout, "\trsb");
+            break;
+        case BinaryMInstruction::SMMUL:
+            fprintf(yyout, "\tsmmul");
+            break;
+        case BinaryMInstruction::LSL:
+            fprintf(yyout, "\tlsl");
+            break;
+        case BinaryMInstruction::LSR:
+            fprintf(yyout, "\tlsr");
+            break;
+        case BinaryMInstruction::ASR:
+            fprintf(yyout, "\tasr");
+            break;
         default:
             break;
         }
@@ -249,6 +297,60 @@ void BinaryMInstruction::output()
     this->use_list[0]->output();
     fprintf(yyout, ", ");
     this->use_list[1]->output();
+    printShift();
+    fprintf(yyout, "\n");
+}
+
+MulAccMInstruction::MulAccMInstruction(MachineBlock *p, int op,
+                                       MachineOperand *dst, MachineOperand *src1, MachineOperand *src2, MachineOperand *acc,
+                                       int cond)
+{
+    this->parent = p;
+    this->type = MachineInstruction::MULACC;
+    this->op = op;
+    this->cond = cond;
+    this->def_list.push_back(dst);
+    this->use_list.push_back(src1);
+    this->use_list.push_back(src2);
+    this->use_list.push_back(acc);
+    dst->setParent(this);
+    src1->setParent(this);
+    src2->setParent(this);
+    acc->setParent(this);
+}
+
+void MulAccMInstruction::output()
+{
+    switch (this->op)
+    {
+    case MulAccMInstruction::MLA:
+        fprintf(yyout, "\tmla");
+        break;
+    case MulAccMInstruction::MLS:
+        fprintf(yyout, "\tmls");
+        break;
+    case MulAccMInstruction::VFMA:
+        fprintf(yyout, "\tvfma.f32");
+        break;
+    case MulAccMInstruction::VFMS:
+        fprintf(yyout, "\tvfms.f32");
+        break;
+    default:
+        break;
+    }
+    printCond();
+    fprintf(yyout, " ");
+    this->def_list[0]->output();
+    fprintf(yyout, ", ");
+    this->use_list[0]->output();
+    fprintf(yyout, ", ");
+    this->use_list[1]->output();
+    // vfma/vfms的累加器就是dst
+    if (this->op == MulAccMInstruction::MLA || this->op == MulAccMInstruction::MLS)
+    {
+        fprintf(yyout, ", ");
+        this->use_list[2]->output();
+    }
     fprintf(yyout, "\n");
 }
 
@@ -281,19 +383,39 @@ void LoadMInstruction::output()
     //     this->use_list[1] = this->def_list[0];
     // }
 
-    // 小的立即数用MOV优化一下，arm汇编器会自动做?
-    if ((this->use_list.size() == 1) && this->use_list[0]->isImm() && !this->use_list[0]->isIllegalShifterOperand())
+    // 立即数载入核心寄存器：能编码的用mov/mvn，其余用movw/movt拼出，不访问字面量池
+    if ((this->use_list.size() == 1) && this->use_list[0]->isImm() && !this->def_list[0]->getValType()->isFloat())
     {
-        if (this->def_list[0]->getValType()->isFloat())
-            fprintf(yyout, "\tvmov.f32");
+        unsigned bits;
+        if (this->use_list[0]->getValType()->isFloat())
+        {
+            float float_val = (float)(this->use_list[0]->getVal());
+            memcpy(&bits, &float_val, sizeof(bits));
+        }
         else
-            fprintf(yyout, "\tmov");
+            bits = (unsigned)(int)this->use_list[0]->getVal();
+        if (isShifterOperandVal(bits) || isShifterOperandVal(~bits))
+        {
+            fprintf(yyout, isShifterOperandVal(bits) ? "\tmov" : "\tmvn");
+            printCond();
+            fprintf(yyout, " ");
+            this->def_list[0]->output();
+            fprintf(yyout, ", #%d\n", (int)(isShifterOperandVal(bits) ? bits : ~bits));
+            return;
+        }
+        fprintf(yyout, "\tmovw");
         printCond();
         fprintf(yyout, " ");
         this->def_list[0]->output();
-        fprintf(yyout, ", ");
-        this->use_list[0]->output();
-        fprintf(yyout, "\n");
+        fprintf(yyout, ", #%u\n", bits & 0xFFFF);
+        if (bits >> 16)
+        {
+            fprintf(yyout, "\tmovt");
+            printCond();
+            fprintf(yyout, " ");
+            this->def_list[0]->output();
+            fprintf(yyout, ", #%u\n", bits >> 16);
+        }
         return;
     }
 
@@ -330,6 +452,7 @@ void LoadMInstruction::output()
     {
         fprintf(yyout, ", ");
         this->use_list[1]->output();
+        printShift();
     }
 
     if (this->use_list[0]->isReg() || this->use_list[0]->isVReg())
@@ -377,6 +500,7 @@ void StoreMInstruction::output()
     {
         fprintf(yyout, ", ");
         this->use_list[2]->output();
+        printShift();
     }
 
     if (this->use_list[1]->isReg() || this->use_list[1]->isVReg())
@@ -423,9 +547,14 @@ void MovMInstruction::output()
     case MovMInstruction::VMOV:
         fprintf(yyout, "\tvmov");
         break;
-    // case MovMInstruction::VMOVF32:
-    //     fprintf(yyout, "\tvmov.f32");
-    //     break;
+    case MovMInstruction::VMOVF32:
+        // 浮点立即数按十进制输出，能编码的值只有5位有效二进制位，不会损失精度
+        fprintf(yyout, "\tvmov.f32");
+        printCond();
+        fprintf(yyout, " ");
+        this->def_list[0]->output();
+        fprintf(yyout, ", #%e\n", this->use_list[0]->getVal());
+        return;
     default:
         break;
     }
@@ -447,6 +576,29 @@ BranchMInstruction::BranchMInstruction(MachineBlock *p, int op,
     this->cond = cond;
     this->def_list.push_back(dst);
     dst->setParent(this);
+    // 调用破坏的caller-saved寄存器(r0-r3, r12, lr, s0-s15)作为bl的def，分配寄存器时不会让跨越调用的值使用它们
+    if (op == BL)
+    {
+        for (int i = 0; i < 4; i++)
+            this->def_list.push_back(new MachineOperand(MachineOperand::REG, i));
+        this->def_list.push_back(new MachineOperand(MachineOperand::REG, 12));
+        this->def_list.push_back(new MachineOperand(MachineOperand::REG, 14));
+        for (int i = 0; i < 16; i++)
+            this->def_list.push_back(new MachineOperand(MachineOperand::REG, i, TypeSystem::floatType));
+        for (auto def : def_list)
+            def->setParent(this);
+    }
+}
+
+BranchMInstruction::BranchMInstruction(MachineBlock *p, int op,
+                                       MachineOperand *dst, std::vector<MachineOperand *> args,
+                                       int cond) : BranchMInstruction(p, op, dst, cond)
+{
+    for (auto arg : args)
+    {
+        this->use_list.push_back(arg);
+        arg->setParent(this);
+    }
 }
 
 void BranchMInstruction::output()
@@ -459,6 +611,10 @@ void BranchMInstruction::output()
     case B:
         fprintf(yyout, "\tb");
         break;
+    case TAIL:
+        parent->getParent()->outputEpilogue();
+        fprintf(yyout, "\tb");
+        break;
     // case BX:
     //     fprintf(yyout, "\tbx ");
     //     break;
@@ -471,13 +627,14 @@ void BranchMInstruction::output()
     fprintf(yyout, "\n");
 }
 
-CmpMInstruction::CmpMInstruction(MachineBlock *p,
+CmpMInstruction::CmpMInstruction(MachineBlock *p, int op,
                                  MachineOperand *src1, MachineOperand *src2,
                                  int cond)
 {
     this->type = MachineInstruction::CMP;
     this->parent = p;
-    this->op = cond;
+    this->op = op;
+    this->cond = cond;
     this->use_list.push_back(src1);
     this->use_list.push_back(src2);
     src1->setParent(this);
@@ -488,6 +645,8 @@ void CmpMInstruction::output()
 {
     if (this->use_list[0]->getValType()->isFloat())
         fprintf(yyout, "\tvcmp.f32");
+    else if (this->op == CmpMInstruction::CMN)
+        fprintf(yyout, "\tcmn");
     else
         fprintf(yyout, "\tcmp");
     printCond();
@@ -669,7 +828,12 @@ MachineOperand *MachineBlock::insertLoadImm(MachineOperand *imm)
     // this->insertInst(new LoadMInstruction(this, internal_reg, imm));
     // return new MachineOperand(*internal_reg);
 
-    // ToDo:有些浮点字面常量可以直接vldr到s寄存器
+    if (imm->getValType()->isFloat() && isVFPImmediate(imm->getVal()))
+    {
+        auto internal_reg = new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel(), TypeSystem::floatType);
+        this->insertInst(new MovMInstruction(this, MovMInstruction::VMOVF32, internal_reg, imm));
+        return new MachineOperand(*internal_reg);
+    }
     MachineOperand *internal_reg1 = new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel(), TypeSystem::intType);
     this->insertInst(new LoadMInstruction(this, internal_reg1, imm));
     if (imm->getValType()->isFloat())
@@ -724,6 +888,9 @@ MachineFunction::MachineFunction(MachineUnit *p, SymbolEntry *sym_ptr)
 
 void MachineFunction::addSavedRegs(int regno, bool is_sreg)
 {
+    // caller-saved寄存器由调用者负责，不需要在序言中保存
+    if (is_sreg ? regno < 16 : (regno < 4 || regno == 12))
+        return;
     if (is_sreg)
     {
         // saved_sregs.insert(regno);
@@ -761,6 +928,20 @@ std::vector<MachineOperand *> MachineFunction::getSavedSRegs()
     return sregs;
 }
 
+// vpush/vpop的寄存器列表必须连续且不超过16个，按此分段，出栈时逆序
+static std::vector<std::pair<size_t, size_t>> groupSRegs(const std::vector<MachineOperand *> &sregs)
+{
+    std::vector<std::pair<size_t, size_t>> sreg_groups;
+    for (size_t i = 0; i != sregs.size(); i++)
+    {
+        if (sreg_groups.empty() || sregs[i]->getReg() != sregs[i - 1]->getReg() + 1 || i - sreg_groups.back().first == 16)
+            sreg_groups.push_back(std::make_pair(i, i + 1));
+        else
+            sreg_groups.back().second = i + 1;
+    }
+    return sreg_groups;
+}
+
 void MachineFunction::output()
 {
     fprintf(yyout, "\t.global %s\n", this->sym_ptr->toStr().c_str() + 1);
@@ -779,12 +960,12 @@ void MachineFunction::output()
     fprintf(yyout, "}\n");
     // Save callee saved float registers
     std::vector<MachineOperand *> sregs = getSavedSRegs();
-    i = 0;
-    while (i != sregs.size())
+    auto sreg_groups = groupSRegs(sregs);
+    for (auto group = sreg_groups.begin(); group != sreg_groups.end(); group++)
     {
         fprintf(yyout, "\tvpush {");
-        sregs[i++]->output();
-        for (int j = 1; i != sregs.size() && j != 16; i++, j++)
+        sregs[group->first]->output();
+        for (i = group->first + 1; i != group->second; i++)
         {
             fprintf(yyout, ", ");
             sregs[i]->output();
@@ -804,10 +985,9 @@ void MachineFunction::output()
     {
         if (!isShifterOperandVal(stack_size))
         {
-            auto reg_no = (*saved_rregs.begin());
-            assert(reg_no < 11);
-            fprintf(yyout, "\tldr r%d, =%d\n", reg_no, stack_size);
-            fprintf(yyout, "\tsub sp, sp, r%d\n", reg_no);
+            // 序言中r12(ip)可以随意使用，保存的寄存器里不一定有r4-r10
+            fprintf(yyout, "\tldr r12, =%d\n", stack_size);
+            fprintf(yyout, "\tsub sp, sp, r12\n");
         }
         else
             fprintf(yyout, "\tsub sp, sp, #%d\n", stack_size);
@@ -839,22 +1019,32 @@ void MachineFunction::output()
     // output endLabel
     if (outputEndLabel)
         fprintf(yyout, ".L%s_END:\n", this->sym_ptr->toStr().erase(0, 1).c_str()); // skip '@'
+    outputEpilogue();
+    // Generate bx instruction
+    fprintf(yyout, "\tbx lr\n\n");
+}
+
+void MachineFunction::outputEpilogue()
+{
     // recycle stack space
     if (stack_size)
         fprintf(yyout, "\tmov sp, fp\n");
     // Restore saved registers
-    i = 0;
-    while (i != sregs.size())
+    std::vector<MachineOperand *> sregs = getSavedSRegs();
+    auto sreg_groups = groupSRegs(sregs);
+    size_t i;
+    for (auto group = sreg_groups.rbegin(); group != sreg_groups.rend(); group++)
     {
         fprintf(yyout, "\tvpop {");
-        sregs[i++]->output();
-        for (int j = 1; i != sregs.size() && j != 16; i++, j++)
+        sregs[group->first]->output();
+        for (i = group->first + 1; i != group->second; i++)
         {
             fprintf(yyout, ", ");
             sregs[i]->output();
         }
         fprintf(yyout, "}\n");
     }
+    std::vector<MachineOperand *> regs = getSavedRRegs();
     fprintf(yyout, "\tpop {");
     regs[0]->output();
     for (i = 1; i != regs.size(); i++)
@@ -863,8 +1053,89 @@ void MachineFunction::output()
         regs[i]->output();
     }
     fprintf(yyout, "}\n");
-    // Generate bx instruction
-    fprintf(yyout, "\tbx lr\n\n");
+}
+
+std::map<MachineBlock *, std::set<MachineBlock *>> MachineFunction::findLoops()
+{
+    std::map<MachineBlock *, std::set<MachineBlock *>> result;
+    int n = block_list.size();
+    if (n == 0)
+        return result;
+    std::unordered_map<MachineBlock *, int> block_no;
+    for (int i = 0; i < n; i++)
+        block_no[block_list[i]] = i;
+    // 支配集：dom(b) = {b} ∪ (∩ dom(p))
+    DataflowSolver<FORWARD, MEET_INTERSECT> solver(n, n);
+    for (int i = 0; i < n; i++)
+    {
+        for (auto succ : block_list[i]->getSuccs())
+            solver.addEdge(i, block_no[succ]);
+        solver.gen[i].set(i);
+    }
+    solver.solve(0);
+    std::vector<bool> reachable(n, false);
+    std::vector<int> stk = {0};
+    reachable[0] = true;
+    while (!stk.empty())
+    {
+        int b = stk.back();
+        stk.pop_back();
+        for (auto succ : block_list[b]->getSuccs())
+            if (!reachable[block_no[succ]])
+            {
+                reachable[block_no[succ]] = true;
+                stk.push_back(block_no[succ]);
+            }
+    }
+    // 回边tail->head(head支配tail)，自head以外逆向搜索得到循环体，同一head的循环合并
+    std::vector<BitVector> loops(n);
+    for (int tail = 0; tail < n; tail++)
+    {
+        if (!reachable[tail])
+            continue;
+        for (auto succ : block_list[tail]->getSuccs())
+        {
+            int head = block_no[succ];
+            if (!solver.out[tail].test(head))
+                continue;
+            auto &body = loops[head];
+            if (body.size() == 0)
+                body = BitVector(n);
+            body.set(head);
+            if (body.test(tail))
+                continue;
+            body.set(tail);
+            stk = {tail};
+            while (!stk.empty())
+            {
+                int b = stk.back();
+                stk.pop_back();
+                for (auto pred : block_list[b]->getPreds())
+                {
+                    int p = block_no[pred];
+                    if (reachable[p] && !body.test(p))
+                    {
+                        body.set(p);
+                        stk.push_back(p);
+                    }
+                }
+            }
+        }
+    }
+    for (int head = 0; head < n; head++)
+        if (loops[head].size() != 0)
+            loops[head].forEach([&](int b)
+                                { result[block_list[head]].insert(block_list[b]); });
+    return result;
+}
+
+void MachineFunction::computeLoopDepth()
+{
+    for (auto block : block_list)
+        block->setLoopDepth(0);
+    for (auto &loop : findLoops())
+        for (auto block : loop.second)
+            block->setLoopDepth(block->getLoopDepth() + 1);
 }
 
 MachineFunction::~MachineFunction()
@@ -0,0 +1,89 @@
+#include "MachineLICM.h"
+#include <algorithm>
+
+void MachineLICM::pass()
+{
+    for (auto func : unit->getFuncs())
+    {
+        def_cnt.clear();
+        for (auto block : func->getBlocks())
+            for (auto inst : block->getInsts())
+                for (auto def : inst->getDef())
+                    if (def->isVReg())
+                        def_cnt[def->getReg()]++;
+        auto loops = func->findLoops();
+        typedef std::pair<MachineBlock *, std::set<MachineBlock *>> LoopBody;
+        std::vector<LoopBody> order(loops.begin(), loops.end());
+        std::stable_sort(order.begin(), order.end(), [](const LoopBody &a, const LoopBody &b)
+                         { return a.second.size() < b.second.size(); });
+        for (auto &loop : order)
+            hoist(loop.first, loop.second);
+    }
+}
+
+bool MachineLICM::isSingleDef(MachineOperand *op)
+{
+    return op->isVReg() && def_cnt[op->getReg()] == 1;
+}
+
+// hoisted为本循环中已提升的vreg
+bool MachineLICM::canHoist(MachineInstruction *inst, const std::set<int> &hoisted)
+{
+    if (inst->getCond() != MachineInstruction::NONE || inst->getDef().size() != 1 || !isSingleDef(inst->getDef()[0]))
+        return false;
+    auto &uses = inst->getUse();
+    if (dynamic_cast<LoadMInstruction *>(inst) != nullptr)
+        return uses.size() == 1 && (uses[0]->isImm() || uses[0]->isLabel());
+    if (dynamic_cast<MovMInstruction *>(inst) != nullptr && inst->getOpType() == MovMInstruction::VMOVF32)
+        return uses[0]->isImm();
+    if (dynamic_cast<MovMInstruction *>(inst) != nullptr && inst->getOpType() == MovMInstruction::VMOV)
+        return uses.size() == 1 && uses[0]->isVReg() && hoisted.count(uses[0]->getReg());
+    return false;
+}
+
+void MachineLICM::hoist(MachineBlock *header, const std::set<MachineBlock *> &body)
+{
+    MachineBlock *preheader = nullptr;
+    for (auto pred : header->getPreds())
+    {
+        if (body.count(pred))
+            continue;
+        if (preheader != nullptr && preheader != pred)
+            return;
+        preheader = pred;
+    }
+    if (preheader == nullptr)
+        return;
+    // 插入位置：末尾连续的跳转指令(不含bl)之前
+    auto &pre_insts = preheader->getInsts();
+    auto pos = pre_insts.end();
+    while (pos != pre_insts.begin())
+    {
+        auto branch = *(pos - 1);
+        if (!branch->isBranch() || branch->getOpType() == BranchMInstruction::BL)
+            break;
+        pos--;
+    }
+    std::vector<MachineInstruction *> moved;
+    std::set<int> hoisted;
+    for (auto block : header->getParent()->getBlocks())
+    {
+        if (!body.count(block))
+            continue;
+        auto &insts = block->getInsts();
+        for (auto it = insts.begin(); it != insts.end();)
+        {
+            auto inst = *it;
+            if (canHoist(inst, hoisted))
+            {
+                hoisted.insert(inst->getDef()[0]->getReg());
+                inst->setParent(preheader);
+                moved.push_back(inst);
+                it = insts.erase(it);
+            }
+            else
+                it++;
+        }
+    }
+    pre_insts.insert(pos, moved.begin(), moved.end());
+}
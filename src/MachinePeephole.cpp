@@ -0,0 +1,235 @@
+#include "MachinePeephole.h"
+#include <algorithm>
+
+void MachinePeephole::pass()
+{
+    for (auto f : unit->getFuncs())
+    {
+        func = f;
+        def_cnt.clear();
+        use_cnt.clear();
+        for (auto block : func->getBlocks())
+            for (auto inst : block->getInsts())
+            {
+                for (auto def : inst->getDef())
+                    if (def->isVReg())
+                        def_cnt[def->getReg()]++;
+                for (auto use : inst->getUse())
+                    if (use->isVReg())
+                        use_cnt[use->getReg()]++;
+            }
+        for (auto block : func->getBlocks())
+            for (int i = 0; i < (int)block->getInsts().size(); i++)
+            {
+                // 折叠时i随当前指令的位置更新
+                while (foldShift(block, i))
+                    ;
+                foldMulAcc(block, i);
+                foldAddress(block, i);
+            }
+    }
+}
+
+// op在本块pos之前唯一的定值的下标，op须只定值一次、只使用一次
+int MachinePeephole::findSingleUseDef(MachineBlock *block, int pos, MachineOperand *op)
+{
+    if (!op->isVReg() || def_cnt[op->getReg()] != 1 || use_cnt[op->getReg()] != 1)
+        return -1;
+    auto &insts = block->getInsts();
+    for (int i = pos - 1; i >= 0; i--)
+        for (auto def : insts[i]->getDef())
+            if (def->isVReg() && def->getReg() == op->getReg())
+                return insts[i]->getCond() == MachineInstruction::NONE ? i : -1;
+    return -1;
+}
+
+// from处指令的源操作数在to之前没有被重新定值；物理寄存器只接受不会改变的fp
+bool MachinePeephole::srcsUnchanged(MachineBlock *block, int from, int to)
+{
+    auto &insts = block->getInsts();
+    for (auto src : insts[from]->getUse())
+    {
+        if (src->isImm())
+            continue;
+        if (src->isReg() && src->getReg() == 11)
+            continue;
+        if (!src->isVReg())
+            return false;
+        for (int i = from + 1; i < to; i++)
+            for (auto def : insts[i]->getDef())
+                if (def->isVReg() && def->getReg() == src->getReg())
+                    return false;
+    }
+    return true;
+}
+
+bool MachinePeephole::foldShift(MachineBlock *block, int &pos)
+{
+    auto inst = block->getInsts()[pos];
+    int op = inst->getOpType();
+    if (dynamic_cast<BinaryMInstruction *>(inst) == nullptr || inst->getCond() != MachineInstruction::NONE ||
+        inst->getShiftType() != -1 || inst->getDef()[0]->getValType()->isFloat())
+        return false;
+    if (op != BinaryMInstruction::ADD && op != BinaryMInstruction::SUB && op != BinaryMInstruction::RSB)
+        return false;
+    auto &uses = inst->getUse();
+    auto isShift = [&](int def)
+    {
+        if (def < 0)
+            return false;
+        auto shift = block->getInsts()[def];
+        int shift_op = shift->getOpType();
+        return dynamic_cast<BinaryMInstruction *>(shift) != nullptr && shift->getUse()[1]->isImm() &&
+               (shift_op == BinaryMInstruction::LSL || shift_op == BinaryMInstruction::LSR || shift_op == BinaryMInstruction::ASR) &&
+               srcsUnchanged(block, def, pos);
+    };
+    int def = findSingleUseDef(block, pos, uses[1]);
+    if (!isShift(def))
+    {
+        // 第一个操作数是移位结果时交换操作数，sub与rsb互换
+        def = uses[0]->isImm() ? -1 : findSingleUseDef(block, pos, uses[0]);
+        if (!isShift(def) || uses[1]->isImm())
+            return false;
+        std::swap(uses[0], uses[1]);
+        if (op == BinaryMInstruction::SUB)
+            inst = new BinaryMInstruction(block, BinaryMInstruction::RSB, inst->getDef()[0], uses[0], uses[1]);
+        else if (op == BinaryMInstruction::RSB)
+            inst = new BinaryMInstruction(block, BinaryMInstruction::SUB, inst->getDef()[0], uses[0], uses[1]);
+        if (inst != block->getInsts()[pos])
+        {
+            delete block->getInsts()[pos];
+            block->getInsts().insert(block->getInsts().begin() + pos, inst);
+        }
+    }
+    auto shift = block->getInsts()[def];
+    auto src = new MachineOperand(*shift->getUse()[0]);
+    src->setParent(inst);
+    inst->getUse()[1] = src;
+    inst->setShift(shift->getOpType(), shift->getUse()[1]->getVal());
+    delete shift;
+    pos--;
+    return true;
+}
+
+bool MachinePeephole::foldMulAcc(MachineBlock *block, int &pos)
+{
+    auto inst = block->getInsts()[pos];
+    int op = inst->getOpType();
+    if (dynamic_cast<BinaryMInstruction *>(inst) == nullptr || inst->getCond() != MachineInstruction::NONE || inst->getShiftType() != -1)
+        return false;
+    bool isFloat = inst->getDef()[0]->getValType()->isFloat();
+    if (isFloat && !fast_math)
+        return false;
+    // d = c + t 或 d = c - t，t为乘法结果
+    auto &uses = inst->getUse();
+    auto findMul = [&](int idx)
+    {
+        int def = uses[1 - idx]->isImm() ? -1 : findSingleUseDef(block, pos, uses[idx]);
+        if (def < 0)
+            return -1;
+        auto mul = block->getInsts()[def];
+        if (dynamic_cast<BinaryMInstruction *>(mul) == nullptr || mul->getOpType() != BinaryMInstruction::MUL || mul->getShiftType() != -1 ||
+            mul->getUse()[0]->isImm() || mul->getUse()[1]->isImm() || !srcsUnchanged(block, def, pos))
+            return -1;
+        return def;
+    };
+    int mul_idx, def = -1;
+    if (op == BinaryMInstruction::ADD)
+    {
+        mul_idx = 1;
+        def = findMul(1);
+        if (def < 0)
+            def = findMul(mul_idx = 0);
+    }
+    else if (op == BinaryMInstruction::SUB)
+        def = findMul(mul_idx = 1);
+    else if (op == BinaryMInstruction::RSB && !isFloat)
+        def = findMul(mul_idx = 0);
+    if (def < 0)
+        return false;
+    auto mul = block->getInsts()[def];
+    auto acc = uses[1 - mul_idx];
+    auto dst = inst->getDef()[0];
+    auto src1 = new MachineOperand(*mul->getUse()[0]), src2 = new MachineOperand(*mul->getUse()[1]);
+    MachineInstruction *fused;
+    if (isFloat)
+    {
+        // 累加器与dst不是同一个vreg时先复制到dst，dst不能是乘数
+        if (!(*acc == *dst))
+        {
+            if (*src1 == *dst || *src2 == *dst)
+                return false;
+            block->insertBefore(inst, new MovMInstruction(block, MovMInstruction::VMOV, new MachineOperand(*dst), new MachineOperand(*acc)));
+            pos++;
+            def_cnt[dst->getReg()]++;
+            use_cnt[dst->getReg()]++;
+        }
+        int fused_op = op == BinaryMInstruction::ADD ? MulAccMInstruction::VFMA : MulAccMInstruction::VFMS;
+        fused = new MulAccMInstruction(block, fused_op, dst, src1, src2, new MachineOperand(*dst));
+    }
+    else
+    {
+        int fused_op = op == BinaryMInstruction::ADD ? MulAccMInstruction::MLA : MulAccMInstruction::MLS;
+        fused = new MulAccMInstruction(block, fused_op, dst, src1, src2, new MachineOperand(*acc));
+    }
+    block->getInsts()[pos] = fused;
+    delete mul;
+    pos--;
+    return true;
+}
+
+bool MachinePeephole::foldAddress(MachineBlock *block, int &pos)
+{
+    auto inst = block->getInsts()[pos];
+    if (inst->getCond() != MachineInstruction::NONE || inst->getShiftType() != -1)
+        return false;
+    auto &uses = inst->getUse();
+    int addr;
+    Type *valType;
+    if (dynamic_cast<LoadMInstruction *>(inst) != nullptr && uses.size() == 1)
+    {
+        addr = 0;
+        valType = inst->getDef()[0]->getValType();
+    }
+    else if (dynamic_cast<StoreMInstruction *>(inst) != nullptr && uses.size() == 2)
+    {
+        addr = 1;
+        valType = uses[0]->getValType();
+    }
+    else
+        return false;
+    int def = findSingleUseDef(block, pos, uses[addr]);
+    if (def < 0 || !srcsUnchanged(block, def, pos))
+        return false;
+    auto calc = block->getInsts()[def];
+    int op = calc->getOpType();
+    if (dynamic_cast<BinaryMInstruction *>(calc) == nullptr || (op != BinaryMInstruction::ADD && op != BinaryMInstruction::SUB))
+        return false;
+    auto base = calc->getUse()[0], offset = calc->getUse()[1];
+    if (offset->isImm())
+    {
+        // 输出序言时才确定的额外参数偏移不能复制
+        auto &args_offset = func->getAdditionalArgsOffset();
+        if (std::find(args_offset.begin(), args_offset.end(), offset) != args_offset.end())
+            return false;
+        int val = op == BinaryMInstruction::ADD ? offset->getVal() : -offset->getVal();
+        if (valType->isFloat() ? (val % 4 != 0 || val > 1020 || val < -1020) : (val > 4095 || val < -4095))
+            return false;
+        offset = new MachineOperand(MachineOperand::IMM, val);
+    }
+    else
+    {
+        if (valType->isFloat() || op != BinaryMInstruction::ADD)
+            return false;
+        offset = new MachineOperand(*offset);
+        inst->setShift(calc->getShiftType(), calc->getShiftAmount());
+    }
+    base = new MachineOperand(*base);
+    base->setParent(inst);
+    offset->setParent(inst);
+    uses[addr] = base;
+    uses.insert(uses.begin() + addr + 1, offset);
+    delete calc;
+    pos--;
+    return true;
+}
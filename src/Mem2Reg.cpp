@@ -2,7 +2,6 @@
 #include "Type.h"
 #include <queue>
 
-static std::map<BasicBlock *, std::set<BasicBlock *>> SDoms;
 static std::map<Instruction *, unsigned> InstNumbers;
 static std::vector<PhiInstruction *> newPHIs;
 static std::set<Instruction *> freeList;
@@ -60,6 +59,8 @@ void Mem2Reg::pass()
 {
     for (auto func = unit->begin(); func != unit->end(); func++)
     {
+        InstNumbers.clear();
+        newPHIs.clear();
         ComputeDom(*func);
         ComputeDomFrontier(*func);
         InsertPhi(*func);
@@ -67,109 +68,14 @@ void Mem2Reg::pass()
     }
 }
 
-// SDoms & IDom
 void Mem2Reg::ComputeDom(Function *func)
 {
-    // Vertex-removal Algorithm, TODO：采用更高效的算法
-    SDoms.clear();
-    for (auto bb : func->getBlockList())
-        SDoms[bb] = std::set<BasicBlock *>();
-    std::set<BasicBlock *> all_bbs(func->getBlockList().begin(), func->getBlockList().end());
-    for (auto removed_bb : func->getBlockList())
-    {
-        std::set<BasicBlock *> visited;
-        std::queue<BasicBlock *> q;
-        std::map<BasicBlock *, bool> is_visited;
-        for (auto bb : func->getBlockList())
-            is_visited[bb] = false;
-        if (func->getEntry() != removed_bb)
-        {
-            visited.insert(func->getEntry());
-            is_visited[func->getEntry()] = true;
-            q.push(func->getEntry());
-            while (!q.empty())
-            {
-                BasicBlock *cur = q.front();
-                q.pop();
-                for (auto succ = cur->succ_begin(); succ != cur->succ_end(); succ++)
-                    if (*succ != removed_bb && !is_visited[*succ])
-                    {
-                        q.push(*succ);
-                        visited.insert(*succ);
-                        is_visited[*succ] = true;
-                    }
-            }
-        }
-        std::set<BasicBlock *> not_visited;
-        set_difference(all_bbs.begin(), all_bbs.end(), visited.begin(), visited.end(), inserter(not_visited, not_visited.end()));
-        for (auto bb : not_visited)
-        {
-            if (bb != removed_bb)
-                SDoms[bb].insert(removed_bb); // strictly dominators
-        }
-    }
-    // immediate dominator ：严格支配 bb，且不严格支配任何严格支配 bb 的节点的节点
-    IDom.clear();
-    for (auto bb : func->getBlockList())
-    {
-        IDom[bb] = SDoms[bb];
-        for (auto sdom : SDoms[bb])
-        {
-            std::set<BasicBlock *> temp;
-            set_difference(IDom[bb].begin(), IDom[bb].end(), SDoms[sdom].begin(), SDoms[sdom].end(), inserter(temp, temp.end()));
-            IDom[bb] = temp;
-        }
-        assert(IDom[bb].size() == 1 || (bb == func->getEntry() && IDom[bb].size() == 0));
-    }
-    // for (auto kv : IDom)
-    // {
-    //     fprintf(stderr, "IDom[B%d] = {", kv.first->getNo());
-    //     for (auto bb : kv.second)
-    //         fprintf(stderr, "B%d, ", bb->getNo());
-    //     fprintf(stderr, "}\n");
-    // }
+    DT = pm->getDomTree(func);
 }
 
-// ref : Static Single Assignment Book
 void Mem2Reg::ComputeDomFrontier(Function *func)
 {
-    DF.clear();
-    for (auto bb : func->getBlockList())
-        DF[bb] = std::set<BasicBlock *>();
-    std::map<BasicBlock *, bool> is_visited;
-    for (auto bb : func->getBlockList())
-        is_visited[bb] = false;
-    std::queue<BasicBlock *> q;
-    q.push(func->getEntry());
-    is_visited[func->getEntry()] = true;
-    while (!q.empty())
-    {
-        auto a = q.front();
-        q.pop();
-        std::vector<BasicBlock *> succs(a->succ_begin(), a->succ_end());
-        for (auto b : succs)
-        {
-            auto x = a;
-            while (!SDoms[b].count(x))
-            {
-                assert(x != func->getEntry());
-                DF[x].insert(b);
-                x = *(IDom[x].begin());
-            }
-            if (!is_visited[b])
-            {
-                is_visited[b] = true;
-                q.push(b);
-            }
-        }
-    }
-    // for (auto kv : DF)
-    // {
-    //     fprintf(stderr, "DF[B%d] = {", kv.first->getNo());
-    //     for (auto bb : kv.second)
-    //         fprintf(stderr, "B%d, ", bb->getNo());
-    //     fprintf(stderr, "}\n");
-    // }
+    DT->computeDomFrontier(DF);
 }
 
 static bool isAllocaPromotable(AllocaInstruction *alloca)
@@ -184,9 +90,6 @@ static bool isAllocaPromotable(AllocaInstruction *alloca)
         {
             assert(user->getUses()[1]->getEntry() != alloca->getDef()[0]->getEntry());
             assert(dynamic_cast<PointerType *>(user->getUses()[0]->getType())->getValType() == dynamic_cast<PointerType *>(alloca->getDef()[0]->getType())->getValType());
-            if (user->getUses()[1]->getEntry()->isVariable())
-                if (dynamic_cast<IdentifierSymbolEntry *>(user->getUses()[1]->getEntry())->isParam())
-                    return false; // todo : 函数参数先不提升
         }
         // load: 不允许load src的类型和alloc dst的类型不符
         else if (user->isLoad())
@@ -228,7 +131,7 @@ static unsigned getInstructionIndex(Instruction *inst)
 }
 
 // 如果只有一个store语句，那么被这个store指令所支配的所有指令都要被替换为store的src。
-static bool rewriteSingleStoreAlloca(AllocaInstruction *alloca, AllocaInfo &Info)
+static bool rewriteSingleStoreAlloca(AllocaInstruction *alloca, AllocaInfo &Info, DominatorTree *DT)
 {
     StoreInstruction *OnlyStore = Info.OnlyStore;
     bool StoringGlobalVal = OnlyStore->getUses()[1]->getEntry()->isVariable() &&
@@ -260,7 +163,7 @@ static bool rewriteSingleStoreAlloca(AllocaInstruction *alloca, AllocaInfo &Info
                 }
             }
             // 如果二者在不同基本块，则需要保证 load 指令能被 store 支配
-            else if (!SDoms[UserInst->getParent()].count(StoreBB))
+            else if (!DT->dominates(StoreBB, UserInst->getParent()))
             {
                 Info.UsingBlocks.push_back(UserInst->getParent());
                 continue;
@@ -309,6 +212,9 @@ static bool promoteSingleBlockAlloca(AllocaInstruction *alloca)
     }
     std::sort(StoresByIndex.begin(), StoresByIndex.end());
     std::sort(LoadsByIndex.begin(), LoadsByIndex.end());
+    // 第一个store之前有load时，读到的值可能来自循环的上一次迭代，交给PHI处理
+    if (!LoadsByIndex.empty() && (StoresByIndex.empty() || LoadsByIndex[0].first < StoresByIndex[0].first))
+        return false;
 
     // 遍历所有load指令，用前面最近的store指令替换掉
     for (auto kv : LoadsByIndex)
@@ -318,19 +224,8 @@ static bool promoteSingleBlockAlloca(AllocaInstruction *alloca)
 
         // 找到离load最近的store，用store的操作数替换load的user
         StoresByIndexTy::iterator it = std::lower_bound(StoresByIndex.begin(), StoresByIndex.end(), std::make_pair(LoadIdx, static_cast<StoreInstruction *>(nullptr)));
-        if (it == StoresByIndex.begin())
-        {
-            assert(0);
-            // if (StoresByIndex.size())
-            //     LoadInst->replaceAllUsesWith((*it).second->getUses()[1]);
-            // else
-            //     return false;
-        }
-        else
-        {
-            auto ReplVal = (*(it - 1)).second->getUses()[1];
-            LoadInst->replaceAllUsesWith(ReplVal);
-        }
+        auto ReplVal = (*(it - 1)).second->getUses()[1];
+        LoadInst->replaceAllUsesWith(ReplVal);
 
         // 删除load指令
         InstNumbers.erase(LoadInst);
@@ -427,7 +322,7 @@ void Mem2Reg::InsertPhi(Function *func)
         // 筛2：如果 alloca 只有一个 store，那么 users 可以替换成这个 store 的值
         if (Info.DefiningBlocks.size() == 1)
         {
-            if (rewriteSingleStoreAlloca(alloca, Info))
+            if (rewriteSingleStoreAlloca(alloca, Info, DT))
                 continue;
         }
 
@@ -466,55 +361,66 @@ void Mem2Reg::InsertPhi(Function *func)
     }
 }
 
-// 删除源操作数均相同的PHI
+// 删除源操作数除自身外均相同的PHI，删除一个PHI可能使别的PHI也变得平凡，迭代到不动点
 static void SimplifyInstruction()
 {
-    for (auto phi : newPHIs)
+    std::set<PhiInstruction *> removed;
+    bool changed = true;
+    while (changed)
     {
-        auto srcs = phi->getUses();
-        auto last_src = srcs[0];
-        bool Elim = true;
-        for (auto src : srcs)
+        changed = false;
+        for (auto phi : newPHIs)
         {
-            if (src != last_src)
+            if (removed.count(phi))
+                continue;
+            auto dst = phi->getDef()[0]->getEntry();
+            Operand *same = nullptr;
+            bool Elim = true;
+            for (auto &kv : phi->getSrcs())
             {
-                Elim = false;
-                break;
+                auto src = kv.second;
+                if (src->getEntry() == dst || (same && src->getEntry() == same->getEntry()))
+                    continue;
+                if (same)
+                {
+                    Elim = false;
+                    break;
+                }
+                same = src;
             }
-        }
-        if (Elim)
-        {
-            phi->replaceAllUsesWith(last_src);
+            if (!Elim || !same)
+                continue;
+            phi->replaceAllUsesWith(same);
+            for (auto &kv : phi->getSrcs())
+                kv.second->removeUse(phi);
             phi->getParent()->remove(phi);
             freeList.insert(phi);
+            removed.insert(phi);
+            changed = true;
         }
     }
 }
 
+// 未初始化的局部变量读出0
+static Operand *undefValue(Operand *addr)
+{
+    auto type = dynamic_cast<PointerType *>(addr->getType())->getValType();
+    return new Operand(new ConstantSymbolEntry(type->isFloat() ? TypeSystem::constFloatType : TypeSystem::constIntType, 0));
+}
+
 // https://roife.github.io/2022/02/07/mem2reg/
 void Mem2Reg::Rename(Function *func)
 {
-    // std::map<BasicBlock *, std::set<BasicBlock *>> DT_succ; // DominatorTree
-    // // 将IDom反向得到DominatorTree
-    // for (auto kv : IDom)
-    //     DT_succ[*kv.second.begin()].insert(kv.first);
-
     using RenamePassData = std::pair<BasicBlock *, std::map<Operand *, Operand *>>; //(bb, addr2val)
 
-    // bfs
-    std::map<BasicBlock *, bool> isVisited;
-    for (auto bb : func->getBlockList())
-        isVisited[bb] = false;
-    std::queue<RenamePassData> workList;
-    workList.push(std::make_pair(func->getEntry(), std::map<Operand *, Operand *>()));
+    // 沿支配树先序遍历，块入口处的到达定值即其idom出口处的到达定值
+    std::vector<RenamePassData> workList;
+    workList.push_back(std::make_pair(func->getEntry(), std::map<Operand *, Operand *>()));
     while (!workList.empty())
     {
-        auto BB = workList.front().first;
-        auto IncomingVals = workList.front().second;
-        workList.pop();
-        if (isVisited[BB])
-            continue;
-        isVisited[BB] = true;
+        auto BB = workList.back().first;
+        auto IncomingVals = workList.back().second;
+        workList.pop_back();
         for (auto inst = BB->begin(); inst != BB->end(); inst = inst->getNext())
         {
             if (inst->isAlloca() && isAllocaPromotable(dynamic_cast<AllocaInstruction *>(inst)))
@@ -527,7 +433,10 @@ void Mem2Reg::Rename(Function *func)
                 if (inst->getUses()[0]->getDef() && inst->getUses()[0]->getDef()->isAlloca() &&
                     isAllocaPromotable(dynamic_cast<AllocaInstruction *>(inst->getUses()[0]->getDef())))
                 {
-                    inst->replaceAllUsesWith(IncomingVals[inst->getUses()[0]]);
+                    auto addr = inst->getUses()[0]->getDef()->getDef()[0];
+                    if (!IncomingVals.count(addr))
+                        IncomingVals[addr] = undefValue(addr);
+                    inst->replaceAllUsesWith(IncomingVals[addr]);
                     inst->getParent()->remove(inst);
                     freeList.insert(inst);
                 }
@@ -537,7 +446,7 @@ void Mem2Reg::Rename(Function *func)
                 if (inst->getUses()[0]->getDef() && inst->getUses()[0]->getDef()->isAlloca() &&
                     isAllocaPromotable(dynamic_cast<AllocaInstruction *>(inst->getUses()[0]->getDef())))
                 {
-                    IncomingVals[inst->getUses()[0]] = inst->getUses()[1];
+                    IncomingVals[inst->getUses()[0]->getDef()->getDef()[0]] = inst->getUses()[1];
                     inst->getParent()->remove(inst);
                     freeList.insert(inst);
                 }
@@ -553,21 +462,17 @@ void Mem2Reg::Rename(Function *func)
             }
         }
         for (auto succ = BB->succ_begin(); succ != BB->succ_end(); succ++)
-        // for (auto succ : DT_succ[BB])
         {
-            // workList.push(std::make_pair(succ, IncomingVals));
-            // for (auto phi = succ->begin(); phi != succ->end() && phi->isPHI(); phi = phi->getNext())
-            // {
-            //     if (IncomingVals.count(dynamic_cast<PhiInstruction *>(phi)->getAddr()))
-            //         dynamic_cast<PhiInstruction *>(phi)->addEdge(BB, IncomingVals[dynamic_cast<PhiInstruction *>(phi)->getAddr()]);
-            // }
-            workList.push(std::make_pair(*succ, IncomingVals));
             for (auto phi = (*succ)->begin(); phi != (*succ)->end() && phi->isPHI(); phi = phi->getNext())
             {
-                if (IncomingVals.count(dynamic_cast<PhiInstruction *>(phi)->getAddr()))
-                    dynamic_cast<PhiInstruction *>(phi)->addEdge(BB, IncomingVals[dynamic_cast<PhiInstruction *>(phi)->getAddr()]);
+                auto addr = dynamic_cast<PhiInstruction *>(phi)->getAddr();
+                if (!IncomingVals.count(addr))
+                    IncomingVals[addr] = undefValue(addr);
+                dynamic_cast<PhiInstruction *>(phi)->addEdge(BB, IncomingVals[addr]);
             }
         }
+        for (auto child : DT->getChildren(BB))
+            workList.push_back(std::make_pair(child, IncomingVals));
     }
     SimplifyInstruction();
     // bug
@@ -0,0 +1,154 @@
+#include "PassManager.h"
+#include "SimplifyCFG.h"
+#include "Mem2Reg.h"
+#include "ElimPHI.h"
+#include "SCCP.h"
+#include "GVN.h"
+#include "LoopSimplify.h"
+#include "LICM.h"
+#include "LoopStrengthReduce.h"
+#include "LoopUnroll.h"
+#include "Inliner.h"
+#include "CodeElim.h"
+#include "TailRecursionElim.h"
+
+PassManager::PassManager(Unit *unit) : unit(unit)
+{
+    registerPass("simplify-cfg", [this]()
+                 { SimplifyCFG(this->unit).pass(); });
+    registerPass("mem2reg", [this]()
+                 { Mem2Reg(this->unit, this).pass(); },
+                 true);
+    registerPass("tail-rec", [this]()
+                 { TailRecursionElim(this->unit).pass(); });
+    registerPass("inline", [this]()
+                 { Inliner(this->unit, this).pass(); });
+    registerPass("sccp", [this]()
+                 { SCCP(this->unit).pass(); });
+    registerPass("gvn", [this]()
+                 { GVN(this->unit, this).pass(); },
+                 true);
+    registerPass("adce", [this]()
+                 { DeadCodeElim(this->unit).pass(); });
+    registerPass("loop-simplify", [this]()
+                 { LoopSimplify(this->unit, this).pass(); });
+    registerPass("licm", [this]()
+                 { LICM(this->unit, this).pass(); },
+                 true);
+    registerPass("loop-unroll", [this]()
+                 { LoopUnroll(this->unit, this).pass(); });
+    registerPass("loop-reduce", [this]()
+                 { LoopStrengthReduce(this->unit, this).pass(); },
+                 true);
+    // SSA destruction，IR之后不再是SSA形式，不放在预设流水线中，由main在生成汇编前执行
+    registerPass("elim-phi", [this]()
+                 { ElimPHI(this->unit, this).pass(); });
+}
+
+void PassManager::registerPass(const std::string &name, std::function<void()> run, bool preservesCFG)
+{
+    passes[name] = {run, preservesCFG};
+}
+
+bool PassManager::addPass(const std::string &name)
+{
+    if (!hasPass(name))
+        return false;
+    pipeline.push_back(name);
+    return true;
+}
+
+bool PassManager::parsePipeline(const std::string &names)
+{
+    size_t begin = 0;
+    while (begin <= names.size())
+    {
+        size_t end = names.find(',', begin);
+        if (end == std::string::npos)
+            end = names.size();
+        auto name = names.substr(begin, end - begin);
+        if (!name.empty() && !addPass(name))
+        {
+            fprintf(stderr, "unknown pass: %s\n", name.c_str());
+            return false;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+void PassManager::buildPipeline(int opt_level)
+{
+    if (opt_level >= 1)
+    {
+        addPass("simplify-cfg");
+        addPass("mem2reg");
+        if (opt_level >= 2)
+        {
+            // 尾递归改为循环后不再是递归函数，可以内联
+            addPass("tail-rec");
+            // 内联后实参为常量的分支可以由SCCP消去，合并拆分出的基本块
+            addPass("inline");
+            addPass("simplify-cfg");
+        }
+        addPass("sccp");
+        addPass("gvn");
+        addPass("adce");
+        addPass("simplify-cfg");
+    }
+    if (opt_level >= 2)
+    {
+        addPass("loop-simplify");
+        addPass("licm");
+        addPass("loop-unroll");
+        // 展开后的循环体之间做常量传播和公共子表达式消除，余数循环需要重新插入preheader
+        addPass("sccp");
+        addPass("gvn");
+        addPass("adce");
+        addPass("loop-simplify");
+        addPass("loop-reduce");
+        addPass("adce");
+        // 合并没有提升到指令的preheader和专用出口
+        addPass("simplify-cfg");
+    }
+}
+
+void PassManager::runPass(const std::string &name)
+{
+    auto &info = passes[name];
+    info.run();
+    if (!info.preservesCFG)
+        invalidate();
+}
+
+void PassManager::run()
+{
+    for (auto &name : pipeline)
+        runPass(name);
+}
+
+DominatorTree *PassManager::getDomTree(Function *func)
+{
+    auto &DT = dom_trees[func];
+    if (DT == nullptr)
+        DT = new DominatorTree(func);
+    return DT;
+}
+
+LoopInfo *PassManager::getLoopInfo(Function *func)
+{
+    auto &LI = loop_infos[func];
+    if (LI == nullptr)
+        LI = new LoopInfo(func, getDomTree(func));
+    return LI;
+}
+
+void PassManager::invalidate()
+{
+    for (auto &kv : dom_trees)
+        delete kv.second;
+    dom_trees.clear();
+    for (auto &kv : loop_infos)
+        delete kv.second;
+    loop_infos.clear();
+}
@@ -0,0 +1,192 @@
+#include <assert.h>
+#include <algorithm>
+#include "RegisterAllocator.h"
+#include "MachineCode.h"
+
+RegisterAllocator::RegisterAllocator(MachineUnit *unit)
+{
+    this->unit = unit;
+    // caller-saved寄存器排在前面，不跨越调用的值优先使用，不需要在序言中保存
+    for (int i = 0; i < 11; i++)
+        rregs.push_back(i);
+    for (int i = 0; i < 32; i++)
+        if (i != 4 && i != 5)
+            sregs.push_back(i);
+    // r12(ip)为caller-saved，lr在用到时入栈；s4、s5不参与分配
+    spill_rregs = {12, 14};
+    spill_sregs = {4, 5};
+}
+
+MachineInstruction *RegisterAllocator::rematerializable(MachineOperand *def)
+{
+    auto inst = def->getParent();
+    if (inst->getCond() != MachineInstruction::NONE || inst->getDef().size() != 1)
+        return nullptr;
+    auto &uses = inst->getUse();
+    // ldr =imm / ldr =label
+    if (dynamic_cast<LoadMInstruction *>(inst) && uses.size() == 1 && (uses[0]->isImm() || uses[0]->isLabel()))
+        return inst;
+    // mov #imm / vmov.f32 #imm
+    if (dynamic_cast<MovMInstruction *>(inst) && (inst->getOpType() == MovMInstruction::MOV || inst->getOpType() == MovMInstruction::VMOVF32) &&
+        uses[0]->isImm())
+        return inst;
+    // add fp, #off
+    if (dynamic_cast<BinaryMInstruction *>(inst) && inst->getOpType() == BinaryMInstruction::ADD &&
+        uses[0]->isReg() && uses[0]->getReg() == 11 && uses[1]->isImm())
+        return inst;
+    return nullptr;
+}
+
+void RegisterAllocator::insertRemat(MachineBlock *block, std::vector<MachineInstruction *> &insts, int reg, const StackSlot &slot)
+{
+    auto inst = slot.remat;
+    auto dst = new MachineOperand(MachineOperand::REG, reg, slot.valType);
+    std::vector<MachineOperand *> uses;
+    for (auto use : inst->getUse())
+    {
+        uses.push_back(new MachineOperand(*use));
+        // 额外参数的偏移在输出序言时才确定，复制出的立即数也要更新
+        auto &offsets = func->getAdditionalArgsOffset();
+        if (std::find(offsets.begin(), offsets.end(), use) != offsets.end())
+            func->addAdditionalArgsOffset(uses.back());
+    }
+    if (dynamic_cast<LoadMInstruction *>(inst))
+        insts.push_back(new LoadMInstruction(block, dst, uses[0]));
+    else if (dynamic_cast<MovMInstruction *>(inst))
+        insts.push_back(new MovMInstruction(block, inst->getOpType(), dst, uses[0]));
+    else
+        insts.push_back(new BinaryMInstruction(block, inst->getOpType(), dst, uses[0], uses[1]));
+}
+
+void RegisterAllocator::insertSpillLoad(MachineBlock *block, std::vector<MachineInstruction *> &insts, int reg, const StackSlot &slot)
+{
+    if (slot.remat)
+    {
+        insertRemat(block, insts, reg, slot);
+        return;
+    }
+    auto dst = new MachineOperand(MachineOperand::REG, reg, slot.valType);
+    auto fp = new MachineOperand(MachineOperand::REG, 11);
+    if (slot.valType->isFloat())
+    {
+        if (slot.disp <= 1020)
+            insts.push_back(new LoadMInstruction(block, dst, fp, new MachineOperand(MachineOperand::IMM, -slot.disp)));
+        else
+        {
+            auto addr = new MachineOperand(MachineOperand::REG, spill_rregs[0]);
+            insts.push_back(new LoadMInstruction(block, addr, new MachineOperand(MachineOperand::IMM, -slot.disp)));
+            insts.push_back(new BinaryMInstruction(block, BinaryMInstruction::ADD, new MachineOperand(*addr), fp, new MachineOperand(*addr)));
+            insts.push_back(new LoadMInstruction(block, dst, new MachineOperand(*addr)));
+        }
+    }
+    else
+    {
+        if (slot.disp <= 4095)
+            insts.push_back(new LoadMInstruction(block, dst, fp, new MachineOperand(MachineOperand::IMM, -slot.disp)));
+        else
+        {
+            auto offset = new MachineOperand(MachineOperand::REG, reg);
+            insts.push_back(new LoadMInstruction(block, offset, new MachineOperand(MachineOperand::IMM, -slot.disp)));
+            insts.push_back(new LoadMInstruction(block, dst, fp, new MachineOperand(*offset)));
+        }
+    }
+}
+
+void RegisterAllocator::insertSpillStore(MachineBlock *block, std::vector<MachineInstruction *> &insts, int reg, const StackSlot &slot, int cond)
+{
+    // 重新计算的值不需要写回
+    if (slot.remat)
+        return;
+    auto src = new MachineOperand(MachineOperand::REG, reg, slot.valType);
+    auto fp = new MachineOperand(MachineOperand::REG, 11);
+    int limit = slot.valType->isFloat() ? 1020 : 4095;
+    if (slot.disp <= limit)
+        insts.push_back(new StoreMInstruction(block, src, fp, new MachineOperand(MachineOperand::IMM, -slot.disp), cond));
+    else
+    {
+        // 地址用另一个scratch寄存器计算，浮点数只能用[reg]寻址
+        auto addr = new MachineOperand(MachineOperand::REG, reg == spill_rregs[0] ? spill_rregs[1] : spill_rregs[0]);
+        insts.push_back(new LoadMInstruction(block, addr, new MachineOperand(MachineOperand::IMM, -slot.disp)));
+        if (slot.valType->isFloat())
+        {
+            insts.push_back(new BinaryMInstruction(block, BinaryMInstruction::ADD, new MachineOperand(*addr), fp, new MachineOperand(*addr)));
+            insts.push_back(new StoreMInstruction(block, src, new MachineOperand(*addr), nullptr, cond));
+        }
+        else
+            insts.push_back(new StoreMInstruction(block, src, fp, new MachineOperand(*addr), cond));
+        if (addr->getReg() == 14)
+            func->addSavedRegs(14);
+    }
+}
+
+void RegisterAllocator::genSpillCode(std::map<MachineOperand *, StackSlot> &spilled)
+{
+    /* HINT:
+     * The vreg should be spilled to memory.
+     * 1. insert ldr inst before the use of vreg
+     * 2. insert str inst after the def of vreg
+     * 溢出的vreg在每条指令内临时放在scratch寄存器中，同一条指令里同一个vreg只load一次
+     */
+    for (auto &block : func->getBlocks())
+    {
+        std::vector<MachineInstruction *> insts;
+        for (auto &inst : block->getInsts())
+        {
+            // 栈偏移(重新计算的值以定值指令区分) -> 已经载入的scratch寄存器
+            std::vector<std::pair<std::pair<int, MachineInstruction *>, int>> loaded;
+            auto findLoaded = [&](const StackSlot &slot) -> int
+            {
+                for (auto &p : loaded)
+                    if (p.first == std::make_pair(slot.disp, slot.remat))
+                        return p.second;
+                return -1;
+            };
+            size_t rcnt = 0, scnt = 0;
+            // 浮点先load，地址计算借用尚未分出去的整数scratch寄存器
+            for (int round = 0; round < 2; round++)
+                for (auto &use : inst->getUse())
+                {
+                    if (!spilled.count(use))
+                        continue;
+                    auto &slot = spilled[use];
+                    if (slot.valType->isFloat() != (round == 0))
+                        continue;
+                    int reg = findLoaded(slot);
+                    if (reg == -1)
+                    {
+                        if (round == 0)
+                        {
+                            assert(scnt < spill_sregs.size());
+                            reg = spill_sregs[scnt++];
+                        }
+                        else
+                        {
+                            assert(rcnt < spill_rregs.size());
+                            reg = spill_rregs[rcnt++];
+                            if (reg == 14)
+                                func->addSavedRegs(14);
+                        }
+                        insertSpillLoad(block, insts, reg, slot);
+                        loaded.push_back(std::make_pair(std::make_pair(slot.disp, slot.remat), reg));
+                    }
+                    use->setReg(reg);
+                }
+            // 重新计算的vreg在用到的地方再生成，原来的定值删除
+            if (inst->getDef().size() == 1 && spilled.count(inst->getDef()[0]) && spilled[inst->getDef()[0]].remat == inst)
+                continue;
+            insts.push_back(inst);
+            for (auto &def : inst->getDef())
+            {
+                if (!spilled.count(def))
+                    continue;
+                auto &slot = spilled[def];
+                int reg = findLoaded(slot);
+                if (reg == -1)
+                    reg = slot.valType->isFloat() ? spill_sregs[0] : spill_rregs[0];
+                def->setReg(reg);
+                insertSpillStore(block, insts, reg, slot, inst->getCond());
+            }
+        }
+        block->getInsts() = insts;
+    }
+}
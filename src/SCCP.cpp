@@ -0,0 +1,343 @@
+#include "SCCP.h"
+#include "Type.h"
+#include <queue>
+#include <climits>
+
+static std::set<Instruction *> freeInsts;
+
+void SCCP::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+    {
+        status.clear();
+        exec_edges.clear();
+        exec_blocks.clear();
+        propagate(*func);
+        rewrite(*func);
+    }
+}
+
+// 常量和const标识符直接取值；函数内定值的临时变量查格，初值为UNDEF；参数、全局变量等为NAC
+SCCP::Lattice SCCP::getStatus(Operand *op)
+{
+    auto se = op->getEntry();
+    if (se->isConstant())
+        return {Lattice::CONST, se->getValue()};
+    // 内联后const全局变量可以作为实参直接出现在运算中
+    if (se->isVariable() && se->getType()->isConst() && !se->getType()->isARRAY())
+        return {Lattice::CONST, se->getValue()};
+    if (se->isTemporary() && op->getDef() != nullptr)
+    {
+        auto it = status.find(se);
+        if (it != status.end())
+            return it->second;
+        return {Lattice::UNDEF, 0};
+    }
+    return {Lattice::NAC, 0};
+}
+
+// 格值只能单调下降，变化时把使用者加入SSA工作表
+void SCCP::setStatus(Instruction *inst, Lattice val)
+{
+    auto dst = inst->getDef()[0];
+    auto old = getStatus(dst);
+    if (old.state == Lattice::NAC || val.state == Lattice::UNDEF)
+        return;
+    if (old.state == Lattice::CONST)
+    {
+        if (val.state == Lattice::CONST && val.value == old.value)
+            return;
+        val.state = Lattice::NAC;
+    }
+    status[dst->getEntry()] = val;
+    for (auto user : dst->getUses())
+        ssa_worklist.push_back(user);
+}
+
+void SCCP::markEdge(BasicBlock *from, BasicBlock *to)
+{
+    if (exec_edges.insert(std::make_pair(from, to)).second)
+        cfg_worklist.push_back(std::make_pair(from, to));
+}
+
+static int toInt(long long val)
+{
+    return (int)(unsigned)val;
+}
+
+SCCP::Lattice SCCP::evaluate(Instruction *inst)
+{
+    auto &uses = inst->getUses();
+    std::vector<Lattice> srcs;
+    for (auto use : uses)
+    {
+        srcs.push_back(getStatus(use));
+        if (srcs.back().state == Lattice::NAC)
+            return {Lattice::NAC, 0};
+    }
+    for (auto &src : srcs)
+        if (src.state == Lattice::UNDEF)
+            return {Lattice::UNDEF, 0};
+    bool isFloat = uses[0]->getType()->isFloat();
+    if (inst->isBinary())
+    {
+        double a = srcs[0].value, b = srcs[1].value;
+        if (isFloat)
+        {
+            float res;
+            switch (inst->getOpcode())
+            {
+            case BinaryInstruction::ADD:
+                res = (float)a + (float)b;
+                break;
+            case BinaryInstruction::SUB:
+                res = (float)a - (float)b;
+                break;
+            case BinaryInstruction::MUL:
+                res = (float)a * (float)b;
+                break;
+            case BinaryInstruction::DIV:
+                if ((float)b == 0)
+                    return {Lattice::NAC, 0};
+                res = (float)a / (float)b;
+                break;
+            default:
+                return {Lattice::NAC, 0};
+            }
+            return {Lattice::CONST, res};
+        }
+        int x = (int)a, y = (int)b;
+        switch (inst->getOpcode())
+        {
+        case BinaryInstruction::ADD:
+            return {Lattice::CONST, (double)toInt((long long)x + y)};
+        case BinaryInstruction::SUB:
+            return {Lattice::CONST, (double)toInt((long long)x - y)};
+        case BinaryInstruction::MUL:
+            return {Lattice::CONST, (double)toInt((long long)x * y)};
+        case BinaryInstruction::DIV:
+        case BinaryInstruction::MOD:
+            // 除零和溢出保持原样，交给运行时
+            if (y == 0 || (x == INT_MIN && y == -1))
+                return {Lattice::NAC, 0};
+            return {Lattice::CONST, (double)(inst->getOpcode() == BinaryInstruction::DIV ? x / y : x % y)};
+        default:
+            return {Lattice::NAC, 0};
+        }
+    }
+    if (inst->isCmp())
+    {
+        double a = srcs[0].value, b = srcs[1].value;
+        if (isFloat)
+            a = (float)a, b = (float)b;
+        bool res;
+        switch (inst->getOpcode())
+        {
+        case CmpInstruction::E:
+            res = a == b;
+            break;
+        case CmpInstruction::NE:
+            res = a != b;
+            break;
+        case CmpInstruction::L:
+            res = a < b;
+            break;
+        case CmpInstruction::LE:
+            res = a <= b;
+            break;
+        case CmpInstruction::G:
+            res = a > b;
+            break;
+        case CmpInstruction::GE:
+            res = a >= b;
+            break;
+        default:
+            return {Lattice::NAC, 0};
+        }
+        return {Lattice::CONST, (double)res};
+    }
+    if (inst->isZext())
+        return {Lattice::CONST, (double)((int)srcs[0].value != 0)};
+    if (inst->isIntFloatCast())
+    {
+        if (inst->getOpcode() == IntFloatCastInstruction::S2F)
+            return {Lattice::CONST, (float)(int)srcs[0].value};
+        float val = (float)srcs[0].value;
+        if (val != val || val >= 2147483648.0f || val < -2147483648.0f)
+            return {Lattice::NAC, 0};
+        return {Lattice::CONST, (double)(int)val};
+    }
+    return {Lattice::NAC, 0};
+}
+
+void SCCP::visit(Instruction *inst)
+{
+    auto bb = inst->getParent();
+    if (!exec_blocks.count(bb))
+        return;
+    if (inst->isPHI())
+    {
+        // 只合并可执行边上的src
+        Lattice val = {Lattice::UNDEF, 0};
+        for (auto &kv : dynamic_cast<PhiInstruction *>(inst)->getSrcs())
+        {
+            if (!exec_edges.count(std::make_pair(kv.first, bb)))
+                continue;
+            auto src = getStatus(kv.second);
+            if (src.state == Lattice::UNDEF)
+                continue;
+            if (src.state == Lattice::NAC || (val.state == Lattice::CONST && val.value != src.value))
+            {
+                val = {Lattice::NAC, 0};
+                break;
+            }
+            val = src;
+        }
+        setStatus(inst, val);
+    }
+    else if (inst->isCond())
+    {
+        auto br = dynamic_cast<CondBrInstruction *>(inst);
+        auto cond = getStatus(inst->getUses()[0]);
+        if (cond.state == Lattice::CONST)
+            markEdge(bb, cond.value ? br->getTrueBranch() : br->getFalseBranch());
+        else if (cond.state == Lattice::NAC)
+        {
+            markEdge(bb, br->getTrueBranch());
+            markEdge(bb, br->getFalseBranch());
+        }
+    }
+    else if (inst->isUncond())
+        markEdge(bb, dynamic_cast<UncondBrInstruction *>(inst)->getBranch());
+    else if (inst->isBinary() || inst->isCmp() || inst->isZext() || inst->isIntFloatCast())
+        setStatus(inst, evaluate(inst));
+    else if (!inst->getDef().empty())
+        setStatus(inst, {Lattice::NAC, 0});
+}
+
+void SCCP::propagate(Function *func)
+{
+    auto entry = func->getEntry();
+    exec_blocks.insert(entry);
+    for (auto inst = entry->begin(); inst != entry->end(); inst = inst->getNext())
+        visit(inst);
+    while (!cfg_worklist.empty() || !ssa_worklist.empty())
+    {
+        while (!cfg_worklist.empty())
+        {
+            auto bb = cfg_worklist.back().second;
+            cfg_worklist.pop_back();
+            // 第一次可执行时求值整个块，否则只有PHI受新边影响
+            if (exec_blocks.insert(bb).second)
+            {
+                for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+                    visit(inst);
+            }
+            else
+            {
+                for (auto inst = bb->begin(); inst != bb->end() && inst->isPHI(); inst = inst->getNext())
+                    visit(inst);
+            }
+        }
+        while (!ssa_worklist.empty())
+        {
+            auto inst = ssa_worklist.back();
+            ssa_worklist.pop_back();
+            visit(inst);
+        }
+    }
+}
+
+static Operand *constOperand(Type *type, double value)
+{
+    Type *constType = TypeSystem::constIntType;
+    if (type->isFloat())
+        constType = TypeSystem::constFloatType;
+    else if (type->isBool())
+        constType = TypeSystem::constBoolType;
+    return new Operand(new ConstantSymbolEntry(constType, value));
+}
+
+static void removeInst(Instruction *inst)
+{
+    for (auto use : inst->getUses())
+        use->removeUse(inst);
+    inst->getParent()->remove(inst);
+    freeInsts.insert(inst);
+}
+
+void SCCP::rewrite(Function *func)
+{
+    for (auto bb : func->getBlockList())
+    {
+        if (!exec_blocks.count(bb))
+            continue;
+        auto inst = bb->begin();
+        while (inst != bb->end())
+        {
+            auto next = inst->getNext();
+            if (!inst->getDef().empty() && !inst->isCall())
+            {
+                auto val = getStatus(inst->getDef()[0]);
+                if (val.state == Lattice::CONST)
+                {
+                    inst->replaceAllUsesWith(constOperand(inst->getDef()[0]->getType(), val.value));
+                    removeInst(inst);
+                }
+            }
+            else if (inst->isCond())
+            {
+                auto br = dynamic_cast<CondBrInstruction *>(inst);
+                auto cond = getStatus(inst->getUses()[0]);
+                if (cond.state == Lattice::CONST)
+                {
+                    auto taken = cond.value ? br->getTrueBranch() : br->getFalseBranch();
+                    auto dead = cond.value ? br->getFalseBranch() : br->getTrueBranch();
+                    removeInst(inst);
+                    new UncondBrInstruction(taken, bb);
+                    if (dead != taken)
+                    {
+                        bb->removeSucc(dead);
+                        dead->removePred(bb);
+                        for (auto phi = dead->begin(); phi != dead->end() && phi->isPHI(); phi = phi->getNext())
+                            dynamic_cast<PhiInstruction *>(phi)->removeEdge(bb);
+                    }
+                }
+            }
+            inst = next;
+        }
+    }
+    // 删除分支折叠后不可达的基本块
+    std::set<BasicBlock *> reachable;
+    std::queue<BasicBlock *> q;
+    q.push(func->getEntry());
+    reachable.insert(func->getEntry());
+    while (!q.empty())
+    {
+        auto bb = q.front();
+        q.pop();
+        for (auto succ = bb->succ_begin(); succ != bb->succ_end(); succ++)
+            if (reachable.insert(*succ).second)
+                q.push(*succ);
+    }
+    auto blocks = func->getBlockList();
+    for (auto bb : blocks)
+    {
+        if (reachable.count(bb))
+            continue;
+        func->remove(bb);
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            for (auto use : inst->getUses())
+                use->removeUse(inst);
+        std::vector<BasicBlock *> preds(bb->pred_begin(), bb->pred_end());
+        std::vector<BasicBlock *> succs(bb->succ_begin(), bb->succ_end());
+        for (auto pred : preds)
+            pred->removeSucc(bb);
+        for (auto succ : succs)
+        {
+            succ->removePred(bb);
+            for (auto phi = succ->begin(); phi != succ->end() && phi->isPHI(); phi = phi->getNext())
+                dynamic_cast<PhiInstruction *>(phi)->removeEdge(bb);
+        }
+    }
+}
@@ -56,6 +56,21 @@ void SimplifyCFG::pass()
                 assert(bb->getNumOfSucc() == 1);
                 if (bb == func->getEntry() && succs[0]->getNumOfPred())
                     goto Next;
+                // 后继有PHI时，前驱已经是后继的前驱就无法区分两条边上的值
+                if (succs[0]->begin()->isPHI())
+                {
+                    for (auto pred : preds)
+                        if (std::find(succs[0]->pred_begin(), succs[0]->pred_end(), pred) != succs[0]->pred_end())
+                            goto Next;
+                    for (auto phi = succs[0]->begin(); phi != succs[0]->end() && phi->isPHI(); phi = phi->getNext())
+                    {
+                        auto PHI = dynamic_cast<PhiInstruction *>(phi);
+                        auto src = PHI->getSrcs()[bb];
+                        PHI->removeEdge(bb);
+                        for (auto pred : preds)
+                            PHI->addEdge(pred, src);
+                    }
+                }
                 succs[0]->removePred(bb);
                 for (auto pred : preds)
                 {
@@ -84,7 +99,6 @@ void SimplifyCFG::pass()
                     }
                     pred->addSucc(succs[0]);
                     succs[0]->addPred(pred);
-                    // toDO : PHI
                 }
                 if (bb == func->getEntry())
                     func->setEntry(succs[0]);
@@ -92,9 +106,27 @@ void SimplifyCFG::pass()
                 freeList.insert(bb);
             }
             // 如果仅有一个前驱且该前驱仅有一个后继，将基本块与前驱合并
-            else if (bb->getNumOfPred() == 1 && (*(bb->pred_begin()))->getNumOfSucc() == 1 && bb != func->getEntry())
+            else if (bb->getNumOfPred() == 1 && (*(bb->pred_begin()))->getNumOfSucc() == 1 && bb != func->getEntry() && *(bb->pred_begin()) != bb)
             {
                 auto pred = *(bb->pred_begin());
+                // 只有一个前驱的PHI只有一个src
+                while (bb->begin()->isPHI())
+                {
+                    auto phi = dynamic_cast<PhiInstruction *>(bb->begin());
+                    auto src = phi->getSrcs()[pred];
+                    phi->removeEdge(pred);
+                    phi->replaceAllUsesWith(src);
+                    bb->remove(phi);
+                    freeInsts.insert(phi);
+                }
+                for (auto succ : succs)
+                    for (auto phi = succ->begin(); phi != succ->end() && phi->isPHI(); phi = phi->getNext())
+                    {
+                        auto PHI = dynamic_cast<PhiInstruction *>(phi);
+                        auto src = PHI->getSrcs()[bb];
+                        PHI->removeEdge(bb);
+                        PHI->addEdge(pred, src);
+                    }
                 pred->removeSucc(bb);
                 auto lastInst = pred->rbegin();
                 assert(lastInst->isUncond() || (lastInst->isCond() && ((CondBrInstruction *)(lastInst))->getTrueBranch() == ((CondBrInstruction *)(lastInst))->getFalseBranch()));
@@ -140,7 +172,11 @@ void SimplifyCFG::pass()
                 for (auto pred : preds)
                     pred->removeSucc(bb);
                 for (auto succ : succs)
+                {
                     succ->removePred(bb);
+                    for (auto phi = succ->begin(); phi != succ->end() && phi->isPHI(); phi = phi->getNext())
+                        dynamic_cast<PhiInstruction *>(phi)->removeEdge(bb);
+                }
                 freeList.insert(bb);
             }
     }
@@ -0,0 +1,172 @@
+#include "TailRecursionElim.h"
+#include "Type.h"
+#include <map>
+
+void TailRecursionElim::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+    {
+        std::vector<TailSite> sites;
+        unsigned acc_opcode = BinaryInstruction::ADD;
+        if (!findSites(*func, sites, acc_opcode))
+            continue;
+        bool hasAcc = false;
+        for (auto &site : sites)
+            hasAcc |= site.acc_op != nullptr;
+        eliminate(*func, sites, hasAcc, acc_opcode);
+    }
+}
+
+static bool isSelfCall(Function *func, Instruction *inst)
+{
+    return inst->isCall() && dynamic_cast<FuncCallInstruction *>(inst)->getFuncSe() == func->getSymPtr();
+}
+
+static bool sameValue(Operand *a, Operand *b)
+{
+    return a->getEntry() == b->getEntry();
+}
+
+// 所有尾递归和累加器递归的调用点；累加器递归只接受同一种运算
+bool TailRecursionElim::findSites(Function *func, std::vector<TailSite> &sites, unsigned &acc_opcode)
+{
+    for (auto inst = func->getEntry()->begin(); inst != func->getEntry()->end(); inst = inst->getNext())
+        if (inst->isAlloca() && inst->getDef()[0]->usersNum() != 0)
+            return false;
+    for (auto param : func->getParamsList())
+        if (param->getType()->isPTR())
+            return false;
+    bool hasAcc = false;
+    for (auto bb : func->getBlockList())
+    {
+        auto ret = bb->rbegin();
+        if (!ret->isRet())
+            continue;
+        auto prev = ret->getPrev();
+        if (isSelfCall(func, prev))
+        {
+            if (ret->getUses().empty() || sameValue(ret->getUses()[0], prev->getDef()[0]))
+                sites.push_back({prev, nullptr, nullptr});
+            continue;
+        }
+        // r = x op f(...); ret r
+        if (ret->getUses().empty() || !prev->isBinary() || !sameValue(ret->getUses()[0], prev->getDef()[0]))
+            continue;
+        auto call = prev->getPrev();
+        if (!isSelfCall(func, call) || !prev->getDef()[0]->getType()->isInt())
+            continue;
+        if (prev->getOpcode() != BinaryInstruction::ADD && prev->getOpcode() != BinaryInstruction::MUL)
+            continue;
+        if (hasAcc && prev->getOpcode() != acc_opcode)
+            continue;
+        auto res = call->getDef()[0];
+        auto lhs = prev->getUses()[0], rhs = prev->getUses()[1];
+        if (sameValue(lhs, res) == sameValue(rhs, res))
+            continue;
+        hasAcc = true;
+        acc_opcode = prev->getOpcode();
+        sites.push_back({call, prev, sameValue(lhs, res) ? rhs : lhs});
+    }
+    return !sites.empty();
+}
+
+static void removeInst(Instruction *inst)
+{
+    for (auto use : inst->getUses())
+        use->removeUse(inst);
+    inst->getParent()->remove(inst);
+}
+
+static Operand *newTemporary(Type *type)
+{
+    return new Operand(new TemporarySymbolEntry(type, SymbolTable::getLabel()));
+}
+
+void TailRecursionElim::eliminate(Function *func, std::vector<TailSite> &sites, bool hasAcc, unsigned acc_opcode)
+{
+    auto header = func->getEntry();
+    auto entry = new BasicBlock(func);
+    func->moveBlockBefore(entry, header);
+    func->setEntry(entry);
+    // 有局部数组的函数不处理，剩下未被使用的alloca也移到新的入口块
+    auto inst = header->begin();
+    while (inst != header->end())
+    {
+        auto next = inst->getNext();
+        if (inst->isAlloca())
+        {
+            header->remove(inst);
+            entry->insertBack(inst);
+        }
+        inst = next;
+    }
+    new UncondBrInstruction(header, entry);
+    entry->addSucc(header);
+    header->addPred(entry);
+    // 形参的使用都改为header中的PHI
+    std::vector<PhiInstruction *> phis;
+    std::map<Operand *, Operand *> param_phis;
+    for (auto param : func->getParamsList())
+    {
+        auto dst = newTemporary(param->getType());
+        auto phi = new PhiInstruction(dst);
+        header->insertFront(phi);
+        phi->updateDst(dst);
+        for (auto user : param->getUses())
+            user->replaceUse(param, dst);
+        phi->addEdge(entry, param);
+        phis.push_back(phi);
+        param_phis[param] = dst;
+    }
+    PhiInstruction *acc = nullptr;
+    if (hasAcc)
+    {
+        auto retType = dynamic_cast<FunctionType *>(func->getSymPtr()->getType())->getRetType();
+        auto dst = newTemporary(retType);
+        acc = new PhiInstruction(dst);
+        header->insertFront(acc);
+        acc->updateDst(dst);
+        int identity = acc_opcode == BinaryInstruction::ADD ? 0 : 1;
+        acc->addEdge(entry, new Operand(new ConstantSymbolEntry(TypeSystem::constIntType, identity)));
+        // 非递归的返回处返回 累加器 op 返回值
+        for (auto bb : func->getBlockList())
+        {
+            auto ret = bb->rbegin();
+            if (!ret->isRet() || ret->getUses().empty())
+                continue;
+            bool isSite = false;
+            for (auto &site : sites)
+                isSite |= site.call->getParent() == bb;
+            if (isSite)
+                continue;
+            auto value = newTemporary(retType);
+            bb->insertBefore(new BinaryInstruction(acc_opcode, value, acc->getDef()[0], ret->getUses()[0]), ret);
+            ret->replaceUse(ret->getUses()[0], value);
+        }
+    }
+    for (auto &site : sites)
+    {
+        auto bb = site.call->getParent();
+        auto args = site.call->getUses();
+        for (size_t i = 0; i < phis.size(); i++)
+            phis[i]->addEdge(bb, args[i]);
+        removeInst(bb->rbegin());
+        if (site.acc_op != nullptr)
+            removeInst(site.acc_op);
+        removeInst(site.call);
+        if (acc != nullptr)
+        {
+            Operand *next = acc->getDef()[0];
+            if (site.acc_op != nullptr)
+            {
+                next = newTemporary(next->getType());
+                auto value = param_phis.count(site.acc_val) ? param_phis[site.acc_val] : site.acc_val;
+                new BinaryInstruction(acc_opcode, next, acc->getDef()[0], value, bb);
+            }
+            acc->addEdge(bb, next);
+        }
+        new UncondBrInstruction(header, bb);
+        bb->addSucc(header);
+        header->addPred(bb);
+    }
+}
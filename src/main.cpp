@@ -5,9 +5,10 @@
 #include "Unit.h"
 #include "MachineCode.h"
 #include "LinearScan.h"
-#include "SimplifyCFG.h"
-#include "Mem2Reg.h"
-#include "ElimPHI.h"
+#include "GraphColor.h"
+#include "MachineLICM.h"
+#include "MachinePeephole.h"
+#include "PassManager.h"
 using namespace std;
 
 Ast ast;
@@ -26,11 +27,34 @@ bool dump_ast;
 bool dump_ir;
 bool dump_asm;
 bool optimize;
+int opt_level;
+bool linear_scan; // -O2下也使用线性扫描分配寄存器
+bool fast_math;   // -ffast-math 允许改变浮点舍入的优化
+std::string passes; // -passes=a,b,c 自定义优化遍的顺序
 
 int main(int argc, char *argv[])
 {
     int opt;
-    while ((opt = getopt(argc, argv, "Siato:O::")) != -1)
+    // -passes=和-ffast-math不是单字母选项，在getopt之前取出
+    for (int i = 1; i < argc; i++)
+        if (strncmp(argv[i], "-passes=", 8) == 0)
+        {
+            passes = argv[i] + 8;
+            optimize = true;
+            for (int j = i; j < argc; j++)
+                argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        }
+        else if (strcmp(argv[i], "-ffast-math") == 0)
+        {
+            fast_math = true;
+            for (int j = i; j < argc; j++)
+                argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        }
+    while ((opt = getopt(argc, argv, "Siatlo:O::")) != -1)
     {
         switch (opt)
         {
@@ -49,11 +73,15 @@ int main(int argc, char *argv[])
         case 'S':
             dump_asm = true;
             break;
+        case 'l':
+            linear_scan = true;
+            break;
         case 'O':
             optimize = true;
+            opt_level = optarg ? atoi(optarg) : 1;
             break;
         default:
-            fprintf(stderr, "Usage: %s [-o outfile] infile\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-o outfile] [-O level] [-passes=pass1,pass2,...] [-ffast-math] infile\n", argv[0]);
             exit(EXIT_FAILURE);
             break;
         }
@@ -83,31 +111,39 @@ int main(int argc, char *argv[])
     // ast.typeCheck();
     ast.genCode(&unit);
     fprintf(stderr, "ir generated\n");
-    if (dump_ir && !optimize)
+    PassManager pm(&unit);
+    if (!passes.empty())
     {
-        unit.output();
-        fprintf(stderr, "ir output ok\n");
+        if (!pm.parsePipeline(passes))
+            exit(EXIT_FAILURE);
     }
+    else if (optimize)
+        pm.buildPipeline(opt_level);
+    pm.run();
     if (optimize)
-    {
-        // SimplifyCFG sc(&unit);
-        // sc.pass();
-        // Mem2Reg m2r(&unit);
-        // m2r.pass();
-        // // sc.pass();
-        // ElimPHI ep(&unit);
-        // ep.pass();
-        // sc.pass();
         fprintf(stderr, "opt ir generated\n");
-    }
-    if (dump_ir && optimize)
+    if (dump_ir)
     {
         unit.output();
-        fprintf(stderr, "opt ir output ok\n");
+        fprintf(stderr, "ir output ok\n");
     }
+    // SSA destruction放在输出IR之后，输出的IR中保留PHI
+    pm.runPass("elim-phi");
     unit.genMachineCode(&mUnit);
-    LinearScan linearScan(&mUnit);
-    linearScan.allocateRegisters();
+    // 机器码上的优化属于-O1及以上的默认流水线，-O0和-passes=指定的流水线不运行
+    bool machine_opt = opt_level >= 1 && passes.empty();
+    if (machine_opt)
+    {
+        MachineLICM(&mUnit).pass();
+        MachinePeephole(&mUnit, fast_math).pass();
+    }
+    RegisterAllocator *allocator;
+    if (opt_level >= 2 && !linear_scan)
+        allocator = new GraphColor(&mUnit);
+    else
+        allocator = new LinearScan(&mUnit);
+    allocator->allocateRegisters();
+    delete allocator;
     fprintf(stderr, "asm generated\n");
     if (dump_asm)
     {
@@ -140,9 +140,29 @@ LRVal
             delete [](char*)$1;
             assert(se != nullptr);
         }
-        Id* new_id = new Id(se, true);
-        new_id->setIndices(dynamic_cast<IndicesNode*>($2));
-        $$ = new_id;
+        IndicesNode* indices = dynamic_cast<IndicesNode*>($2);
+        // 常量数组且下标均为常量时直接折叠为数组元素的值
+        bool foldable = se->getType()->isARRAY() && se->getType()->isConst() &&
+                        indices->get_len() == ((ArrayType*)se->getType())->getLength();
+        for (auto idx : indices->getExprList())
+            foldable = foldable && idx->getType()->isConst();
+        if (foldable)
+        {
+            std::vector<int> dims = ((ArrayType*)se->getType())->fetch();
+            std::vector<double> vals = se->getArrVals();
+            std::vector<ExprNode*> idxs = indices->getExprList();
+            size_t offset = 0;
+            for (size_t i = 0; i < dims.size(); i++)
+                offset = offset * dims[i] + (int)idxs[i]->getValue();
+            double val = offset < vals.size() ? vals[offset] : 0;
+            $$ = new Constant(new ConstantSymbolEntry(((ArrayType*)se->getType())->getElemType(), val));
+        }
+        else
+        {
+            Id* new_id = new Id(se, true);
+            new_id->setIndices(indices);
+            $$ = new_id;
+        }
         delete []$1;
     }
     ; 